@@ -7,6 +7,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Part of the limited API from Python 3.11, but PyMemoryView_FromMemory
+// accepts it from 3.3.
+#ifndef PyBUF_READ
+#define PyBUF_READ 0x100
+#endif
+
 #define NTPY_TODO()                                                           \
     do                                                                        \
     {                                                                         \
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NT_COMPRESS_SINK_H
+#define NT_COMPRESS_SINK_H
+
+#include "nano_template/common.h"
+#include "nano_template/context.h"
+#include "nano_template/string_buffer.h"
+
+/// @brief A sink that compresses UTF-8 output a chunk at a time, using a
+/// compression object from Python's zlib module.
+///
+/// Compressed output is passed to `write` as it is produced, or collected
+/// and joined when the render finishes. The render buffer is compressed in
+/// place, so uncompressed output is never held beyond one chunk.
+typedef struct NT_CompressSink
+{
+    NT_Sink base;
+    PyObject *compressor; // A zlib compression object
+    PyObject *write;      // Callable[[bytes], object], or NULL
+    PyObject *chunks;     // Compressed output when `write` is NULL
+    PyObject *sync_flush; // zlib.Z_SYNC_FLUSH, or NULL
+} NT_CompressSink;
+
+/// @brief Initialize `sink` to compress at `level` in the format selected
+/// by `wbits`, as accepted by `zlib.compressobj`. If `write` is not NULL,
+/// compressed output is passed to it after every chunk, flushed so that it
+/// can be decompressed without waiting for the rest of the output.
+/// @return 0 on success, -1 on failure with an exception set.
+int NT_CompressSink_init(NT_CompressSink *sink, int level, int wbits,
+                         PyObject *write);
+
+/// @brief Finish the compressed stream after everything has been flushed
+/// to `sink`.
+/// @return New reference to the complete compressed output, or None if it
+/// was passed to `write`. NULL on failure with an exception set.
+PyObject *NT_CompressSink_finish(NT_CompressSink *sink);
+
+/// @brief Release references held by `sink`.
+void NT_CompressSink_clear(NT_CompressSink *sink);
+
+#endif
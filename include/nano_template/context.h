@@ -4,8 +4,25 @@
 #define NT_CONTEXT_H
 
 #include "nano_template/common.h"
+#include "nano_template/string_buffer.h"
 #include "nano_template/token.h"
 
+/// @brief A native destination for output as it is rendered, for streaming
+/// renders that don't pass output to a Python callable.
+typedef struct NT_Sink
+{
+    /// @brief Take everything in `buf`, leaving it empty.
+    /// @return 0 on success, -1 on failure with an exception set.
+    int (*flush)(struct NT_Sink *sink, NT_StringBuffer *buf);
+
+    /// @brief Take literal text `utf8`, which follows anything in `buf`,
+    /// either by copying it to `buf` or by holding on to it until the next
+    /// flush. `utf8` lives at least as long as the render. Can be NULL, in
+    /// which case text is always copied to `buf`.
+    /// @return 0 on success, -1 on failure with an exception set.
+    int (*text)(struct NT_Sink *sink, NT_StringBuffer *buf, PyObject *utf8);
+} NT_Sink;
+
 typedef struct NT_RenderContext
 {
     PyObject *str; // The input string
@@ -14,34 +31,213 @@ typedef struct NT_RenderContext
     Py_ssize_t size;     // Size of the stack
     Py_ssize_t capacity; // Stack capacity
 
+    // Owned references to loop-invariant variable paths resolved earlier in
+    // the same render, indexed by NT_Expr.slot.
+    PyObject **memo;
+    Py_ssize_t memo_size;
+
+    // Owned references to the current value of each loop variable, indexed
+    // by NT_Expr.binding and NT_Node.binding. Loop variables are never
+    // looked up in scope.
+    PyObject **bindings;
+    Py_ssize_t binding_count;
+
+    PyObject *lazy; // dict[Lazy, object] of called Lazy objects, or NULL
+
+    // Flattened paths from prepared data, and the index of the namespace
+    // they belong to. NULL and -1 if no prepared data is in scope.
+    PyObject *paths;
+    Py_ssize_t paths_index;
+
     PyObject *serializer; // Callable[[object], str]
     PyObject *undefined;  // Type[Undefined]
+
+    // Callable[[str], object] that receives output as it is rendered, or
+    // NULL to collect all output before returning it.
+    PyObject *write;
+
+    // Native destination for output as it is rendered, used instead of
+    // `write`, or NULL. Not owned by the context.
+    NT_Sink *sink;
+
+    // The least output, in characters, to collect before passing it to
+    // `write` or `sink`. Zero passes output on at every opportunity.
+    Py_ssize_t chunk_size;
+
+    // Callable[[AsyncIterable], Iterator] used by for tags to consume async
+    // iterables, or NULL if async iterables are not supported.
+    PyObject *aiter;
+
+    // Set when `aiter` fails for a for tag, before anything of the tag has
+    // been rendered, so that a paused render can retry the tag.
+    bool aiter_failed;
 } NT_RenderContext;
 
 /// @brief Allocate and initialize a new NT_RenderContext.
 /// Increment reference counts for `str`, `globals`, `serializer` and
 /// `undefined`. All are DECREFed in NT_RenderContext_free.
+/// @param memo_size The number of distinct variable paths in the template.
+/// @param binding_count The most loop variables bound at once.
 /// @return Newly allocated NT_RenderContext*, or NULL on memory error.
 NT_RenderContext *NT_RenderContext_new(PyObject *str, PyObject *globals,
                                        PyObject *serializer,
-                                       PyObject *undefined);
+                                       PyObject *undefined,
+                                       Py_ssize_t memo_size,
+                                       Py_ssize_t binding_count);
 
 void NT_RenderContext_free(NT_RenderContext *ctx);
 
-/// @brief Lookup `key` in the current scope.
-/// @return 0 if out was set to a new reference, or 1 if `key` is not in scope
-/// or `key` is not a Python str.
-int NT_RenderContext_get(const NT_RenderContext *ctx, PyObject *key,
-                         PyObject **out);
+/// @brief Call `visit` on each object owned by `ctx`, for the tp_traverse
+/// of an object that holds on to a render context.
+/// @return 0, or the first nonzero result of `visit`.
+int NT_RenderContext_traverse(const NT_RenderContext *ctx, visitproc visit,
+                              void *arg);
+
+/// @brief Get the result of calling Lazy object `op`, calling it if this is
+/// the first time it has been reached during this render.
+/// The result is owned by `ctx`. `owned` is released and set to NULL.
+/// @return A borrowed reference to the result, or NULL on failure with an
+/// exception set.
+PyObject *NT_RenderContext_force(NT_RenderContext *ctx, PyObject *op,
+                                 PyObject **owned);
+
+/// @brief Lookup `key` in the current scope, borrowing the result where the
+/// value is owned by a namespace.
+/// If a new reference had to be created, it is stored in `owned` and must be
+/// released with Py_XDECREF once the caller is done with the result.
+/// @param index Optional. Set to the index of the namespace `key` was found
+/// in.
+/// @return A borrowed reference, or NULL if `key` is not in scope.
+PyObject *NT_RenderContext_lookup(const NT_RenderContext *ctx, PyObject *key,
+                                  PyObject **owned, Py_ssize_t *index);
 
 /// @brief Extend scope with mapping `namespace`.
 /// A reference to `namespace` is stolen and DECREFed in
-/// `NT_RenderContext_free`.
+/// `NT_RenderContext_free`. If `namespace` is a Prepared object, its
+/// top-level dict is pushed and its flattened paths are made available to
+/// variable expressions.
 /// @return 0 on success, -1 on failure.
 int NT_RenderContext_push(NT_RenderContext *ctx, PyObject *namespace);
 
+/// @brief Return true if output is passed on as it is rendered, rather than
+/// collected until the end of the render.
+static inline bool NT_RenderContext_streaming(const NT_RenderContext *ctx)
+{
+    return ctx->write || ctx->sink;
+}
+
+/// @brief Pass everything in string buffer `buf` to `ctx->sink` or
+/// `ctx->write`, if either is set and there is output to pass on.
+/// @return 0 on success, -1 on failure with an exception set.
+int NT_RenderContext_flush(NT_RenderContext *ctx, NT_StringBuffer *buf);
+
+/// @brief Pass everything in string buffer `buf` to `ctx->sink` or
+/// `ctx->write`, if either is set and `buf` holds at least
+/// `ctx->chunk_size` characters.
+/// @return 0 on success, -1 on failure with an exception set.
+static inline int NT_RenderContext_maybe_flush(NT_RenderContext *ctx,
+                                               NT_StringBuffer *buf)
+{
+    if (!NT_RenderContext_streaming(ctx) ||
+        StringBuffer_length(buf) < ctx->chunk_size)
+    {
+        return 0;
+    }
+
+    return NT_RenderContext_flush(ctx, buf);
+}
+
+/// @brief Append literal text `str` to `buf`, or hand it to `ctx->sink`.
+/// `utf8` is `str` encoded ahead of time, or NULL.
+/// @return 0 on success, -1 on failure with an exception set.
+static inline int NT_RenderContext_append_text(NT_RenderContext *ctx,
+                                               NT_StringBuffer *buf,
+                                               PyObject *str, PyObject *utf8)
+{
+    if (ctx->sink && ctx->sink->text && utf8)
+    {
+        return ctx->sink->text(ctx->sink, buf, utf8);
+    }
+
+    return StringBuffer_append_text(buf, str, utf8);
+}
+
 /// @brief Remove the namespace at the top of the scope stack.
 /// Decrement the reference count for the popped namespace.
 void NT_RenderContext_pop(NT_RenderContext *ctx);
 
+/// @brief Get item `key` from `obj`, borrowing the result from exact dicts,
+/// lists and tuples.
+/// Borrowed dict lookups are not used on free-threaded builds, where another
+/// thread could mutate the dict while we hold its item.
+/// @return A borrowed reference, or NULL without an exception set if `obj`
+/// does not have item `key`. New references are also stored in `owned`.
+static inline PyObject *nt_getitem(PyObject *obj, PyObject *key,
+                                   PyObject **owned)
+{
+    PyObject *item = NULL;
+    *owned = NULL;
+
+#ifdef Py_GIL_DISABLED
+    if (PyDict_CheckExact(obj))
+    {
+        if (PyDict_GetItemRef(obj, key, &item) <= 0)
+        {
+            PyErr_Clear();
+            return NULL;
+        }
+
+        *owned = item;
+        return item;
+    }
+#else
+    if (PyDict_CheckExact(obj))
+    {
+        item = PyDict_GetItemWithError(obj, key);
+        if (!item)
+        {
+            PyErr_Clear();
+        }
+        return item;
+    }
+
+    if (PyLong_CheckExact(key) &&
+        (PyList_CheckExact(obj) || PyTuple_CheckExact(obj)))
+    {
+        Py_ssize_t index = PyLong_AsSsize_t(key);
+        if (index == -1 && PyErr_Occurred())
+        {
+            PyErr_Clear();
+            return NULL;
+        }
+
+        bool is_list = PyList_CheckExact(obj);
+        Py_ssize_t size = is_list ? PyList_Size(obj) : PyTuple_Size(obj);
+
+        if (index < 0)
+        {
+            index += size;
+        }
+
+        if (index < 0 || index >= size)
+        {
+            return NULL;
+        }
+
+        return is_list ? PyList_GetItem(obj, index)
+                       : PyTuple_GetItem(obj, index);
+    }
+#endif
+
+    item = PyObject_GetItem(obj, key);
+    if (!item)
+    {
+        PyErr_Clear();
+        return NULL;
+    }
+
+    *owned = item;
+    return item;
+}
+
 #endif
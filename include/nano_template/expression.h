@@ -44,6 +44,19 @@ typedef struct NT_Expr
     // column numbers.
     NT_Token *token;
 
+    // Index into the render context's memo for EXPR_VAR. Identical variable
+    // paths share a slot. -1 if the expression is not memoized.
+    Py_ssize_t slot;
+
+    // A tuple of path segments for EXPR_VAR, used to lookup flattened paths
+    // in prepared data. NULL for other expression kinds.
+    PyObject *path;
+
+    // Index into the render context's loop bindings for EXPR_VAR, if the
+    // first segment of the path is bound by an enclosing for tag. -1 if the
+    // path is loop-invariant.
+    Py_ssize_t binding;
+
     NT_ExprKind kind;
 } NT_Expr;
 
@@ -51,4 +64,72 @@ typedef struct NT_Expr
 /// @return Arbitrary Python object, or NULL on failure.
 PyObject *NT_Expr_evaluate(const NT_Expr *expr, NT_RenderContext *ctx);
 
+/// @brief Evaluate expression `expr` with data from context `ctx`, borrowing
+/// the result where it is owned by the scope or the syntax tree.
+/// If a new reference had to be created, it is stored in `owned` and must be
+/// released with Py_XDECREF once the caller is done with the result.
+/// @return A borrowed reference, or NULL on failure.
+PyObject *NT_Expr_evaluate_borrowed(const NT_Expr *expr, NT_RenderContext *ctx,
+                                    PyObject **owned);
+
+/// @brief Evaluate expression `expr` and test the result for truthiness.
+/// @return 1 if the result is truthy, 0 if it is falsy, or -1 on failure.
+int NT_Expr_truthy(const NT_Expr *expr, NT_RenderContext *ctx);
+
+/// @brief Test `op` for truthiness without calling back into Python.
+/// @return 1 if `op` is truthy, 0 if it is falsy, or -2 if `op` is not a
+/// built-in type we know how to test.
+static inline int nt_truthy_fast(PyObject *op)
+{
+    if (op == Py_True)
+    {
+        return 1;
+    }
+
+    if (op == Py_False || op == Py_None)
+    {
+        return 0;
+    }
+
+    if (PyUnicode_CheckExact(op))
+    {
+        return PyUnicode_GetLength(op) != 0;
+    }
+
+    if (PyDict_CheckExact(op))
+    {
+        return PyDict_Size(op) != 0;
+    }
+
+    if (PyList_CheckExact(op))
+    {
+        return PyList_Size(op) != 0;
+    }
+
+    if (PyTuple_CheckExact(op))
+    {
+        return PyTuple_Size(op) != 0;
+    }
+
+    return -2;
+}
+
+/// @brief Test `op` for truthiness.
+/// Common built-in types are tested inline. Everything else goes through
+/// PyObject_IsTrue, with `op` kept alive for the duration of the call.
+/// @return 1 if `op` is truthy, 0 if it is falsy, or -1 on failure.
+static inline int nt_truthy(PyObject *op)
+{
+    int rv = nt_truthy_fast(op);
+    if (rv != -2)
+    {
+        return rv;
+    }
+
+    Py_INCREF(op);
+    rv = PyObject_IsTrue(op);
+    Py_DECREF(op);
+    return rv;
+}
+
 #endif
\ No newline at end of file
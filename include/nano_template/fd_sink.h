@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NT_FD_SINK_H
+#define NT_FD_SINK_H
+
+#include "nano_template/common.h"
+#include "nano_template/context.h"
+#include "nano_template/string_buffer.h"
+
+/// @brief The most pieces of output written with one call to writev.
+#define NT_FD_SINK_MAX_SEGMENTS 64
+
+/// @brief Literal text shorter than this, in bytes, is copied to the render
+/// buffer rather than written from where it is.
+#define NT_FD_SINK_MIN_DIRECT 512
+
+/// @brief A piece of output waiting to be written.
+typedef struct NT_FdSegment
+{
+    PyObject *text;   // UTF-8 literal text, or NULL for a range of the buffer
+    Py_ssize_t start; // Start of the range of the render buffer
+    Py_ssize_t size;  // Number of bytes
+} NT_FdSegment;
+
+/// @brief A sink that writes UTF-8 output to a file descriptor.
+///
+/// Output is gathered into a list of segments, each either a range of the
+/// render buffer or long literal text that was encoded at parse time, and
+/// written with a single writev once `chunk_size` bytes are waiting. Long
+/// literal text is never copied. On Windows, segments are written one at
+/// a time.
+typedef struct NT_FdSink
+{
+    NT_Sink base;
+    int fd;
+    Py_ssize_t chunk_size; // The least output to collect before writing
+    Py_ssize_t written;    // Bytes written so far, even if a write failed
+    Py_ssize_t pending;    // Bytes of literal text waiting in `segments`
+    Py_ssize_t mark;       // Start of buffer output not yet in a segment
+    int segment_count;
+    NT_FdSegment segments[NT_FD_SINK_MAX_SEGMENTS];
+} NT_FdSink;
+
+/// @brief Initialize `sink` to write to file descriptor `fd`, which is not
+/// owned by the sink. The render buffer it is used with must be in UTF-8
+/// mode.
+void NT_FdSink_init(NT_FdSink *sink, int fd, Py_ssize_t chunk_size);
+
+#endif
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NT_JSON_TAPE_H
+#define NT_JSON_TAPE_H
+
+#include "nano_template/common.h"
+
+typedef enum
+{
+    JSON_NULL = 1,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_INT,
+    JSON_FLOAT,
+    JSON_STRING,
+    JSON_OBJECT,
+    JSON_ARRAY,
+} NT_JsonKind;
+
+/// @brief One JSON value on a tape. Object members are stored as a string
+/// entry for the key followed by the member's value.
+typedef struct NT_JsonEntry
+{
+    NT_JsonKind kind;
+
+    // True if a string contains at least one escape sequence.
+    bool escaped;
+
+    // Byte offsets of scalar text in the source document. For strings,
+    // these exclude the surrounding quotes.
+    Py_ssize_t start;
+    Py_ssize_t end;
+
+    // Number of members or items in an object or array.
+    Py_ssize_t count;
+
+    // Index of the entry following this value and all of its descendants.
+    Py_ssize_t next;
+} NT_JsonEntry;
+
+/// @brief A structural index over a JSON document. Scalars are left as
+/// source text until someone asks for them.
+typedef struct NT_JsonTape
+{
+    PyObject *bytes;  // The source document. A bytes object.
+    const char *data; // bytes' internal buffer.
+    Py_ssize_t length;
+
+    NT_JsonEntry *entries;
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+
+    // dict[str, bytes] of UTF-8 encoded keys we've been asked to find.
+    PyObject *keys;
+} NT_JsonTape;
+
+/// @brief Validate and index the JSON document in bytes object `bytes`.
+/// @return A newly allocated tape, or NULL on error with an exception set.
+NT_JsonTape *NT_JsonTape_new(PyObject *bytes);
+
+void NT_JsonTape_free(NT_JsonTape *tape);
+
+/// @brief Find the value of member `key` in the object at `index`. As with
+/// `json.loads`, the last of any duplicate keys wins.
+/// @return The index of the member's value, -1 if there's no such key, or
+/// -2 on error with an exception set.
+Py_ssize_t NT_JsonTape_find(NT_JsonTape *tape, Py_ssize_t index,
+                            PyObject *key);
+
+/// @brief Find the `n`th item of the array at `index`.
+/// @return The index of the item, or -1 if `n` is out of range.
+Py_ssize_t NT_JsonTape_item(NT_JsonTape *tape, Py_ssize_t index,
+                            Py_ssize_t n);
+
+/// @brief Build a Python object for the scalar at `index`.
+/// @return A new reference, or NULL on error with an exception set.
+PyObject *NT_JsonTape_scalar(NT_JsonTape *tape, Py_ssize_t index);
+
+/// @brief Build Python objects for the value at `index` and everything it
+/// contains, like `json.loads` would.
+/// @return A new reference, or NULL on error with an exception set.
+PyObject *NT_JsonTape_materialize(NT_JsonTape *tape, Py_ssize_t index);
+
+#endif
@@ -3,6 +3,7 @@
 #ifndef NT_NODE_H
 #define NT_NODE_H
 
+#include "nano_template/allocator.h"
 #include "nano_template/common.h"
 #include "nano_template/context.h"
 #include "nano_template/expression.h"
@@ -19,7 +20,15 @@ typedef enum
     NODE_FOR_BLOCK,
     NODE_ELIF_BLOCK,
     NODE_ELSE_BLOCK,
-    NODE_TEXT
+    NODE_TEXT,
+
+    // A for tag whose block only outputs its loop variable.
+    NODE_FOR_JOIN_TAG,
+
+    // Fused node kinds, produced by the peephole pass.
+    NODE_TEXT_OUTPUT,    // Optional text, an output, then optional text
+    NODE_IF_OUTPUT,      // `{% if x %}{{ x }}{% endif %}`
+    NODE_OUTPUT_DEFAULT, // `{{ x or "literal" }}`
 } NT_NodeKind;
 
 /// @brief One block of a paged array (unrolled linked list) holding AST nodes.
@@ -43,11 +52,67 @@ typedef struct NT_Node
     // variable or literal text.
     PyObject *str;
 
+    // Optional second string object. Like the name of the value variable in
+    // `{% for key, value in mapping %}`.
+    PyObject *str2;
+
+    // UTF-8 encodings of `str` and `str2` where they are literal text, for
+    // rendering to bytes without encoding them again. Otherwise NULL.
+    PyObject *bytes;
+    PyObject *bytes2;
+
+    // Index into the render context's loop bindings of a for tag's first
+    // loop variable. A second loop variable uses the next index.
+    Py_ssize_t binding;
+
     NT_NodeKind kind;
 } NT_Node;
 
 /// @brief Render node `node` to `buf` with data from `ctx`.
 /// @return 0 on success, -1 on failure with a Python error set.
-int NT_Node_render(const NT_Node *node, NT_RenderContext *ctx, PyObject *buf);
+int NT_Node_render(const NT_Node *node, NT_RenderContext *ctx,
+                   NT_StringBuffer *buf);
+
+/// @brief Remove the text nodes that `root`'s children start with, up to
+/// the first node that needs render data.
+/// @return A new reference to the removed nodes' text, which is empty if
+/// there were none, or NULL on failure with an exception set.
+PyObject *NT_Node_take_text_prefix(NT_Node *root);
+
+/// @brief Encode the literal text of `root` and its descendants to UTF-8,
+/// setting each node's `bytes` and `bytes2`. Encoded text is owned by
+/// `mem`, the allocator that owns the tree. Text that can't be encoded is
+/// left with `bytes` or `bytes2` set to NULL.
+/// @return 0 on success, -1 on failure with an exception set.
+int NT_Node_encode_text(NT_Mem *mem, NT_Node *root);
+
+/// @brief A suspended render. The blocks and for tags that rendering is part
+/// way through, innermost last, so rendering can be paused and resumed
+/// without holding on to the C stack.
+typedef struct NT_RenderStack NT_RenderStack;
+
+/// @brief Allocate a render stack, ready to render `root` from the start.
+/// @return The new stack, or NULL on failure with an exception set.
+NT_RenderStack *NT_RenderStack_new(const NT_Node *root);
+
+/// @brief Free `stack` and any loops it is part way through. `stack` can
+/// be NULL.
+void NT_RenderStack_free(NT_RenderStack *stack);
+
+/// @brief Call `visit` on each object held by loops `stack` is part way
+/// through. `stack` can be NULL.
+/// @return 0, or the first nonzero result of `visit`.
+int NT_RenderStack_traverse(const NT_RenderStack *stack, visitproc visit,
+                            void *arg);
+
+/// @brief Render from where `stack` left off until `buf` holds at least
+/// `chunk_size` characters, or rendering is done. Rendering only pauses
+/// between nodes and loop items.
+/// @return 1 if there's more to render, 0 if rendering is done, or -1 on
+/// failure with an exception set. Don't resume a stack after a failure,
+/// unless `ctx->aiter_failed` is set, in which case the for tag that failed
+/// is entered again.
+int NT_RenderStack_resume(NT_RenderStack *stack, NT_RenderContext *ctx,
+                          NT_StringBuffer *buf, Py_ssize_t chunk_size);
 
 #endif
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NT_NUMERIC_BUFFER_H
+#define NT_NUMERIC_BUFFER_H
+
+#include "nano_template/common.h"
+
+/// @brief The most bytes written by NT_NumericBuffer_format.
+#define NT_NUMBER_MAX 32
+
+/// @brief The size of the scratch buffer numeric loops format output into
+/// before passing it on.
+#define NT_NUMERIC_CHUNK_SIZE 8192
+
+/// @brief The items of a one-dimensional buffer of integers, doubles or
+/// bools, from an object that supports the buffer protocol.
+typedef struct NT_NumericBuffer
+{
+    PyObject *bytes;     // Owned copy of the buffer's contents, or NULL
+    const char *data;    // Contents of `bytes`
+    Py_ssize_t size;     // Number of items
+    Py_ssize_t itemsize; // Size of each item in bytes
+    char format;         // A native `struct` module format character
+} NT_NumericBuffer;
+
+/// @brief Copy the items of `op` into `nb`, if `op` exports a 1-D buffer of
+/// native integers, doubles or bools.
+/// @return 0 on success, 1 if `op` is not a numeric buffer, or -1 on error
+/// with an exception set.
+int NT_NumericBuffer_init(NT_NumericBuffer *nb, PyObject *op);
+
+void NT_NumericBuffer_clear(NT_NumericBuffer *nb);
+
+/// @brief Write item `index` of `nb` to `out` as `str()` would format it,
+/// without creating a Python object. `out` must have room for
+/// NT_NUMBER_MAX bytes.
+/// @return The number of bytes written, or -1 on error with an exception
+/// set.
+Py_ssize_t NT_NumericBuffer_format(const NT_NumericBuffer *nb,
+                                   Py_ssize_t index, char *out);
+
+#endif
@@ -22,6 +22,17 @@ typedef struct NT_Parser
     Py_ssize_t pos; // Current index into tokens.
 
     NT_TokenKind whitespace_carry; // Preceding whitespace control.
+
+    PyObject *paths;     // dict[tuple[str | int, ...], int] of variable paths.
+    PyObject *loop_vars; // list[str] of enclosing loop variable names.
+
+    // The most loop variables bound at once. One binding slot is allocated
+    // for each when rendering.
+    Py_ssize_t binding_count;
+
+    // dict[tuple[str | int, ...], None] of paths that don't start with a
+    // loop variable, in the order they appear.
+    PyObject *root_paths;
 } NT_Parser;
 
 /// @brief Allocate and initialize a new NT_Parser.
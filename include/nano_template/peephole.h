@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NT_PEEPHOLE_H
+#define NT_PEEPHOLE_H
+
+#include "nano_template/allocator.h"
+#include "nano_template/common.h"
+#include "nano_template/node.h"
+
+/// @brief Rewrite common node sequences in the tree rooted at `root` into
+/// fused node kinds, which render with fewer dispatches.
+///
+/// - text, output, text becomes NODE_TEXT_OUTPUT.
+/// - `{% if x %}{{ x }}{% endif %}` becomes NODE_IF_OUTPUT.
+/// - `{{ x or "literal" }}` becomes NODE_OUTPUT_DEFAULT.
+///
+/// New nodes are allocated from `mem`, the allocator that owns the tree.
+/// @return 0 on success, -1 on failure with an exception set.
+int NT_Peephole_optimize(NT_Mem *mem, NT_Node *root);
+
+#endif
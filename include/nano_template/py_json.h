@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NTPY_JSON_H
+#define NTPY_JSON_H
+
+#include "nano_template/common.h"
+#include "nano_template/json_tape.h"
+
+/// @brief A read-only mapping or sequence view of an object or array in a
+/// JSON document. Members are looked up on the document's tape, and Python
+/// objects are only built for scalars as they are accessed.
+typedef struct
+{
+    PyObject_HEAD
+
+        // A capsule owning the tape, shared by every view of the document.
+        PyObject *doc;
+
+    NT_JsonTape *tape;
+    Py_ssize_t index;
+} NTPY_JSONViewObject;
+
+/// @brief Index the JSON document in `buf`, a str, bytes or bytearray.
+/// @return A new reference to a view of the document's top-level object, or
+/// NULL on error with an exception set.
+PyObject *NTPY_JSONView_parse(PyObject *buf);
+
+/// @brief Return true if `op` is a JSONView object.
+bool NTPY_JSONView_Check(PyObject *op);
+
+/// @brief Replace JSON views in `op`, or in tuple `op`, with the dicts and
+/// lists they represent, ready for a serializer.
+/// @return A new reference, or NULL on error with an exception set.
+PyObject *NTPY_JSONView_materialize(PyObject *op);
+
+int nt_register_json_view_type(PyObject *module);
+
+#endif
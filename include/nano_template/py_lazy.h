@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NTPY_LAZY_H
+#define NTPY_LAZY_H
+
+#include "nano_template/common.h"
+
+/// @brief A callable in render data that is called at most once per render,
+/// the first time a template reaches it.
+typedef struct
+{
+    PyObject_HEAD PyObject *fn;
+} NTPY_LazyObject;
+
+/// @brief Wrap callable `fn` in a new Lazy object.
+/// @return A new reference to a Lazy object, or NULL on error with an
+/// exception set.
+PyObject *lazy(PyObject *self, PyObject *fn);
+
+/// @brief Return true if `op` is a Lazy object.
+bool NTPY_Lazy_Check(PyObject *op);
+
+int nt_register_lazy_type(PyObject *module);
+
+#endif
@@ -6,6 +6,7 @@
 #include "nano_template/common.h"
 
 /// @brief Parse argument string as a template.
+/// The optional fifth argument disables the peephole pass when false.
 /// @return A new reference to a NTPY_Template, or NULL on error with an
 /// exception set.
 PyObject *parse(PyObject *self, PyObject *args);
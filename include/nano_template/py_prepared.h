@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NTPY_PREPARED_H
+#define NTPY_PREPARED_H
+
+#include "nano_template/common.h"
+
+/// @brief Render data that has been frozen for fast repeated lookups.
+typedef struct
+{
+    PyObject_HEAD
+
+        // A copy of the top-level mapping, with interned str keys.
+        PyObject *root;
+
+    // dict[tuple[str | int, ...], object] mapping every path through nested
+    // dicts, of two or more segments, to its value.
+    PyObject *paths;
+} NTPY_PreparedObject;
+
+/// @brief Prepare `mapping` for repeated rendering.
+/// @return A new reference to a Prepared object, or NULL on error with an
+/// exception set.
+PyObject *prepare(PyObject *self, PyObject *mapping);
+
+/// @brief Return true if `op` is a Prepared object.
+bool NTPY_Prepared_Check(PyObject *op);
+
+int nt_register_prepared_type(PyObject *module);
+
+#endif
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NTPY_RENDER_ITERATOR_H
+#define NTPY_RENDER_ITERATOR_H
+
+#include "nano_template/common.h"
+#include "nano_template/context.h"
+#include "nano_template/node.h"
+#include "nano_template/string_buffer.h"
+
+/// @brief An iterator of rendered chunks. Rendering is paused between
+/// chunks, with its progress kept on an explicit render stack.
+typedef struct
+{
+    PyObject_HEAD PyObject *template; // Keeps the template's AST alive
+    NT_RenderContext *ctx;
+    NT_StringBuffer *buf;
+    NT_RenderStack *stack; // NULL once rendering is done or has failed
+    Py_ssize_t chunk_size;
+    bool running;
+    bool prefix_pending; // The buffered prefix is to be yielded on its own
+} NTPY_RenderIteratorObject;
+
+/// @brief Create an iterator that renders `root` with render context `ctx`,
+/// yielding chunks of at least `chunk_size` characters. The iterator takes
+/// ownership of `ctx`, even on failure.
+/// @param template The template that owns `root`.
+/// @param prefix Text to output before rendering `root`, or NULL.
+/// @param flush_prefix If true, yield `prefix` on its own, otherwise it is
+/// part of the first chunk.
+/// @return A new reference to a RenderIterator, or NULL on error with an
+/// exception set.
+PyObject *NTPY_RenderIterator_new(PyObject *template, const NT_Node *root,
+                                  PyObject *prefix, bool flush_prefix,
+                                  NT_RenderContext *ctx,
+                                  Py_ssize_t chunk_size);
+
+int nt_register_render_iterator_type(PyObject *module);
+
+#endif
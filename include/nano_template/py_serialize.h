@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef NTPY_SERIALIZE_H
+#define NTPY_SERIALIZE_H
+
+#include "nano_template/common.h"
+
+/// @brief The default serializer. Lists, dicts and tuples are serialized
+/// with `json.dumps`, everything else with `str`.
+/// @return A new reference to a str, or NULL on error with an exception set.
+PyObject *serialize(PyObject *self, PyObject *obj);
+
+/// @brief Return true if `op` is the default serializer, so output can be
+/// serialized without calling back into it.
+bool NTPY_Serializer_is_default(PyObject *op);
+
+/// @brief Remember the module's `serialize` function, for comparison in
+/// NTPY_Serializer_is_default.
+int nt_register_serializer(PyObject *module);
+
+#endif
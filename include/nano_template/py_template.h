@@ -12,19 +12,38 @@ typedef struct NTPY_Template
     PyObject_HEAD
 
         PyObject *str;
-    NT_Node *root;
+    PyObject *prefix;       // Leading static text, or NULL if there isn't any
+    PyObject *prefix_bytes; // `prefix` encoded to UTF-8, or NULL
+    NT_Node *root;          // Everything after `prefix`
     NT_Mem *ast;
 
+    Py_ssize_t path_count;    // Number of distinct variable paths
+    Py_ssize_t binding_count; // Most loop variables bound at once
+    PyObject *root_paths;     // tuple[tuple[str | int, ...], ...]
+
     PyObject *serializer; // Callable[[object], str]
     PyObject *undefined;  // Type[Undefined]
+    PyObject *globals;    // Mapping[str, object] | Prepared, or NULL
+
+    // Output of recent renders, used to presize render buffers. These are
+    // hints only, accessed with relaxed atomics on free-threaded builds.
+    Py_ssize_t size_estimate;      // Smoothed output length, in characters
+    Py_ssize_t utf8_size_estimate; // Smoothed UTF-8 output length, in bytes
+    Py_UCS4 last_maxchar;          // Largest character in the last output
 } NTPY_Template;
 
 /// @brief Allocate and initialize a new NTPY_Template.
+/// @param prefix Text to output before rendering `root`. Can be empty.
+/// @param root_paths A tuple of variable paths that are resolved from render
+/// data rather than from loop variables.
+/// @param globals Template-level render data, placed beneath data passed to
+/// `render`. Can be NULL.
 /// @return The new template, or NULL on failure with an exception set.
-PyObject *NTPY_Template_new(PyObject *str, NT_Node *root, NT_Mem *ast,
-                            PyObject *serializer, PyObject *undefined);
-
-void NTPY_Template_free(PyObject *self);
+PyObject *NTPY_Template_new(PyObject *str, PyObject *prefix, NT_Node *root,
+                            NT_Mem *ast,
+                            Py_ssize_t path_count, Py_ssize_t binding_count,
+                            PyObject *root_paths, PyObject *serializer,
+                            PyObject *undefined, PyObject *globals);
 
 int nt_register_template_type(PyObject *module);
 
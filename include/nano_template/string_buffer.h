@@ -5,17 +5,145 @@
 
 #include "nano_template/common.h"
 
+/// @brief A growable buffer of characters, copied in as strings are
+/// appended, and turned into a single str when rendering is done.
+///
+/// With the full C API, characters are stored with the narrowest width that
+/// fits, widening from UCS1 to UCS2 to UCS4 as needed, or are written with
+/// PyUnicodeWriter on Python 3.14 and later. With the limited API,
+/// characters are stored as Latin-1, widening to UCS4 if a wider character
+/// is appended, and decoded once at the end.
+///
+/// A buffer created in UTF-8 mode holds encoded bytes instead, and is
+/// turned into a bytes object. Its length and capacity count bytes.
+typedef struct NT_StringBuffer
+{
+#if !defined(Py_LIMITED_API) && PY_VERSION_HEX >= 0x030E0000
+    PyUnicodeWriter *writer; // Created on first append
+#elif !defined(Py_LIMITED_API)
+    void *data;      // UCS1, UCS2 or UCS4 characters, depending on `kind`
+    int kind;        // PyUnicode_1BYTE_KIND, 2BYTE or 4BYTE
+    Py_UCS4 maxchar; // The largest character appended so far
+#else
+    void *data;      // Latin-1 or UCS4 characters, depending on `kind`
+    int kind;        // Bytes per character, 1 or 4
+    Py_UCS4 maxchar; // A bound on the largest character appended so far
+#endif
+    char *bytes;         // UTF-8 storage, used instead of the above if `utf8`
+    bool utf8;           // True if the buffer holds UTF-8 bytes
+    Py_ssize_t length;   // Number of characters in the buffer
+    Py_ssize_t capacity; // Number of characters allocated
+    Py_ssize_t peak;     // Most characters held since last released
+} NT_StringBuffer;
+
 /// @brief Allocate a new empty string buffer.
-/// @return A PyList to act as our buffer.
-PyObject *StringBuffer_new(void);
+/// @return The new buffer, or NULL on failure with an exception set.
+NT_StringBuffer *StringBuffer_new(void);
+
+/// @brief Allocate a new empty string buffer with room for `capacity`
+/// characters, stored wide enough for characters up to `maxchar`.
+/// @return The new buffer, or NULL on failure with an exception set.
+NT_StringBuffer *StringBuffer_new_sized(Py_ssize_t capacity,
+                                        Py_UCS4 maxchar);
+
+/// @brief Allocate a new empty buffer in UTF-8 mode, with room for
+/// `capacity` bytes.
+/// @return The new buffer, or NULL on failure with an exception set.
+NT_StringBuffer *StringBuffer_new_utf8(Py_ssize_t capacity);
+
+/// @brief Free `sb` and anything it holds. `sb` can be NULL.
+void StringBuffer_free(NT_StringBuffer *sb);
+
+/// @brief Take the current thread's scratch buffer, with room for
+/// `capacity` characters up to `maxchar`.
+///
+/// Scratch buffers keep their storage between renders, so steady rendering
+/// on a thread doesn't allocate and grow a new buffer each time. If the
+/// thread's buffer is already in use, a new buffer is allocated instead.
+/// @return An empty buffer, or NULL on failure with an exception set.
+NT_StringBuffer *StringBuffer_acquire(Py_ssize_t capacity, Py_UCS4 maxchar);
 
-/// @brief Append a string to the buffer.
+/// @brief Like StringBuffer_acquire, but take the current thread's UTF-8
+/// scratch buffer, with room for `capacity` bytes.
+/// @return An empty buffer, or NULL on failure with an exception set.
+NT_StringBuffer *StringBuffer_acquire_utf8(Py_ssize_t capacity);
+
+/// @brief Return a buffer to the current thread's scratch slot, discarding
+/// its contents, or free it if the slot is full. `sb` can be NULL.
+///
+/// Storage that is much larger than recent renders have needed, or larger
+/// than NT_SCRATCH_MAX_SIZE, is freed rather than kept.
+void StringBuffer_release(NT_StringBuffer *sb);
+
+/// @brief Create the key that scratch buffers are stored under in thread
+/// state dicts. Call once at module initialization.
 /// @return 0 on success, -1 on failure with an exception set.
-int StringBuffer_append(PyObject *sb, PyObject *str);
+int nt_init_scratch_buffers(void);
+
+/// @brief Append a string to the buffer, encoding it if the buffer is in
+/// UTF-8 mode.
+/// @return 0 on success, -1 on failure with an exception set.
+int StringBuffer_append(NT_StringBuffer *sb, PyObject *str);
+
+/// @brief Append `size` bytes of valid UTF-8 from `s` to the buffer,
+/// decoding them if the buffer is not in UTF-8 mode.
+/// @return 0 on success, -1 on failure with an exception set.
+int StringBuffer_append_utf8(NT_StringBuffer *sb, const char *s,
+                             Py_ssize_t size);
+
+/// @brief Append literal text `str` to the buffer. `utf8` is `str` encoded
+/// ahead of time, or NULL, and is copied as it is in UTF-8 mode.
+/// @return 0 on success, -1 on failure with an exception set.
+static inline int StringBuffer_append_text(NT_StringBuffer *sb,
+                                           PyObject *str, PyObject *utf8)
+{
+    if (sb->utf8 && utf8)
+    {
+        return StringBuffer_append_utf8(sb, PyBytes_AsString(utf8),
+                                        PyBytes_Size(utf8));
+    }
+
+    return StringBuffer_append(sb, str);
+}
+
+/// @brief Return the number of characters, or bytes in UTF-8 mode, in the
+/// buffer.
+static inline Py_ssize_t StringBuffer_length(const NT_StringBuffer *sb)
+{
+    return sb->length;
+}
+
+/// @brief Return the bytes held by a buffer in UTF-8 mode. The pointer is
+/// valid until the buffer is next changed.
+static inline const char *StringBuffer_utf8_data(const NT_StringBuffer *sb)
+{
+    return sb->bytes;
+}
+
+/// @brief Return true if the buffer holds UTF-8 bytes.
+static inline bool StringBuffer_is_utf8(const NT_StringBuffer *sb)
+{
+    return sb->utf8;
+}
+
+/// @brief Return a bound on the largest character appended since the
+/// buffer was last emptied, like PyUnicode_MAX_CHAR_VALUE, or 0 if the
+/// buffer is written with PyUnicodeWriter. The bound is no more than 0xff
+/// only if every character is Latin-1.
+Py_UCS4 StringBuffer_maxchar(const NT_StringBuffer *sb);
+
+/// @brief Discard the buffer's contents, keeping its storage.
+void StringBuffer_reset(NT_StringBuffer *sb);
+
+/// @brief Build a string, or bytes in UTF-8 mode, from the buffer's
+/// contents and empty the buffer.
+/// @return The new object, or NULL on failure.
+PyObject *StringBuffer_flush(NT_StringBuffer *sb);
 
-/// @brief Join buffer items into a single string and destroy the buffer.
-/// Do not Py_DECREF the buffer after calling this.
-/// @return The concatenated string, or NULL on failure.
-PyObject *StringBuffer_finish(PyObject *sb);
+/// @brief Build a string, or bytes in UTF-8 mode, from the buffer's
+/// contents and free the buffer. Do not call StringBuffer_free after
+/// calling this.
+/// @return The new object, or NULL on failure.
+PyObject *StringBuffer_finish(NT_StringBuffer *sb);
 
 #endif
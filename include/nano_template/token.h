@@ -38,6 +38,7 @@ typedef enum
     TOK_OR,
     TOK_NOT,
     TOK_IN,
+    TOK_COMMA,
     TOK_ERROR,
     TOK_UNKNOWN,
     TOK_EOF,
@@ -74,6 +75,7 @@ static const char *NT_TokenKind_names[] = {
     [TOK_OR] = "TOK_OR",
     [TOK_NOT] = "TOK_NOT",
     [TOK_IN] = "TOK_IN",
+    [TOK_COMMA] = "TOK_COMMA",
     [TOK_ERROR] = "TOK_ERROR",
     [TOK_EOF] = "TOK_EOF"};
 
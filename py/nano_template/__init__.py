@@ -1,14 +1,18 @@
 # SPDX-License-Identifier: MIT
 
-import json
 from collections.abc import Mapping
 from typing import Any
 from typing import Callable
 from typing import Type
 
+from ._nano_template import Lazy
+from ._nano_template import Prepared
 from ._nano_template import Template
 from ._nano_template import TokenView as _TokenView
+from ._nano_template import lazy
 from ._nano_template import parse as _parse
+from ._nano_template import prepare
+from ._nano_template import serialize
 from ._nano_template import tokenize as _tokenize
 from ._token_kind import TokenKind as _TokenKind
 from ._undefined import Undefined
@@ -21,7 +25,11 @@ __all__ = (
     "_tokenize",
     "_TokenKind",
     "_TokenView",
+    "Lazy",
+    "lazy",
     "parse",
+    "Prepared",
+    "prepare",
     "render",
     "serialize",
     "StrictUndefined",
@@ -33,19 +41,20 @@ __all__ = (
 )
 
 
-def serialize(obj: object) -> str:
-    return json.dumps(obj) if isinstance(obj, (list, dict, tuple)) else str(obj)
-
-
 def parse(
     source: str,
     *,
     serializer: Callable[[object], str] = serialize,
     undefined: Type[Undefined] = Undefined,
+    globals: Mapping[str, Any] | Prepared | None = None,
 ) -> Template:
-    """Parse `source` as a template."""
+    """Parse `source` as a template.
+
+    Variables in `globals` are available to every render of the template,
+    beneath data passed to `Template.render`.
+    """
     try:
-        return _parse(source, serializer, undefined)
+        return _parse(source, serializer, undefined, globals)
     except RuntimeError as err:
         raise TemplateSyntaxError(
             str(err),
@@ -57,10 +66,13 @@ def parse(
 
 def render(
     source: str,
-    data: Mapping[str, Any],
+    data: Mapping[str, Any] | Prepared,
     *,
     serializer: Callable[[object], str] = serialize,
     undefined: Type[Undefined] = Undefined,
+    globals: Mapping[str, Any] | Prepared | None = None,
 ) -> str:
     """Render template `source` with variables from `data`."""
-    return parse(source, serializer=serializer, undefined=undefined).render(data)
+    return parse(
+        source, serializer=serializer, undefined=undefined, globals=globals
+    ).render(data)
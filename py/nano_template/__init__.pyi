@@ -3,7 +3,11 @@ from typing import Any
 from typing import Callable
 from typing import Type
 
+from ._nano_template import Lazy
+from ._nano_template import Prepared
 from ._nano_template import Template
+from ._nano_template import lazy
+from ._nano_template import prepare
 from ._nano_template import TokenView as _TokenView
 from ._nano_template import tokenize as _tokenize
 from ._token_kind import TokenKind as _TokenKind
@@ -17,7 +21,11 @@ __all__ = (
     "_tokenize",
     "_TokenKind",
     "_TokenView",
+    "Lazy",
+    "lazy",
     "parse",
+    "Prepared",
+    "prepare",
     "render",
     "serialize",
     "StrictUndefined",
@@ -34,11 +42,13 @@ def parse(
     *,
     serializer: Callable[[object], str] = serialize,
     undefined: Type[Undefined] = Undefined,
+    globals: Mapping[str, Any] | Prepared | None = None,
 ) -> Template: ...
 def render(
     source: str,
-    data: Mapping[str, Any],
+    data: Mapping[str, Any] | Prepared,
     *,
     serializer: Callable[[object], str] = serialize,
     undefined: Type[Undefined] = Undefined,
+    globals: Mapping[str, Any] | Prepared | None = None,
 ) -> str: ...
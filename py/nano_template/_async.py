@@ -0,0 +1,370 @@
+# SPDX-License-Identifier: MIT
+
+"""Awaitable-aware rendering.
+
+Before rendering, we follow every variable path a template resolves from
+render data, gathering awaitables we find along the way. Awaitables found
+at the same depth are awaited concurrently. Resolved values are then passed
+to `Template.render` as overrides, copying containers on the way to nested
+awaitables so that render data is never modified.
+
+The renderer can't wait for an async iterable, so a render that reaches one
+is paused there and carried on in a worker thread. Each item is fetched on
+the event loop, and output is handed back to the event loop as it is
+rendered.
+"""
+
+from __future__ import annotations
+
+import asyncio
+import inspect
+from collections import ChainMap
+from collections.abc import Mapping
+from typing import TYPE_CHECKING
+from typing import AsyncIterable
+from typing import AsyncIterator
+from typing import Awaitable
+from typing import Callable
+from typing import Iterator
+from typing import Sequence
+
+if TYPE_CHECKING:
+    from ._nano_template import Template
+
+_Path = tuple[object, ...]
+
+_MISSING = object()
+_DONE = object()
+
+# The most rendered chunks waiting to be consumed before rendering pauses.
+_MAX_PENDING_CHUNKS = 16
+
+
+class _AsyncIterationRequired(Exception):
+    """Raised by a synchronous render that reaches an async iterable."""
+
+
+class _Closed(Exception):
+    """Raised in a worker thread when its output is no longer wanted."""
+
+
+async def render_async(
+    template: Template,
+    data: Mapping[str, object],
+    overrides: Mapping[str, object] | None = None,
+) -> str:
+    """Render `template` after awaiting awaitables it would reach in `data`,
+    `overrides` and the template's globals."""
+    namespace = _namespace(template, data, overrides)
+
+    resolved = await _prefetch(template.paths, namespace)
+
+    if resolved and overrides is not None:
+        overrides = ChainMap(resolved, overrides)  # type: ignore
+    elif resolved:
+        overrides = resolved
+
+    # Most templates don't loop over async iterables, so start rendering
+    # without a worker thread. The render pauses at the first for tag that
+    # loops over an async iterable, and is carried on from there in a worker
+    # thread, so nothing is evaluated twice.
+    aiter = _SwitchableAiter()
+    render = template._iter_stream(data, overrides, aiter)
+    buf: list[str] = []
+    try:
+        for chunk in render:
+            buf.append(chunk)
+    except _AsyncIterationRequired:
+
+        def resume(
+            write: Callable[[str], object],
+            blocking_aiter: Callable[[AsyncIterable[object]], Iterator[object]],
+        ) -> None:
+            aiter.fn = blocking_aiter
+            for chunk in render:
+                write(chunk)
+
+        buf.extend([chunk async for chunk in _stream(resume)])
+
+    return "".join(buf)
+
+
+async def render_async_iter(
+    template: Template,
+    data: Mapping[str, object],
+    overrides: Mapping[str, object] | None = None,
+    *,
+    flush_prefix: bool = False,
+) -> AsyncIterator[str]:
+    """Render `template` one chunk at a time, consuming async iterables in
+    for tags as they produce items. If `flush_prefix` is true, the template's
+    static prefix is yielded on its own before awaiting anything."""
+    # Leading text doesn't depend on render data, so there's no need to wait
+    # for awaitables before sending it.
+    prefix = bool(flush_prefix and template.static_prefix)
+    if prefix:
+        yield template.static_prefix
+
+    namespace = _namespace(template, data, overrides)
+
+    resolved = await _prefetch(template.paths, namespace)
+
+    if resolved and overrides is not None:
+        overrides = ChainMap(resolved, overrides)  # type: ignore
+    elif resolved:
+        overrides = resolved
+
+    def render(
+        write: Callable[[str], object],
+        aiter: Callable[[AsyncIterable[object]], Iterator[object]],
+    ) -> None:
+        template._render_stream(write, data, overrides, aiter, not prefix)
+
+    stream = _stream(render)
+    try:
+        async for chunk in stream:
+            yield chunk
+    finally:
+        await stream.aclose()
+
+
+def _namespace(
+    template: Template,
+    data: Mapping[str, object],
+    overrides: Mapping[str, object] | None,
+) -> Mapping[str, object]:
+    """Return a mapping that resolves names like a render of `template`
+    would, from `overrides`, then `data`, then the template's globals."""
+    maps = [m for m in (overrides, data, template.globals) if m is not None]
+    return maps[0] if len(maps) == 1 else ChainMap(*maps)  # type: ignore
+
+
+class _SwitchableAiter:
+    """An async iteration callback for a render that starts on the event
+    loop. It raises `_AsyncIterationRequired` until the render is moved to a
+    worker thread and given a callback that can block."""
+
+    def __init__(self) -> None:
+        self.fn: Callable[[AsyncIterable[object]], Iterator[object]] | None = (
+            None
+        )
+
+    def __call__(self, obj: AsyncIterable[object]) -> Iterator[object]:
+        if self.fn is None:
+            raise _AsyncIterationRequired
+        return self.fn(obj)
+
+
+_Render = Callable[
+    [
+        Callable[[str], object],
+        Callable[[AsyncIterable[object]], Iterator[object]],
+    ],
+    object,
+]
+
+
+async def _stream(render: _Render) -> AsyncIterator[str]:
+    """Call `render` in a worker thread, with a function that takes output
+    and a callback for consuming async iterables, yielding output as it
+    arrives."""
+    loop = asyncio.get_running_loop()
+    queue: asyncio.Queue[object] = asyncio.Queue(_MAX_PENDING_CHUNKS)
+    closed = False
+
+    def put(obj: object) -> None:
+        asyncio.run_coroutine_threadsafe(queue.put(obj), loop).result()
+
+    def write(chunk: str) -> None:
+        if closed:
+            raise _Closed
+        put(chunk)
+
+    def aiter(obj: AsyncIterable[object]) -> Iterator[object]:
+        return _BlockingIterator(obj, loop)
+
+    def run() -> None:
+        try:
+            render(write, aiter)
+        finally:
+            if not closed:
+                put(_DONE)
+
+    future = loop.run_in_executor(None, run)
+
+    try:
+        while True:
+            chunk = await queue.get()
+            if chunk is _DONE:
+                break
+            yield chunk  # type: ignore
+
+        await future
+    finally:
+        if not future.done():
+            # The consumer has gone away. Make room for any blocked write,
+            # and the worker will stop at the next one.
+            closed = True
+            while not queue.empty():
+                queue.get_nowait()
+            await asyncio.wait((future,))
+            future.exception()
+
+
+class _BlockingIterator:
+    """A synchronous iterator over an async iterable, for use in a worker
+    thread. Each item is fetched on the event loop."""
+
+    def __init__(
+        self, obj: AsyncIterable[object], loop: asyncio.AbstractEventLoop
+    ):
+        self.it = obj.__aiter__()
+        self.loop = loop
+
+    def __iter__(self) -> Iterator[object]:
+        return self
+
+    def __next__(self) -> object:
+        future = asyncio.run_coroutine_threadsafe(self._anext(), self.loop)
+        try:
+            return future.result()
+        except StopAsyncIteration:
+            raise StopIteration from None
+
+    async def _anext(self) -> object:
+        return await self.it.__anext__()
+
+
+async def _prefetch(
+    paths: Sequence[_Path], namespace: Mapping[str, object]
+) -> dict[str, object]:
+    """Return a dict of top-level names in `namespace` to copies of their
+    values, with awaitables on any of `paths` replaced by their results."""
+    resolved: dict[str, object] = {}
+    # Copies made on the way to awaitables, by id, with their original types.
+    copies: dict[int, tuple[object, type]] = {}
+
+    while True:
+        # Awaitables are keyed by id, as the same awaitable can be reached
+        # by more than one path, and awaitables can't always be hashed.
+        pending: dict[int, tuple[Awaitable[object], list[_Path]]] = {}
+
+        for path in paths:
+            prefix = _walk(path, namespace, resolved)
+            if prefix is None:
+                continue
+
+            obj = _get(prefix, namespace, resolved)
+            key = id(obj)
+            if key in pending:
+                if prefix not in pending[key][1]:
+                    pending[key][1].append(prefix)
+            else:
+                pending[key] = (obj, [prefix])  # type: ignore
+
+        if not pending:
+            return {k: _restore(v, copies) for k, v in resolved.items()}
+
+        results = await asyncio.gather(*(aw for aw, _ in pending.values()))
+
+        for (_, prefixes), result in zip(pending.values(), results):
+            for prefix in prefixes:
+                _assign(prefix, result, namespace, resolved, copies)
+
+
+def _lookup(
+    key: object, namespace: Mapping[str, object], resolved: dict[str, object]
+) -> object:
+    if key in resolved:
+        return resolved[key]  # type: ignore
+    try:
+        return namespace[key]  # type: ignore
+    except (KeyError, TypeError):
+        return _MISSING
+
+
+def _walk(
+    path: _Path, namespace: Mapping[str, object], resolved: dict[str, object]
+) -> _Path | None:
+    """Return the shortest prefix of `path` that leads to an awaitable, or
+    None if there are no awaitables on `path`."""
+    obj = _lookup(path[0], namespace, resolved)
+
+    for i, segment in enumerate(path[1:], start=1):
+        if obj is _MISSING:
+            return None
+        if inspect.isawaitable(obj):
+            return path[:i]
+        try:
+            obj = obj[segment]  # type: ignore
+        except (KeyError, IndexError, TypeError):
+            return None
+
+    return path if inspect.isawaitable(obj) else None
+
+
+def _get(
+    path: _Path, namespace: Mapping[str, object], resolved: dict[str, object]
+) -> object:
+    obj = _lookup(path[0], namespace, resolved)
+    for segment in path[1:]:
+        obj = obj[segment]  # type: ignore
+    return obj
+
+
+def _copy(obj: object, copies: dict[int, tuple[object, type]]) -> object:
+    """Return a mutable copy of container `obj`, remembering its type."""
+    copy = dict(obj) if isinstance(obj, Mapping) else list(obj)  # type: ignore
+    copies[id(copy)] = (copy, type(obj))
+    return copy
+
+
+def _restore(obj: object, copies: dict[int, tuple[object, type]]) -> object:
+    """Turn copies of tuples made by `_copy`, in or below `obj`, back into
+    tuples of their original type, once their items are resolved."""
+    if id(obj) not in copies:
+        return obj
+
+    if isinstance(obj, dict):
+        for key, value in obj.items():
+            obj[key] = _restore(value, copies)
+    else:
+        for i, value in enumerate(obj):  # type: ignore
+            obj[i] = _restore(value, copies)  # type: ignore
+
+    cls = copies[id(obj)][1]
+    if not issubclass(cls, tuple):
+        return obj
+    if hasattr(cls, "_make"):
+        return cls._make(obj)  # type: ignore
+    return cls(obj)
+
+
+def _assign(
+    path: _Path,
+    value: object,
+    namespace: Mapping[str, object],
+    resolved: dict[str, object],
+    copies: dict[int, tuple[object, type]],
+) -> None:
+    """Set `path` to `value` in `resolved`, copying any containers on the way
+    that we haven't already copied."""
+    head = path[0]
+
+    if len(path) == 1:
+        resolved[head] = value  # type: ignore
+        return
+
+    if head not in resolved:
+        resolved[head] = _copy(namespace[head], copies)  # type: ignore
+
+    obj = resolved[head]  # type: ignore
+
+    for segment in path[1:-1]:
+        child = obj[segment]  # type: ignore
+        if id(child) not in copies:
+            child = _copy(child, copies)
+            obj[segment] = child  # type: ignore
+        obj = child
+
+    obj[path[-1]] = value  # type: ignore
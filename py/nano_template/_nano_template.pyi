@@ -1,6 +1,11 @@
+from collections.abc import AsyncIterator
+from collections.abc import Iterator
 from collections.abc import Mapping
 from typing import Callable
+from typing import Literal
+from typing import Protocol
 from typing import Type
+from typing_extensions import Buffer
 from ._undefined import Undefined
 
 class TokenView:
@@ -18,11 +23,128 @@ class TokenView:
 
 def tokenize(source: str) -> list[TokenView]: ...
 
+class Lazy:
+    """A callable that is called at most once per render."""
+
+    def __init__(self, fn: Callable[[], object]) -> None: ...
+    def __call__(self) -> object: ...
+
+def lazy(fn: Callable[[], object]) -> Lazy: ...
+
+class Prepared:
+    """Render data frozen for fast repeated lookups."""
+
+    def __init__(self, mapping: Mapping[str, object]) -> None: ...
+    def __getitem__(self, key: str) -> object: ...
+    def __iter__(self) -> Iterator[str]: ...
+    def __len__(self) -> int: ...
+
+def prepare(mapping: Mapping[str, object]) -> Prepared: ...
+def serialize(obj: object) -> str: ...
+
+class RenderIterator:
+    """Iterator of rendered chunks."""
+
+    def __iter__(self) -> RenderIterator: ...
+    def __next__(self) -> str: ...
+
+class _SupportsWrite(Protocol):
+    def write(self, s: str, /) -> object: ...
+
+class _SupportsWriteBytes(Protocol):
+    def write(self, b: bytes, /) -> object: ...
+
+class _HasFileno(Protocol):
+    def fileno(self) -> int: ...
+
 class Template:
-    def render(self, data: Mapping[str, object]) -> str: ...
+    @property
+    def paths(self) -> tuple[tuple[str | int, ...], ...]: ...
+    @property
+    def static_prefix(self) -> str: ...
+    @property
+    def globals(self) -> Mapping[str, object] | Prepared | None: ...
+    def render(
+        self,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        size_hint: int | None = None,
+    ) -> str: ...
+    def render_bytes(
+        self,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        size_hint: int | None = None,
+    ) -> bytes: ...
+    def render_into(
+        self,
+        buffer: Buffer,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        offset: int = 0,
+    ) -> tuple[int, int]: ...
+    def render_json(
+        self,
+        buf: str | bytes | bytearray,
+        overrides: Mapping[str, object] | None = None,
+    ) -> str: ...
+    def render_to(
+        self,
+        sink: _SupportsWrite | Callable[[str], object],
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        chunk_size: int = 65536,
+        flush_prefix: bool = False,
+    ) -> None: ...
+    def render_to_fd(
+        self,
+        fd: int | _HasFileno,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        chunk_size: int = 65536,
+        flush_prefix: bool = False,
+    ) -> int: ...
+    def render_compressed(
+        self,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        encoding: Literal["gzip", "deflate"] = "gzip",
+        level: int = 6,
+        chunk_size: int = 65536,
+        sink: _SupportsWriteBytes | Callable[[bytes], object] | None = None,
+        flush_prefix: bool = False,
+    ) -> bytes | None: ...
+    def iter_render(
+        self,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        chunk_size: int = 65536,
+        flush_prefix: bool = False,
+    ) -> RenderIterator: ...
+    async def render_async(
+        self,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+    ) -> str: ...
+    def render_async_iter(
+        self,
+        data: Mapping[str, object] | Prepared,
+        overrides: Mapping[str, object] | None = None,
+        *,
+        flush_prefix: bool = False,
+    ) -> AsyncIterator[str]: ...
 
 def parse(
     source: str,
     serializer: Callable[[object], str],
     undefined: Type[Undefined],
+    globals: Mapping[str, object] | Prepared | None = None,
+    optimize: bool = True,
 ) -> Template: ...
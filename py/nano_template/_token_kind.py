@@ -34,6 +34,7 @@ class TokenKind(IntEnum):
     TOK_OR = auto()
     TOK_NOT = auto()
     TOK_IN = auto()
+    TOK_COMMA = auto()
     TOK_ERROR = auto()
     TOK_UNKNOWN = auto()
     TOK_EOF = auto()
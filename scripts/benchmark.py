@@ -6,8 +6,11 @@ from dataclasses import dataclass
 from pathlib import Path
 from typing import Any
 
+from nano_template import Undefined
 from nano_template import parse
 from nano_template import render
+from nano_template import serialize
+from nano_template._nano_template import parse as _parse
 from nano_template._pure import Template as PyTemplate
 from nano_template._pure import render as py_render
 
@@ -42,6 +45,7 @@ _TESTS = {
     "parse c ext": "parse(source)",
     "parse pure py": "PyTemplate(source)",
     "just render c ext": "t.render(data)",
+    "just render c ext no peephole": "t_unoptimized.render(data)",
     "just render pure py": "nt.render(data)",
     # "just render jinja2": "jinja_template.render(**data)",
     # "just render minijinja": "minijinja_env.render_template('bench', **data)",
@@ -56,6 +60,7 @@ def benchmark(path: str, number: int = 10000, repeat: int = 5) -> None:
     """Run the benchmark against fixture `path`. Print results to stdout."""
     fixture = Fixture.load(Path(path))
     t = parse(fixture.source)
+    t_unoptimized = _parse(fixture.source, serialize, Undefined, None, False)
     nt = PyTemplate(fixture.source)
 
     # minijinja_env = MiniJinjaEnv(templates={"bench": fixture.source})
@@ -69,6 +74,7 @@ def benchmark(path: str, number: int = 10000, repeat: int = 5) -> None:
         "render": render,
         "source": fixture.source,
         "t": t,
+        "t_unoptimized": t_unoptimized,
         # "render_str": render_str,
         # "JinjaTemplate": JinjaTemplate,
         # "jinja_env": JinjaEnvironment(cache_size=0, bytecode_cache=None),
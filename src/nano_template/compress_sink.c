@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/compress_sink.h"
+
+/// @brief Pass compressed output `out` on, stealing a reference to it.
+/// @return 0 on success, -1 on failure with an exception set.
+static int CompressSink_emit(NT_CompressSink *sink, PyObject *out)
+{
+    int rc = 0;
+
+    if (!out)
+    {
+        return -1;
+    }
+
+    // zlib buffers input until it has enough to compress.
+    if (PyBytes_Size(out) > 0)
+    {
+        if (sink->write)
+        {
+            PyObject *rv =
+                PyObject_CallFunctionObjArgs(sink->write, out, NULL);
+            rc = rv ? 0 : -1;
+            Py_XDECREF(rv);
+        }
+        else
+        {
+            rc = PyList_Append(sink->chunks, out);
+        }
+    }
+
+    Py_DECREF(out);
+    return rc;
+}
+
+static int CompressSink_flush(NT_Sink *base, NT_StringBuffer *buf)
+{
+    NT_CompressSink *sink = (NT_CompressSink *)base;
+    Py_ssize_t size = StringBuffer_length(buf);
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    // Compress straight from the render buffer. zlib consumes all of its
+    // input before compress returns.
+    PyObject *view = PyMemoryView_FromMemory(
+        (char *)StringBuffer_utf8_data(buf), size, PyBUF_READ);
+    if (!view)
+    {
+        return -1;
+    }
+
+    PyObject *out = PyObject_CallMethod(sink->compressor, "compress", "O",
+                                        view);
+    Py_DECREF(view);
+
+    // Pass on everything compressed so far, in one piece, so each write
+    // can be decompressed as soon as it arrives.
+    if (out && sink->sync_flush)
+    {
+        PyBytes_ConcatAndDel(&out,
+                             PyObject_CallMethod(sink->compressor, "flush",
+                                                 "O", sink->sync_flush));
+    }
+
+    if (CompressSink_emit(sink, out) < 0)
+    {
+        return -1;
+    }
+
+    StringBuffer_reset(buf);
+    return 0;
+}
+
+int NT_CompressSink_init(NT_CompressSink *sink, int level, int wbits,
+                         PyObject *write)
+{
+    sink->base.flush = CompressSink_flush;
+    sink->base.text = NULL;
+    sink->compressor = NULL;
+    sink->write = NULL;
+    sink->chunks = NULL;
+    sink->sync_flush = NULL;
+
+    PyObject *zlib = PyImport_ImportModule("zlib");
+    if (!zlib)
+    {
+        return -1;
+    }
+
+    // compressobj(level, method, wbits), where the only method is
+    // zlib.DEFLATED, 8.
+    sink->compressor =
+        PyObject_CallMethod(zlib, "compressobj", "iii", level, 8, wbits);
+
+    if (sink->compressor && write)
+    {
+        sink->sync_flush = PyObject_GetAttrString(zlib, "Z_SYNC_FLUSH");
+    }
+
+    Py_DECREF(zlib);
+
+    if (!sink->compressor || (write && !sink->sync_flush))
+    {
+        NT_CompressSink_clear(sink);
+        return -1;
+    }
+
+    if (write)
+    {
+        sink->write = Py_NewRef(write);
+    }
+    else
+    {
+        sink->chunks = PyList_New(0);
+        if (!sink->chunks)
+        {
+            NT_CompressSink_clear(sink);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+PyObject *NT_CompressSink_finish(NT_CompressSink *sink)
+{
+    if (CompressSink_emit(
+            sink, PyObject_CallMethod(sink->compressor, "flush", NULL)) < 0)
+    {
+        return NULL;
+    }
+
+    if (sink->write)
+    {
+        Py_RETURN_NONE;
+    }
+
+    PyObject *empty = PyBytes_FromStringAndSize(NULL, 0);
+    if (!empty)
+    {
+        return NULL;
+    }
+
+    PyObject *rv = PyObject_CallMethod(empty, "join", "O", sink->chunks);
+    Py_DECREF(empty);
+    return rv;
+}
+
+void NT_CompressSink_clear(NT_CompressSink *sink)
+{
+    Py_CLEAR(sink->compressor);
+    Py_CLEAR(sink->write);
+    Py_CLEAR(sink->chunks);
+    Py_CLEAR(sink->sync_flush);
+}
@@ -1,10 +1,15 @@
 // SPDX-License-Identifier: MIT
 
 #include "nano_template/context.h"
+#include "nano_template/py_lazy.h"
+#include "nano_template/py_prepared.h"
+#include "nano_template/string_buffer.h"
 
 NT_RenderContext *NT_RenderContext_new(PyObject *str, PyObject *globals,
                                        PyObject *serializer,
-                                       PyObject *undefined)
+                                       PyObject *undefined,
+                                       Py_ssize_t memo_size,
+                                       Py_ssize_t binding_count)
 {
     NT_RenderContext *ctx = PyMem_Malloc(sizeof(NT_RenderContext));
     if (!ctx)
@@ -21,8 +26,44 @@ NT_RenderContext *NT_RenderContext_new(PyObject *str, PyObject *globals,
     ctx->scope = NULL;
     ctx->size = 0;
     ctx->capacity = 0;
+    ctx->memo = NULL;
+    ctx->memo_size = 0;
+    ctx->bindings = NULL;
+    ctx->binding_count = 0;
+    ctx->lazy = NULL;
+    ctx->paths = NULL;
+    ctx->paths_index = -1;
     ctx->serializer = serializer;
     ctx->undefined = undefined;
+    ctx->write = NULL;
+    ctx->sink = NULL;
+    ctx->chunk_size = 0;
+    ctx->aiter = NULL;
+    ctx->aiter_failed = false;
+
+    if (memo_size > 0)
+    {
+        ctx->memo = PyMem_Calloc(memo_size, sizeof(PyObject *));
+        if (!ctx->memo)
+        {
+            PyErr_NoMemory();
+            NT_RenderContext_free(ctx);
+            return NULL;
+        }
+        ctx->memo_size = memo_size;
+    }
+
+    if (binding_count > 0)
+    {
+        ctx->bindings = PyMem_Calloc(binding_count, sizeof(PyObject *));
+        if (!ctx->bindings)
+        {
+            PyErr_NoMemory();
+            NT_RenderContext_free(ctx);
+            return NULL;
+        }
+        ctx->binding_count = binding_count;
+    }
 
     if (NT_RenderContext_push(ctx, globals) < 0)
     {
@@ -44,28 +85,117 @@ void NT_RenderContext_free(NT_RenderContext *ctx)
     }
 
     PyMem_Free(ctx->scope);
+
+    for (Py_ssize_t i = 0; i < ctx->memo_size; i++)
+    {
+        Py_XDECREF(ctx->memo[i]);
+    }
+
+    PyMem_Free(ctx->memo);
+
+    for (Py_ssize_t i = 0; i < ctx->binding_count; i++)
+    {
+        Py_XDECREF(ctx->bindings[i]);
+    }
+
+    PyMem_Free(ctx->bindings);
+    Py_XDECREF(ctx->lazy);
+    Py_XDECREF(ctx->paths);
     Py_XDECREF(ctx->serializer);
     Py_XDECREF(ctx->undefined);
+    Py_XDECREF(ctx->write);
+    Py_XDECREF(ctx->aiter);
     PyMem_Free(ctx);
 }
 
-int NT_RenderContext_get(const NT_RenderContext *ctx, PyObject *key,
-                         PyObject **out)
+int NT_RenderContext_traverse(const NT_RenderContext *ctx, visitproc visit,
+                              void *arg)
+{
+    Py_VISIT(ctx->str);
+
+    for (Py_ssize_t i = 0; i < ctx->size; i++)
+    {
+        Py_VISIT(ctx->scope[i]);
+    }
+
+    for (Py_ssize_t i = 0; i < ctx->memo_size; i++)
+    {
+        Py_VISIT(ctx->memo[i]);
+    }
+
+    for (Py_ssize_t i = 0; i < ctx->binding_count; i++)
+    {
+        Py_VISIT(ctx->bindings[i]);
+    }
+
+    Py_VISIT(ctx->lazy);
+    Py_VISIT(ctx->paths);
+    Py_VISIT(ctx->serializer);
+    Py_VISIT(ctx->undefined);
+    Py_VISIT(ctx->write);
+    Py_VISIT(ctx->aiter);
+    return 0;
+}
+
+PyObject *NT_RenderContext_force(NT_RenderContext *ctx, PyObject *op,
+                                 PyObject **owned)
+{
+    PyObject *result = NULL;
+
+    if (!ctx->lazy)
+    {
+        ctx->lazy = PyDict_New();
+        if (!ctx->lazy)
+        {
+            goto cleanup;
+        }
+    }
+
+    result = PyDict_GetItemWithError(ctx->lazy, op);
+    if (result || PyErr_Occurred())
+    {
+        goto cleanup;
+    }
+
+    // `op` might be borrowed from a namespace that the callback modifies.
+    Py_INCREF(op);
+    PyObject *value = PyObject_CallObject(((NTPY_LazyObject *)op)->fn, NULL);
+
+    if (value)
+    {
+        if (PyDict_SetItem(ctx->lazy, op, value) == 0)
+        {
+            result = value;
+        }
+        Py_DECREF(value);
+    }
+
+    Py_DECREF(op);
+
+cleanup:
+    Py_CLEAR(*owned);
+    return result;
+}
+
+PyObject *NT_RenderContext_lookup(const NT_RenderContext *ctx, PyObject *key,
+                                  PyObject **owned, Py_ssize_t *index)
 {
     PyObject *obj = NULL;
 
     for (Py_ssize_t i = ctx->size - 1; i >= 0; i--)
     {
-        obj = PyObject_GetItem(ctx->scope[i], key);
+        obj = nt_getitem(ctx->scope[i], key, owned);
         if (obj)
         {
-            *out = obj;
-            return 0;
+            if (index)
+            {
+                *index = i;
+            }
+            return obj;
         }
-        PyErr_Clear();
     }
 
-    return -1;
+    return NULL;
 }
 
 int NT_RenderContext_push(NT_RenderContext *ctx, PyObject *namespace)
@@ -85,6 +215,15 @@ int NT_RenderContext_push(NT_RenderContext *ctx, PyObject *namespace)
         ctx->capacity = new_cap;
     }
 
+    if (NTPY_Prepared_Check(namespace))
+    {
+        NTPY_PreparedObject *prepared = (NTPY_PreparedObject *)namespace;
+        Py_XDECREF(ctx->paths);
+        ctx->paths = Py_NewRef(prepared->paths);
+        ctx->paths_index = ctx->size;
+        namespace = prepared->root;
+    }
+
     Py_INCREF(namespace);
     ctx->scope[ctx->size++] = namespace;
     return 0;
@@ -95,5 +234,42 @@ void NT_RenderContext_pop(NT_RenderContext *ctx)
     if (ctx->size > 0)
     {
         Py_DECREF(ctx->scope[--ctx->size]);
+
+        if (ctx->paths_index == ctx->size)
+        {
+            Py_CLEAR(ctx->paths);
+            ctx->paths_index = -1;
+        }
+    }
+}
+
+int NT_RenderContext_flush(NT_RenderContext *ctx, NT_StringBuffer *buf)
+{
+    // A sink can be holding on to output of its own.
+    if (ctx->sink)
+    {
+        return ctx->sink->flush(ctx->sink, buf);
+    }
+
+    if (!ctx->write || StringBuffer_length(buf) == 0)
+    {
+        return 0;
     }
+
+    PyObject *str = StringBuffer_flush(buf);
+    if (!str)
+    {
+        return -1;
+    }
+
+    PyObject *rv = PyObject_CallFunctionObjArgs(ctx->write, str, NULL);
+    Py_DECREF(str);
+
+    if (!rv)
+    {
+        return -1;
+    }
+
+    Py_DECREF(rv);
+    return 0;
 }
@@ -1,15 +1,24 @@
 // SPDX-License-Identifier: MIT
 
 #include "nano_template/expression.h"
+#include "nano_template/py_lazy.h"
 #include "nano_template/py_token_view.h"
 
-typedef PyObject *(*EvalFn)(const NT_Expr *expr, NT_RenderContext *ctx);
-
-static PyObject *eval_not_expr(const NT_Expr *expr, NT_RenderContext *ctx);
-static PyObject *eval_and_expr(const NT_Expr *expr, NT_RenderContext *ctx);
-static PyObject *eval_or_expr(const NT_Expr *expr, NT_RenderContext *ctx);
-static PyObject *eval_str_expr(const NT_Expr *expr, NT_RenderContext *ctx);
-static PyObject *eval_var_expr(const NT_Expr *expr, NT_RenderContext *ctx);
+/// @brief Evaluate `expr`, storing any new reference in `owned`.
+/// @return A borrowed reference to the result, or NULL on failure.
+typedef PyObject *(*EvalFn)(const NT_Expr *expr, NT_RenderContext *ctx,
+                            PyObject **owned);
+
+static PyObject *eval_not_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned);
+static PyObject *eval_and_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned);
+static PyObject *eval_or_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                              PyObject **owned);
+static PyObject *eval_str_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned);
+static PyObject *eval_var_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned);
 
 static EvalFn eval_table[] = {
     [EXPR_NOT] = eval_not_expr, [EXPR_AND] = eval_and_expr,
@@ -22,8 +31,30 @@ static EvalFn eval_table[] = {
 static PyObject *undefined(const NT_Expr *expr, NT_RenderContext *ctx,
                            size_t end_pos);
 
+/// @brief Evaluate the left hand side of a logical `and` or `or` expression.
+/// @return 1 if the left hand side is truthy, 0 if it is falsy, or -1 on
+/// failure. `out` is set to a borrowed reference to the left hand side.
+static int eval_logical_left(const NT_Expr *expr, NT_RenderContext *ctx,
+                             PyObject **out, PyObject **owned);
+
 PyObject *NT_Expr_evaluate(const NT_Expr *expr, NT_RenderContext *ctx)
 {
+    PyObject *owned = NULL;
+    PyObject *op = NT_Expr_evaluate_borrowed(expr, ctx, &owned);
+
+    if (!op || owned)
+    {
+        return owned;
+    }
+
+    return Py_NewRef(op);
+}
+
+PyObject *NT_Expr_evaluate_borrowed(const NT_Expr *expr, NT_RenderContext *ctx,
+                                    PyObject **owned)
+{
+    *owned = NULL;
+
     if (!expr)
     {
         return NULL;
@@ -36,192 +67,277 @@ PyObject *NT_Expr_evaluate(const NT_Expr *expr, NT_RenderContext *ctx)
         return NULL;
     }
 
-    return fn(expr, ctx);
+    return fn(expr, ctx, owned);
 }
 
-static PyObject *eval_not_expr(const NT_Expr *expr, NT_RenderContext *ctx)
+int NT_Expr_truthy(const NT_Expr *expr, NT_RenderContext *ctx)
 {
-    PyObject *op = NULL;
-    PyObject *result = NULL;
-
-    if (!expr->right)
-    {
-        result = Py_NewRef(Py_True);
-        goto cleanup;
-    }
+    PyObject *owned = NULL;
+    PyObject *op = NT_Expr_evaluate_borrowed(expr, ctx, &owned);
 
-    op = NT_Expr_evaluate(expr->right, ctx);
     if (!op)
     {
-        goto cleanup;
+        return -1;
     }
 
-    int falsy = PyObject_Not(op);
+    int rv = nt_truthy(op);
+    Py_XDECREF(owned);
+    return rv;
+}
 
-    if (falsy == 0)
+static PyObject *eval_not_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned)
+{
+    (void)owned;
+    if (!expr->right)
     {
-        result = Py_NewRef(Py_True);
+        return Py_True;
     }
-    else if (falsy == 1)
+
+    int truthy = NT_Expr_truthy(expr->right, ctx);
+
+    if (truthy == -1)
     {
-        result = Py_NewRef(Py_False);
+        return NULL;
     }
 
-cleanup:
-    Py_XDECREF(op);
-    return result;
+    return truthy ? Py_False : Py_True;
 }
 
-static PyObject *eval_and_expr(const NT_Expr *expr, NT_RenderContext *ctx)
+static PyObject *eval_and_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned)
 {
     PyObject *left = NULL;
-    PyObject *right = NULL;
-    PyObject *result = NULL;
 
     if (!expr->left || !expr->right)
     {
-        result = Py_NewRef(Py_False);
-        goto cleanup;
+        return Py_False;
     }
 
-    left = NT_Expr_evaluate(expr->left, ctx);
-    if (!left)
-    {
-        goto cleanup;
-    }
+    int truthy = eval_logical_left(expr, ctx, &left, owned);
 
-    int falsy = PyObject_Not(left);
-    if (falsy == -1)
+    if (truthy == -1)
     {
-        goto cleanup;
+        return NULL;
     }
 
-    if (falsy)
+    if (!truthy)
     {
         // Short-circuit. Return left.
-        result = Py_NewRef(left);
-        goto cleanup;
+        return left;
     }
 
-    right = NT_Expr_evaluate(expr->right, ctx);
-    if (!right)
-    {
-        goto cleanup;
-    }
-
-    result = Py_NewRef(right);
-    // Fall through.
-
-cleanup:
-    Py_XDECREF(left);
-    Py_XDECREF(right);
-    return result;
+    Py_CLEAR(*owned);
+    return NT_Expr_evaluate_borrowed(expr->right, ctx, owned);
 }
 
-static PyObject *eval_or_expr(const NT_Expr *expr, NT_RenderContext *ctx)
+static PyObject *eval_or_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                              PyObject **owned)
 {
     PyObject *left = NULL;
-    PyObject *right = NULL;
-    PyObject *result = NULL;
 
     if (!expr->left || !expr->right)
     {
-        result = Py_NewRef(Py_False);
-        goto cleanup;
+        return Py_False;
     }
 
-    left = NT_Expr_evaluate(expr->left, ctx);
-
-    if (!left)
-    {
-        goto cleanup;
-    }
+    int truthy = eval_logical_left(expr, ctx, &left, owned);
 
-    int truthy = PyObject_IsTrue(left);
     if (truthy == -1)
     {
-        goto cleanup;
+        return NULL;
     }
 
     if (truthy)
     {
         // Short-circuit. Return left.
-        result = Py_NewRef(left);
-        goto cleanup;
+        return left;
+    }
+
+    Py_CLEAR(*owned);
+    return NT_Expr_evaluate_borrowed(expr->right, ctx, owned);
+}
+
+static int eval_logical_left(const NT_Expr *expr, NT_RenderContext *ctx,
+                             PyObject **out, PyObject **owned)
+{
+    PyObject *left = NT_Expr_evaluate_borrowed(expr->left, ctx, owned);
+
+    if (!left)
+    {
+        return -1;
     }
 
-    right = NT_Expr_evaluate(expr->right, ctx);
-    if (!right)
+    int truthy = nt_truthy_fast(left);
+
+    if (truthy == -2)
     {
-        goto cleanup;
+        // PyObject_IsTrue can call back into Python. Make sure we hold a
+        // reference to left, as we might be returning it.
+        if (!*owned)
+        {
+            *owned = Py_NewRef(left);
+        }
+
+        truthy = PyObject_IsTrue(left);
     }
 
-    result = Py_NewRef(right);
-    // Fall through.
+    if (truthy == -1)
+    {
+        Py_CLEAR(*owned);
+        return -1;
+    }
 
-cleanup:
-    Py_XDECREF(left);
-    Py_XDECREF(right);
-    return result;
+    *out = left;
+    return truthy;
 }
 
-static PyObject *eval_str_expr(const NT_Expr *expr, NT_RenderContext *ctx)
+static PyObject *eval_str_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned)
 {
     (void)ctx;
+    (void)owned;
     if (!expr->head || expr->head->count < 1)
     {
         return NULL;
     }
-    return Py_NewRef(expr->head->objs[0]);
+
+    // String literals are owned by the syntax tree.
+    return expr->head->objs[0];
 }
 
-static PyObject *eval_var_expr(const NT_Expr *expr, NT_RenderContext *ctx)
+static PyObject *eval_var_expr(const NT_Expr *expr, NT_RenderContext *ctx,
+                               PyObject **owned)
 {
     PyObject *op = NULL;
-    PyObject *result = NULL;
+    PyObject *item = NULL;
+    PyObject *item_owned = NULL;
 
     if (!expr->head || expr->head->count == 0)
     {
-        result = Py_NewRef(Py_None);
-        goto cleanup;
+        return Py_None;
     }
 
-    if (NT_RenderContext_get(ctx, expr->head->objs[0], &op) < 0)
+    PyObject **memo = NULL;
+    Py_ssize_t index = -1;
+
+    if (expr->binding >= 0)
     {
-        result = undefined(expr, ctx, 0);
-        goto cleanup;
+        // Loop variables are read straight from their binding slot. They
+        // change on every iteration, so are never memoized.
+        op = expr->binding < ctx->binding_count ? ctx->bindings[expr->binding]
+                                                : NULL;
+    }
+    else
+    {
+        if (expr->slot >= 0 && expr->slot < ctx->memo_size)
+        {
+            // Loop-invariant paths are resolved at most once per render.
+            memo = &ctx->memo[expr->slot];
+            if (*memo)
+            {
+                return *memo;
+            }
+        }
+
+        op = NT_RenderContext_lookup(ctx, expr->head->objs[0], owned,
+                                     &index);
     }
 
-    if (expr->head->count == 1)
+    if (!op)
     {
-        result = Py_NewRef(op);
-        goto cleanup;
+        *owned = undefined(expr, ctx, 0);
+        return *owned;
+    }
+
+    if (NTPY_Lazy_Check(op))
+    {
+        op = NT_RenderContext_force(ctx, op, owned);
+        if (!op)
+        {
+            return NULL;
+        }
     }
 
+    size_t pos = 0;
     NT_ObjPage *page = expr->head;
+
+    // Paths through nested dicts in prepared data are resolved with a single
+    // lookup. Anything else falls back to resolving one segment at a time.
+    if (index >= 0 && index == ctx->paths_index && expr->path && !*owned &&
+        (page->count > 1 || page->next))
+    {
+        item = PyDict_GetItemWithError(ctx->paths, expr->path);
+        if (item)
+        {
+            op = item;
+            page = NULL;
+
+            if (NTPY_Lazy_Check(op))
+            {
+                op = NT_RenderContext_force(ctx, op, owned);
+                if (!op)
+                {
+                    return NULL;
+                }
+            }
+        }
+        else if (PyErr_Occurred())
+        {
+            PyErr_Clear();
+        }
+    }
+
     while (page)
     {
-        for (size_t i = 1; i < page->count; i++)
+        // The first segment of the first page was resolved from scope.
+        for (size_t i = (page == expr->head) ? 1 : 0; i < page->count; i++)
         {
-            Py_DECREF(op);
-            op = PyObject_GetItem(op, page->objs[i]);
+            pos++;
+            item = nt_getitem(op, page->objs[i], &item_owned);
 
-            if (!op)
+            // If `op` is owned, a borrowed `item` is kept alive by it.
+            // Otherwise both are borrowed from the same root namespace.
+            if (item_owned)
             {
-                PyErr_Clear();
-                result = undefined(expr, ctx, i);
-                goto cleanup;
+                Py_XDECREF(*owned);
+                *owned = item_owned;
+            }
+            else if (*owned && item)
+            {
+                item = Py_NewRef(item);
+                Py_DECREF(*owned);
+                *owned = item;
+            }
+
+            if (!item)
+            {
+                Py_CLEAR(*owned);
+                *owned = undefined(expr, ctx, pos);
+                return *owned;
+            }
+
+            op = item;
+
+            if (NTPY_Lazy_Check(op))
+            {
+                op = NT_RenderContext_force(ctx, op, owned);
+                if (!op)
+                {
+                    return NULL;
+                }
             }
         }
 
         page = page->next;
     }
 
-    result = Py_NewRef(op);
+    if (memo)
+    {
+        *memo = Py_NewRef(op);
+    }
 
-cleanup:
-    Py_XDECREF(op);
-    return result;
+    return op;
 }
 
 static PyObject *undefined(const NT_Expr *expr, NT_RenderContext *ctx,
@@ -252,7 +368,7 @@ static PyObject *undefined(const NT_Expr *expr, NT_RenderContext *ctx,
 
     while (page)
     {
-        for (size_t i = 0; i <= page->count; i++)
+        for (size_t i = 0; i < page->count; i++)
         {
             if (PyList_Append(list, page->objs[i]) < 0)
             {
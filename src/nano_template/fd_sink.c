@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/fd_sink.h"
+
+#include <errno.h>
+#include <limits.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/// @brief Add buffer output that isn't in a segment yet as a new segment.
+static void FdSink_seal(NT_FdSink *sink, NT_StringBuffer *buf)
+{
+    Py_ssize_t length = StringBuffer_length(buf);
+
+    if (length > sink->mark)
+    {
+        NT_FdSegment *segment = &sink->segments[sink->segment_count++];
+        segment->text = NULL;
+        segment->start = sink->mark;
+        segment->size = length - sink->mark;
+        sink->mark = length;
+    }
+}
+
+/// @brief Set an OSError from `err`, or check for signals and return 1 if
+/// the call that failed with `err` should be retried.
+/// @return 1 to retry, or -1 with an exception set.
+static int FdSink_error(int err)
+{
+    if (err == EINTR)
+    {
+        // Retry unless a signal handler raised, as Python's own I/O does.
+        return PyErr_CheckSignals() < 0 ? -1 : 1;
+    }
+
+    errno = err;
+    PyErr_SetFromErrno(PyExc_OSError);
+    return -1;
+}
+
+#ifdef _WIN32
+
+/// @brief Write all `size` bytes from `data` to the sink's file descriptor.
+/// @return 0 on success, -1 on failure with an exception set.
+static int FdSink_write_all(NT_FdSink *sink, const char *data,
+                            Py_ssize_t size)
+{
+    while (size > 0)
+    {
+        unsigned int count = size > INT_MAX ? INT_MAX : (unsigned int)size;
+        int n = 0;
+        int err = 0;
+
+        Py_BEGIN_ALLOW_THREADS n = _write(sink->fd, data, count);
+        if (n < 0)
+        {
+            err = errno;
+        }
+        Py_END_ALLOW_THREADS
+
+        if (n < 0)
+        {
+            if (FdSink_error(err) < 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        sink->written += n;
+        data += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+/// @brief Write every segment in `sink`, in order.
+/// @return 0 on success, -1 on failure with an exception set.
+static int FdSink_write_segments(NT_FdSink *sink, const char *data)
+{
+    for (int i = 0; i < sink->segment_count; i++)
+    {
+        NT_FdSegment *segment = &sink->segments[i];
+        const char *base = segment->text ? PyBytes_AsString(segment->text)
+                                         : data + segment->start;
+
+        if (FdSink_write_all(sink, base, segment->size) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#else
+
+/// @brief Write every segment in `sink`, in order, gathering them with
+/// writev.
+/// @return 0 on success, -1 on failure with an exception set.
+static int FdSink_write_segments(NT_FdSink *sink, const char *data)
+{
+    struct iovec iov[NT_FD_SINK_MAX_SEGMENTS];
+    int count = sink->segment_count;
+
+    for (int i = 0; i < count; i++)
+    {
+        NT_FdSegment *segment = &sink->segments[i];
+        iov[i].iov_base = segment->text ? PyBytes_AsString(segment->text)
+                                        : (char *)data + segment->start;
+        iov[i].iov_len = (size_t)segment->size;
+    }
+
+    struct iovec *next = iov;
+
+    while (count > 0)
+    {
+#ifdef IOV_MAX
+        int batch = count < IOV_MAX ? count : IOV_MAX;
+#else
+        int batch = count;
+#endif
+        ssize_t n = 0;
+        int err = 0;
+
+        Py_BEGIN_ALLOW_THREADS n = writev(sink->fd, next, batch);
+        if (n < 0)
+        {
+            err = errno;
+        }
+        Py_END_ALLOW_THREADS
+
+        if (n < 0)
+        {
+            if (FdSink_error(err) < 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        sink->written += (Py_ssize_t)n;
+
+        // Skip over whatever was written, which can be part of a segment.
+        size_t remaining = (size_t)n;
+
+        while (count > 0 && remaining >= next->iov_len)
+        {
+            remaining -= next->iov_len;
+            next++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            next->iov_base = (char *)next->iov_base + remaining;
+            next->iov_len -= remaining;
+        }
+    }
+
+    return 0;
+}
+
+#endif
+
+static int FdSink_flush(NT_Sink *base, NT_StringBuffer *buf)
+{
+    NT_FdSink *sink = (NT_FdSink *)base;
+
+    FdSink_seal(sink, buf);
+
+    if (sink->segment_count == 0)
+    {
+        return 0;
+    }
+
+    if (FdSink_write_segments(sink, StringBuffer_utf8_data(buf)) < 0)
+    {
+        return -1;
+    }
+
+    sink->pending = 0;
+    sink->mark = 0;
+    sink->segment_count = 0;
+    StringBuffer_reset(buf);
+    return 0;
+}
+
+static int FdSink_text(NT_Sink *base, NT_StringBuffer *buf, PyObject *utf8)
+{
+    NT_FdSink *sink = (NT_FdSink *)base;
+    Py_ssize_t size = PyBytes_Size(utf8);
+
+    if (size < NT_FD_SINK_MIN_DIRECT)
+    {
+        return StringBuffer_append_utf8(buf, PyBytes_AsString(utf8), size);
+    }
+
+    // Make room for buffer output before the text, the text itself, and
+    // buffer output after it, which is sealed at the next flush.
+    if (sink->segment_count > NT_FD_SINK_MAX_SEGMENTS - 3 &&
+        FdSink_flush(base, buf) < 0)
+    {
+        return -1;
+    }
+
+    FdSink_seal(sink, buf);
+
+    NT_FdSegment *segment = &sink->segments[sink->segment_count++];
+    segment->text = utf8;
+    segment->start = 0;
+    segment->size = size;
+    sink->pending += size;
+
+    if (sink->pending + StringBuffer_length(buf) >= sink->chunk_size)
+    {
+        return FdSink_flush(base, buf);
+    }
+
+    return 0;
+}
+
+void NT_FdSink_init(NT_FdSink *sink, int fd, Py_ssize_t chunk_size)
+{
+    sink->base.flush = FdSink_flush;
+    sink->base.text = FdSink_text;
+    sink->fd = fd;
+    sink->chunk_size = chunk_size;
+    sink->written = 0;
+    sink->pending = 0;
+    sink->mark = 0;
+    sink->segment_count = 0;
+}
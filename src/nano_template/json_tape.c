@@ -0,0 +1,886 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/json_tape.h"
+
+/// Objects and arrays nested deeper than this are rejected.
+#define JSON_MAX_DEPTH 512
+
+/// Numbers shorter than this are copied to the stack before conversion.
+#define JSON_NUMBER_BUF_SIZE 64
+
+/// @brief Append a new entry of kind `kind` to the tape.
+/// @return The index of the new entry, or -1 on error with an exception set.
+static Py_ssize_t push_entry(NT_JsonTape *tape, NT_JsonKind kind,
+                             Py_ssize_t start);
+
+/// @brief Index the value starting at `*pos`, advancing `*pos` past it.
+/// @return 0 on success, -1 on error with an exception set.
+static int scan_value(NT_JsonTape *tape, Py_ssize_t *pos, int depth);
+static int scan_object(NT_JsonTape *tape, Py_ssize_t *pos, int depth);
+static int scan_array(NT_JsonTape *tape, Py_ssize_t *pos, int depth);
+static int scan_string(NT_JsonTape *tape, Py_ssize_t *pos);
+static int scan_number(NT_JsonTape *tape, Py_ssize_t *pos);
+static int scan_literal(NT_JsonTape *tape, Py_ssize_t *pos,
+                        const char *word, Py_ssize_t word_length,
+                        NT_JsonKind kind);
+
+/// @brief Set a ValueError describing a syntax error at byte `pos`.
+static int scan_error(Py_ssize_t pos, const char *expected);
+
+static inline void skip_whitespace(NT_JsonTape *tape, Py_ssize_t *pos);
+static inline int hex_value(char ch);
+
+/// @brief Decode the string at `entry`, replacing escape sequences.
+/// @return A new str, or NULL on error with an exception set.
+static PyObject *decode_escaped(NT_JsonTape *tape, const NT_JsonEntry *entry);
+
+/// @brief Convert the number at `entry` to an int or float.
+/// @return A new reference, or NULL on error with an exception set.
+static PyObject *decode_number(NT_JsonTape *tape, const NT_JsonEntry *entry);
+
+NT_JsonTape *NT_JsonTape_new(PyObject *bytes)
+{
+    char *data = NULL;
+    Py_ssize_t length = 0;
+
+    if (PyBytes_AsStringAndSize(bytes, &data, &length) < 0)
+    {
+        return NULL;
+    }
+
+    NT_JsonTape *tape = PyMem_Malloc(sizeof(NT_JsonTape));
+    if (!tape)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    Py_INCREF(bytes);
+    tape->bytes = bytes;
+    tape->data = data;
+    tape->length = length;
+    tape->size = 0;
+    tape->keys = NULL;
+
+    // A rough guess at one entry per eight bytes of input.
+    tape->capacity = length / 8 + 8;
+    tape->entries = PyMem_Malloc(sizeof(NT_JsonEntry) * tape->capacity);
+    if (!tape->entries)
+    {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    tape->keys = PyDict_New();
+    if (!tape->keys)
+    {
+        goto fail;
+    }
+
+    Py_ssize_t pos = 0;
+    skip_whitespace(tape, &pos);
+
+    if (scan_value(tape, &pos, 0) < 0)
+    {
+        goto fail;
+    }
+
+    skip_whitespace(tape, &pos);
+
+    if (pos != length)
+    {
+        scan_error(pos, "end of document");
+        goto fail;
+    }
+
+    return tape;
+
+fail:
+    NT_JsonTape_free(tape);
+    return NULL;
+}
+
+void NT_JsonTape_free(NT_JsonTape *tape)
+{
+    if (!tape)
+    {
+        return;
+    }
+
+    Py_XDECREF(tape->bytes);
+    Py_XDECREF(tape->keys);
+    PyMem_Free(tape->entries);
+    PyMem_Free(tape);
+}
+
+Py_ssize_t NT_JsonTape_find(NT_JsonTape *tape, Py_ssize_t index,
+                            PyObject *key)
+{
+    NT_JsonEntry *object = &tape->entries[index];
+    Py_ssize_t found = -1;
+
+    // Cache the UTF-8 encoding of each key we're asked for, so repeated
+    // lookups are a byte comparison.
+    PyObject *encoded = PyDict_GetItemWithError(tape->keys, key);
+    if (!encoded)
+    {
+        if (PyErr_Occurred())
+        {
+            return -2;
+        }
+
+        encoded = PyUnicode_AsUTF8String(key);
+        if (!encoded)
+        {
+            return -2;
+        }
+
+        int rv = PyDict_SetItem(tape->keys, key, encoded);
+        Py_DECREF(encoded);
+
+        if (rv < 0)
+        {
+            return -2;
+        }
+    }
+
+    const char *key_data = PyBytes_AsString(encoded);
+    Py_ssize_t key_length = PyBytes_Size(encoded);
+    Py_ssize_t i = index + 1;
+
+    for (Py_ssize_t n = 0; n < object->count; n++)
+    {
+        NT_JsonEntry *name = &tape->entries[i];
+        Py_ssize_t value = i + 1;
+
+        if (name->escaped)
+        {
+            PyObject *str = decode_escaped(tape, name);
+            if (!str)
+            {
+                return -2;
+            }
+
+            int match = PyUnicode_Compare(str, key) == 0;
+            Py_DECREF(str);
+
+            if (match)
+            {
+                found = value;
+            }
+        }
+        else if (name->end - name->start == key_length &&
+                 memcmp(tape->data + name->start, key_data, key_length) == 0)
+        {
+            found = value;
+        }
+
+        i = tape->entries[value].next;
+    }
+
+    return found;
+}
+
+Py_ssize_t NT_JsonTape_item(NT_JsonTape *tape, Py_ssize_t index,
+                            Py_ssize_t n)
+{
+    NT_JsonEntry *array = &tape->entries[index];
+
+    if (n < 0 || n >= array->count)
+    {
+        return -1;
+    }
+
+    Py_ssize_t i = index + 1;
+    while (n--)
+    {
+        i = tape->entries[i].next;
+    }
+
+    return i;
+}
+
+PyObject *NT_JsonTape_scalar(NT_JsonTape *tape, Py_ssize_t index)
+{
+    NT_JsonEntry *entry = &tape->entries[index];
+
+    switch (entry->kind)
+    {
+    case JSON_NULL:
+        Py_RETURN_NONE;
+    case JSON_TRUE:
+        Py_RETURN_TRUE;
+    case JSON_FALSE:
+        Py_RETURN_FALSE;
+    case JSON_INT:
+    case JSON_FLOAT:
+        return decode_number(tape, entry);
+    case JSON_STRING:
+        if (entry->escaped)
+        {
+            return decode_escaped(tape, entry);
+        }
+        return PyUnicode_DecodeUTF8(tape->data + entry->start,
+                                    entry->end - entry->start, "strict");
+    default:
+        PyErr_SetString(PyExc_TypeError, "expected a JSON scalar");
+        return NULL;
+    }
+}
+
+PyObject *NT_JsonTape_materialize(NT_JsonTape *tape, Py_ssize_t index)
+{
+    NT_JsonEntry *entry = &tape->entries[index];
+    PyObject *result = NULL;
+    Py_ssize_t i = index + 1;
+
+    if (entry->kind == JSON_OBJECT)
+    {
+        result = PyDict_New();
+        if (!result)
+        {
+            return NULL;
+        }
+
+        for (Py_ssize_t n = 0; n < entry->count; n++)
+        {
+            PyObject *key = NT_JsonTape_scalar(tape, i);
+            if (!key)
+            {
+                goto fail;
+            }
+
+            PyObject *value = NT_JsonTape_materialize(tape, i + 1);
+            if (!value)
+            {
+                Py_DECREF(key);
+                goto fail;
+            }
+
+            int rv = PyDict_SetItem(result, key, value);
+            Py_DECREF(key);
+            Py_DECREF(value);
+
+            if (rv < 0)
+            {
+                goto fail;
+            }
+
+            i = tape->entries[i + 1].next;
+        }
+
+        return result;
+    }
+
+    if (entry->kind == JSON_ARRAY)
+    {
+        result = PyList_New(entry->count);
+        if (!result)
+        {
+            return NULL;
+        }
+
+        for (Py_ssize_t n = 0; n < entry->count; n++)
+        {
+            PyObject *item = NT_JsonTape_materialize(tape, i);
+            if (!item)
+            {
+                goto fail;
+            }
+
+            PyList_SetItem(result, n, item);
+            i = tape->entries[i].next;
+        }
+
+        return result;
+    }
+
+    return NT_JsonTape_scalar(tape, index);
+
+fail:
+    Py_DECREF(result);
+    return NULL;
+}
+
+static Py_ssize_t push_entry(NT_JsonTape *tape, NT_JsonKind kind,
+                             Py_ssize_t start)
+{
+    if (tape->size == tape->capacity)
+    {
+        Py_ssize_t new_capacity = tape->capacity * 2;
+        NT_JsonEntry *new_entries =
+            PyMem_Realloc(tape->entries, sizeof(NT_JsonEntry) * new_capacity);
+
+        if (!new_entries)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+
+        tape->entries = new_entries;
+        tape->capacity = new_capacity;
+    }
+
+    Py_ssize_t index = tape->size++;
+    NT_JsonEntry *entry = &tape->entries[index];
+    entry->kind = kind;
+    entry->escaped = false;
+    entry->start = start;
+    entry->end = start;
+    entry->count = 0;
+    entry->next = index + 1;
+    return index;
+}
+
+static int scan_value(NT_JsonTape *tape, Py_ssize_t *pos, int depth)
+{
+    if (*pos >= tape->length)
+    {
+        return scan_error(*pos, "value");
+    }
+
+    switch (tape->data[*pos])
+    {
+    case '{':
+        return scan_object(tape, pos, depth + 1);
+    case '[':
+        return scan_array(tape, pos, depth + 1);
+    case '"':
+        return scan_string(tape, pos);
+    case 't':
+        return scan_literal(tape, pos, "true", 4, JSON_TRUE);
+    case 'f':
+        return scan_literal(tape, pos, "false", 5, JSON_FALSE);
+    case 'n':
+        return scan_literal(tape, pos, "null", 4, JSON_NULL);
+    default:
+        return scan_number(tape, pos);
+    }
+}
+
+static int scan_object(NT_JsonTape *tape, Py_ssize_t *pos, int depth)
+{
+    if (depth > JSON_MAX_DEPTH)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "JSON document is nested too deeply");
+        return -1;
+    }
+
+    Py_ssize_t index = push_entry(tape, JSON_OBJECT, *pos);
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    Py_ssize_t count = 0;
+    (*pos)++;
+    skip_whitespace(tape, pos);
+
+    if (*pos < tape->length && tape->data[*pos] == '}')
+    {
+        (*pos)++;
+        tape->entries[index].next = tape->size;
+        return 0;
+    }
+
+    for (;;)
+    {
+        if (*pos >= tape->length || tape->data[*pos] != '"')
+        {
+            return scan_error(*pos, "property name");
+        }
+
+        if (scan_string(tape, pos) < 0)
+        {
+            return -1;
+        }
+
+        skip_whitespace(tape, pos);
+
+        if (*pos >= tape->length || tape->data[*pos] != ':')
+        {
+            return scan_error(*pos, "':'");
+        }
+
+        (*pos)++;
+        skip_whitespace(tape, pos);
+
+        if (scan_value(tape, pos, depth) < 0)
+        {
+            return -1;
+        }
+
+        count++;
+        skip_whitespace(tape, pos);
+
+        if (*pos < tape->length && tape->data[*pos] == ',')
+        {
+            (*pos)++;
+            skip_whitespace(tape, pos);
+            continue;
+        }
+
+        if (*pos < tape->length && tape->data[*pos] == '}')
+        {
+            (*pos)++;
+            break;
+        }
+
+        return scan_error(*pos, "',' or '}'");
+    }
+
+    tape->entries[index].count = count;
+    tape->entries[index].next = tape->size;
+    return 0;
+}
+
+static int scan_array(NT_JsonTape *tape, Py_ssize_t *pos, int depth)
+{
+    if (depth > JSON_MAX_DEPTH)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "JSON document is nested too deeply");
+        return -1;
+    }
+
+    Py_ssize_t index = push_entry(tape, JSON_ARRAY, *pos);
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    Py_ssize_t count = 0;
+    (*pos)++;
+    skip_whitespace(tape, pos);
+
+    if (*pos < tape->length && tape->data[*pos] == ']')
+    {
+        (*pos)++;
+        tape->entries[index].next = tape->size;
+        return 0;
+    }
+
+    for (;;)
+    {
+        if (scan_value(tape, pos, depth) < 0)
+        {
+            return -1;
+        }
+
+        count++;
+        skip_whitespace(tape, pos);
+
+        if (*pos < tape->length && tape->data[*pos] == ',')
+        {
+            (*pos)++;
+            skip_whitespace(tape, pos);
+            continue;
+        }
+
+        if (*pos < tape->length && tape->data[*pos] == ']')
+        {
+            (*pos)++;
+            break;
+        }
+
+        return scan_error(*pos, "',' or ']'");
+    }
+
+    tape->entries[index].count = count;
+    tape->entries[index].next = tape->size;
+    return 0;
+}
+
+static int scan_string(NT_JsonTape *tape, Py_ssize_t *pos)
+{
+    const char *data = tape->data;
+    Py_ssize_t length = tape->length;
+    Py_ssize_t p = *pos + 1;
+    bool escaped = false;
+
+    while (p < length && data[p] != '"')
+    {
+        unsigned char ch = (unsigned char)data[p];
+
+        if (ch < 0x20)
+        {
+            return scan_error(p, "closing quote");
+        }
+
+        if (ch != '\\')
+        {
+            p++;
+            continue;
+        }
+
+        escaped = true;
+        p++;
+
+        if (p >= length)
+        {
+            break;
+        }
+
+        switch (data[p])
+        {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            p++;
+            break;
+        case 'u':
+            for (int i = 1; i <= 4; i++)
+            {
+                if (p + i >= length || hex_value(data[p + i]) < 0)
+                {
+                    return scan_error(p + i, "hex digit");
+                }
+            }
+            p += 5;
+            break;
+        default:
+            return scan_error(p, "escape sequence");
+        }
+    }
+
+    if (p >= length)
+    {
+        return scan_error(p, "closing quote");
+    }
+
+    Py_ssize_t index = push_entry(tape, JSON_STRING, *pos + 1);
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    tape->entries[index].end = p;
+    tape->entries[index].escaped = escaped;
+    *pos = p + 1;
+    return 0;
+}
+
+static int scan_number(NT_JsonTape *tape, Py_ssize_t *pos)
+{
+    const char *data = tape->data;
+    Py_ssize_t length = tape->length;
+    Py_ssize_t p = *pos;
+    NT_JsonKind kind = JSON_INT;
+
+    if (p < length && data[p] == '-')
+    {
+        p++;
+    }
+
+    if (p < length && data[p] == '0')
+    {
+        p++;
+    }
+    else if (p < length && data[p] >= '1' && data[p] <= '9')
+    {
+        while (p < length && data[p] >= '0' && data[p] <= '9')
+        {
+            p++;
+        }
+    }
+    else
+    {
+        return scan_error(*pos, "value");
+    }
+
+    if (p < length && data[p] == '.')
+    {
+        kind = JSON_FLOAT;
+        p++;
+
+        if (p >= length || data[p] < '0' || data[p] > '9')
+        {
+            return scan_error(p, "digit");
+        }
+
+        while (p < length && data[p] >= '0' && data[p] <= '9')
+        {
+            p++;
+        }
+    }
+
+    if (p < length && (data[p] == 'e' || data[p] == 'E'))
+    {
+        kind = JSON_FLOAT;
+        p++;
+
+        if (p < length && (data[p] == '+' || data[p] == '-'))
+        {
+            p++;
+        }
+
+        if (p >= length || data[p] < '0' || data[p] > '9')
+        {
+            return scan_error(p, "digit");
+        }
+
+        while (p < length && data[p] >= '0' && data[p] <= '9')
+        {
+            p++;
+        }
+    }
+
+    Py_ssize_t index = push_entry(tape, kind, *pos);
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    tape->entries[index].end = p;
+    *pos = p;
+    return 0;
+}
+
+static int scan_literal(NT_JsonTape *tape, Py_ssize_t *pos,
+                        const char *word, Py_ssize_t word_length,
+                        NT_JsonKind kind)
+{
+    if (tape->length - *pos < word_length ||
+        memcmp(tape->data + *pos, word, word_length) != 0)
+    {
+        return scan_error(*pos, "value");
+    }
+
+    Py_ssize_t index = push_entry(tape, kind, *pos);
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    *pos += word_length;
+    tape->entries[index].end = *pos;
+    return 0;
+}
+
+static int scan_error(Py_ssize_t pos, const char *expected)
+{
+    PyErr_Format(PyExc_ValueError, "invalid JSON: expected %s at byte %zd",
+                 expected, pos);
+    return -1;
+}
+
+static inline void skip_whitespace(NT_JsonTape *tape, Py_ssize_t *pos)
+{
+    while (*pos < tape->length)
+    {
+        char ch = tape->data[*pos];
+        if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r')
+        {
+            break;
+        }
+        (*pos)++;
+    }
+}
+
+static inline int hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+    {
+        return ch - '0';
+    }
+
+    if (ch >= 'a' && ch <= 'f')
+    {
+        return ch - 'a' + 10;
+    }
+
+    if (ch >= 'A' && ch <= 'F')
+    {
+        return ch - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/// @brief Read the four hex digits at `data`, which have already been
+/// validated.
+static inline Py_UCS4 read_code_unit(const char *data)
+{
+    Py_UCS4 code_unit = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        code_unit = (code_unit << 4) | (Py_UCS4)hex_value(data[i]);
+    }
+    return code_unit;
+}
+
+/// @brief Write `code_point` to `out` as UTF-8. Lone surrogates are encoded
+/// as if they were ordinary code points, to be decoded with
+/// "surrogatepass".
+/// @return The number of bytes written.
+static inline Py_ssize_t write_utf8(char *out, Py_UCS4 code_point)
+{
+    if (code_point < 0x80)
+    {
+        out[0] = (char)code_point;
+        return 1;
+    }
+
+    if (code_point < 0x800)
+    {
+        out[0] = (char)(0xC0 | (code_point >> 6));
+        out[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+
+    if (code_point < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (code_point >> 12));
+        out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+
+    out[0] = (char)(0xF0 | (code_point >> 18));
+    out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+static PyObject *decode_escaped(NT_JsonTape *tape, const NT_JsonEntry *entry)
+{
+    const char *data = tape->data;
+    Py_ssize_t end = entry->end;
+
+    // Unescaped text is never longer than its escaped source.
+    char *buf = PyMem_Malloc(end - entry->start + 1);
+    if (!buf)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    Py_ssize_t size = 0;
+    Py_ssize_t p = entry->start;
+
+    while (p < end)
+    {
+        if (data[p] != '\\')
+        {
+            buf[size++] = data[p++];
+            continue;
+        }
+
+        char ch = data[p + 1];
+        p += 2;
+
+        switch (ch)
+        {
+        case 'b':
+            buf[size++] = '\b';
+            break;
+        case 'f':
+            buf[size++] = '\f';
+            break;
+        case 'n':
+            buf[size++] = '\n';
+            break;
+        case 'r':
+            buf[size++] = '\r';
+            break;
+        case 't':
+            buf[size++] = '\t';
+            break;
+        case 'u':
+        {
+            Py_UCS4 code_point = read_code_unit(data + p);
+            p += 4;
+
+            // Combine a surrogate pair, if we have one.
+            if (code_point >= 0xD800 && code_point <= 0xDBFF &&
+                end - p >= 6 && data[p] == '\\' && data[p + 1] == 'u')
+            {
+                Py_UCS4 low = read_code_unit(data + p + 2);
+                if (low >= 0xDC00 && low <= 0xDFFF)
+                {
+                    code_point =
+                        0x10000 + ((code_point - 0xD800) << 10) +
+                        (low - 0xDC00);
+                    p += 6;
+                }
+            }
+
+            size += write_utf8(buf + size, code_point);
+            break;
+        }
+        default:
+            // '"', '\\' or '/'
+            buf[size++] = ch;
+            break;
+        }
+    }
+
+    PyObject *str = PyUnicode_DecodeUTF8(buf, size, "surrogatepass");
+    PyMem_Free(buf);
+    return str;
+}
+
+static PyObject *decode_number(NT_JsonTape *tape, const NT_JsonEntry *entry)
+{
+    const char *data = tape->data + entry->start;
+    Py_ssize_t length = entry->end - entry->start;
+
+    // Small integers don't need a copy of their text.
+    if (entry->kind == JSON_INT && length < 19)
+    {
+        long long value = 0;
+        Py_ssize_t i = data[0] == '-' ? 1 : 0;
+
+        for (; i < length; i++)
+        {
+            value = value * 10 + (data[i] - '0');
+        }
+
+        return PyLong_FromLongLong(data[0] == '-' ? -value : value);
+    }
+
+    // Everything else goes via a NUL terminated copy.
+    char stack_buf[JSON_NUMBER_BUF_SIZE];
+    char *buf = stack_buf;
+    PyObject *result = NULL;
+
+    if (length >= JSON_NUMBER_BUF_SIZE)
+    {
+        buf = PyMem_Malloc(length + 1);
+        if (!buf)
+        {
+            PyErr_NoMemory();
+            return NULL;
+        }
+    }
+
+    memcpy(buf, data, length);
+    buf[length] = '\0';
+
+    if (entry->kind == JSON_INT)
+    {
+        result = PyLong_FromString(buf, NULL, 10);
+    }
+    else
+    {
+        double value = PyOS_string_to_double(buf, NULL, NULL);
+        if (!(value == -1.0 && PyErr_Occurred()))
+        {
+            result = PyFloat_FromDouble(value);
+        }
+    }
+
+    if (buf != stack_buf)
+    {
+        PyMem_Free(buf);
+    }
+
+    return result;
+}
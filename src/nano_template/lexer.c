@@ -276,6 +276,9 @@ static NT_Token NT_Lexer_lex_expr(NT_Lexer *l)
     case ')':
         l->pos++;
         return NT_Token_make(start, l->pos, TOK_R_PAREN);
+    case ',':
+        l->pos++;
+        return NT_Token_make(start, l->pos, TOK_COMMA);
     case '-':
         l->pos++;
         if (!NT_Lexer_accept_while(l, is_ascii_digit))
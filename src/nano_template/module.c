@@ -1,9 +1,15 @@
 // SPDX-License-Identifier: MIT
 
+#include "nano_template/py_json.h"
+#include "nano_template/py_lazy.h"
 #include "nano_template/py_parse.h"
+#include "nano_template/py_prepared.h"
+#include "nano_template/py_render_iterator.h"
+#include "nano_template/py_serialize.h"
 #include "nano_template/py_template.h"
 #include "nano_template/py_token_view.h"
 #include "nano_template/py_tokenize.h"
+#include "nano_template/string_buffer.h"
 #include <Python.h>
 
 static PyMethodDef nano_template_methods[] = {
@@ -11,6 +17,9 @@ static PyMethodDef nano_template_methods[] = {
      PyDoc_STR("parse(str) -> Template")},
     {"tokenize", tokenize, METH_O,
      PyDoc_STR("tokenize(str) -> list[TokenView]")},
+    {"lazy", lazy, METH_O, PyDoc_STR("lazy(fn) -> Lazy")},
+    {"prepare", prepare, METH_O, PyDoc_STR("prepare(mapping) -> Prepared")},
+    {"serialize", serialize, METH_O, PyDoc_STR("serialize(obj) -> str")},
     {NULL, NULL, 0, NULL}};
 
 static struct PyModuleDef nano_template_module = {
@@ -43,5 +52,41 @@ PyMODINIT_FUNC PyInit__nano_template(void)
         return NULL;
     }
 
+    if (nt_register_render_iterator_type(mod) < 0)
+    {
+        Py_DECREF(mod);
+        return NULL;
+    }
+
+    if (nt_register_lazy_type(mod) < 0)
+    {
+        Py_DECREF(mod);
+        return NULL;
+    }
+
+    if (nt_register_prepared_type(mod) < 0)
+    {
+        Py_DECREF(mod);
+        return NULL;
+    }
+
+    if (nt_register_json_view_type(mod) < 0)
+    {
+        Py_DECREF(mod);
+        return NULL;
+    }
+
+    if (nt_register_serializer(mod) < 0)
+    {
+        Py_DECREF(mod);
+        return NULL;
+    }
+
+    if (nt_init_scratch_buffers() < 0)
+    {
+        Py_DECREF(mod);
+        return NULL;
+    }
+
     return mod;
 }
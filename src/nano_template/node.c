@@ -1,43 +1,151 @@
 // SPDX-License-Identifier: MIT
 
 #include "nano_template/node.h"
+#include "nano_template/numeric_buffer.h"
+#include "nano_template/py_json.h"
+#include "nano_template/py_lazy.h"
+#include "nano_template/py_serialize.h"
 #include "nano_template/string_buffer.h"
 
 /// @brief Render `node` to `buf` with data from render context `ctx`.
 typedef int (*RenderFn)(const NT_Node *node, NT_RenderContext *ctx,
-                        PyObject *buf);
+                        NT_StringBuffer *buf);
 
 static int render_output(const NT_Node *node, NT_RenderContext *ctx,
-                         PyObject *buf);
+                         NT_StringBuffer *buf);
 
 static int render_if_tag(const NT_Node *node, NT_RenderContext *ctx,
-                         PyObject *buf);
+                         NT_StringBuffer *buf);
 
 static int render_for_tag(const NT_Node *node, NT_RenderContext *ctx,
-                          PyObject *buf);
+                          NT_StringBuffer *buf);
 
 static int render_text(const NT_Node *node, NT_RenderContext *ctx,
-                       PyObject *buf);
+                       NT_StringBuffer *buf);
+
+static int render_text_output(const NT_Node *node, NT_RenderContext *ctx,
+                              NT_StringBuffer *buf);
+
+static int render_if_output(const NT_Node *node, NT_RenderContext *ctx,
+                            NT_StringBuffer *buf);
+
+static int render_output_default(const NT_Node *node, NT_RenderContext *ctx,
+                                 NT_StringBuffer *buf);
 
 static RenderFn render_table[] = {
     [NODE_OUPUT] = render_output,
     [NODE_IF_TAG] = render_if_tag,
     [NODE_FOR_TAG] = render_for_tag,
     [NODE_TEXT] = render_text,
+    [NODE_FOR_JOIN_TAG] = render_for_tag,
+    [NODE_TEXT_OUTPUT] = render_text_output,
+    [NODE_IF_OUTPUT] = render_if_output,
+    [NODE_OUTPUT_DEFAULT] = render_output_default,
 };
 
-static int render_block(NT_Node *node, NT_RenderContext *ctx, PyObject *buf);
-
-/// @brief Render node->children if node->expr is truthy.
-/// @return 1 if expr is truthy, 0 if expr is falsy, -1 on error.
-static int render_conditional_block(NT_Node *node, NT_RenderContext *ctx,
-                                    PyObject *buf);
+static int render_block(NT_Node *node, NT_RenderContext *ctx,
+                        NT_StringBuffer *buf);
+
+/// @brief Render the block of a NODE_FOR_JOIN_TAG, with `item` as the loop
+/// variable. Text is appended as is and `item` is serialized at most once,
+/// without dispatching on node kind or evaluating expressions.
+static int render_join_block(const NT_Node *node, NT_RenderContext *ctx,
+                             NT_StringBuffer *buf, PyObject *item);
+
+/// @brief Render NODE_FOR_JOIN_TAG `node` over the items of numeric buffer
+/// `op`, formatting numbers straight into the output without creating a
+/// Python object for each item.
+/// @return 0 on success, 1 if `op` is not a non-empty numeric buffer, or -1
+/// on error.
+static int render_numeric_loop(const NT_Node *node, NT_RenderContext *ctx,
+                               NT_StringBuffer *buf, PyObject *op);
+
+/// @brief Serialize `op` for output with `ctx->serializer`.
+/// @return A new reference to a string, or NULL on failure.
+static PyObject *serialize_output(NT_RenderContext *ctx, PyObject *op);
+
+/// @brief Find the block of if tag `node` whose condition is truthy, or
+/// its else block.
+/// @return 0 on success, with `block` set to the block to render or NULL if
+/// there isn't one. -1 on error.
+static int if_tag_branch(const NT_Node *node, NT_RenderContext *ctx,
+                         const NT_Node **block);
+
+/// @brief The state of a for loop over an exact tuple or dict, or over an
+/// iterator for anything else.
+typedef struct NT_LoopCursor
+{
+    PyObject *obj;   // The tuple or dict being walked, or NULL.
+    PyObject *it;    // An iterator, if we're not walking `obj` directly.
+    Py_ssize_t pos;  // Index or PyDict_Next position into `obj`.
+    Py_ssize_t size; // Size of a dict when we started walking it.
+    PyObject *pair;  // The last (key, value) tuple yielded from a dict.
+} NT_LoopCursor;
+
+/// @brief Prepare `cursor` for iterating `op`. Async iterables are consumed
+/// with `ctx->aiter`, if it is set.
+/// @return 0 on success, 1 if op is not iterable, -1 on error.
+static int loop_cursor_init(NT_RenderContext *ctx, PyObject *op,
+                            NT_LoopCursor *cursor);
+
+/// @brief Advance `cursor`, setting `item` to a new reference to the next
+/// item.
+/// @return 1 if `item` was set, 0 if there are no more items, or -1 on error.
+static int loop_cursor_next(NT_LoopCursor *cursor, PyObject **item);
+
+/// @brief Advance `cursor` over an exact dict, setting `key` and `value` to
+/// borrowed references.
+/// @return 1 if `key` and `value` were set, 0 if there are no more items, or
+/// -1 on error.
+static int loop_cursor_next_dict(NT_LoopCursor *cursor, PyObject **key,
+                                 PyObject **value);
+
+/// @brief Advance `cursor` and unpack the next item into `key` and `value`,
+/// setting both to new references.
+/// @return 1 if `key` and `value` were set, 0 if there are no more items, or
+/// -1 on error.
+static int loop_cursor_next_pair(NT_LoopCursor *cursor, PyObject **key,
+                                 PyObject **value);
+
+static void loop_cursor_clear(NT_LoopCursor *cursor);
+
+/// @brief Evaluate for tag `node`'s loop target and get `cursor` ready to
+/// loop over it.
+/// @param whole If true, a loop over a numeric buffer can be rendered in
+/// one go, without stopping between items.
+/// @return 0 if `cursor` is ready, 1 if there's nothing more to do because
+/// the loop was rendered by a specialized loop or has no block, 2 if the
+/// target is not iterable, or -1 on error.
+static int for_tag_begin(const NT_Node *node, NT_RenderContext *ctx,
+                         NT_StringBuffer *buf, NT_LoopCursor *cursor,
+                         bool whole);
+
+/// @brief Bind for tag `node`'s loop variables to the next item from
+/// `cursor`, releasing the previous item.
+/// @return 1 if the variables were bound, 0 if there are no more items, or
+/// -1 on error. The variables are unbound unless 1 is returned.
+static int for_tag_next(const NT_Node *node, NT_RenderContext *ctx,
+                        NT_LoopCursor *cursor);
+
+/// @brief Render one item of for tag `node` with its loop variables bound.
+/// @return 0 on success, -1 on failure with an exception set.
+static int for_tag_render_item(const NT_Node *node, NT_RenderContext *ctx,
+                               NT_StringBuffer *buf);
+
+/// @brief Return for tag `node`'s else block, or NULL if it doesn't have
+/// one.
+static inline NT_Node *for_tag_else(const NT_Node *node)
+{
+    return node->head->count == 2 ? node->head->nodes[1] : NULL;
+}
 
-/// @brief Get an iterator for object `op`.
+/// @brief Get an iterator for object `op`. Async iterables are consumed with
+/// `ctx->aiter`, if it is set.
 /// @return 0 on success, 1 if op is not iterable, -1 on error.
-static int iter(PyObject *op, PyObject **out_iter);
+static int iter(NT_RenderContext *ctx, PyObject *op, PyObject **out_iter);
 
-int NT_Node_render(const NT_Node *node, NT_RenderContext *ctx, PyObject *buf)
+int NT_Node_render(const NT_Node *node, NT_RenderContext *ctx,
+                   NT_StringBuffer *buf)
 {
     if (!node)
     {
@@ -54,196 +162,384 @@ int NT_Node_render(const NT_Node *node, NT_RenderContext *ctx, PyObject *buf)
 }
 
 static int render_output(const NT_Node *node, NT_RenderContext *ctx,
-                         PyObject *buf)
+                         NT_StringBuffer *buf)
 {
-    PyObject *str = NULL;
-    PyObject *op = NT_Expr_evaluate(node->expr, ctx);
+    PyObject *owned = NULL;
+    PyObject *op = NT_Expr_evaluate_borrowed(node->expr, ctx, &owned);
 
     if (!op)
     {
         return -1;
     }
 
-    str = PyObject_CallFunctionObjArgs(ctx->serializer, op, NULL);
+    PyObject *str = serialize_output(ctx, op);
+    Py_XDECREF(owned);
 
     if (!str)
     {
-        goto fail;
+        return -1;
     }
 
     int rv = StringBuffer_append(buf, str);
-    if (rv < 0)
+    Py_DECREF(str);
+    return rv;
+}
+
+static int render_text_output(const NT_Node *node, NT_RenderContext *ctx,
+                              NT_StringBuffer *buf)
+{
+    if (node->str &&
+        NT_RenderContext_append_text(ctx, buf, node->str, node->bytes) < 0)
+    {
+        return -1;
+    }
+
+    if (render_output(node, ctx, buf) < 0)
     {
-        goto fail;
+        return -1;
     }
 
-    Py_DECREF(str);
-    Py_DECREF(op);
+    if (node->str2 &&
+        NT_RenderContext_append_text(ctx, buf, node->str2, node->bytes2) < 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/// @brief Test `op`, which is borrowed unless `*owned` is set, for
+/// truthiness before it is serialized. If the test calls back into Python,
+/// `*owned` takes a reference to `op` first, so `op` outlives any changes
+/// the call makes to the data it was found in.
+/// @return 1 if `op` is truthy, 0 if it is falsy, or -1 on failure.
+static int output_truthy(PyObject *op, PyObject **owned)
+{
+    int rv = nt_truthy_fast(op);
+    if (rv != -2)
+    {
+        return rv;
+    }
+
+    if (!*owned)
+    {
+        *owned = Py_NewRef(op);
+    }
+
+    return PyObject_IsTrue(op);
+}
+
+static int render_if_output(const NT_Node *node, NT_RenderContext *ctx,
+                            NT_StringBuffer *buf)
+{
+    PyObject *owned = NULL;
+    PyObject *str = NULL;
+    int rv = -1;
+
+    // The variable is resolved once, for both the test and the output.
+    PyObject *op = NT_Expr_evaluate_borrowed(node->expr, ctx, &owned);
+    if (!op)
+    {
+        return -1;
+    }
+
+    int truthy = output_truthy(op, &owned);
+    if (truthy <= 0)
+    {
+        rv = truthy;
+        goto cleanup;
+    }
+
+    str = serialize_output(ctx, op);
+    if (!str)
+    {
+        goto cleanup;
+    }
+
+    rv = StringBuffer_append(buf, str);
+
+cleanup:
+    Py_XDECREF(str);
+    Py_XDECREF(owned);
     return rv;
+}
 
-fail:
-    Py_XDECREF(op);
+static int render_output_default(const NT_Node *node, NT_RenderContext *ctx,
+                                 NT_StringBuffer *buf)
+{
+    PyObject *owned = NULL;
+    PyObject *str = NULL;
+    int rv = -1;
+
+    PyObject *op = NT_Expr_evaluate_borrowed(node->expr, ctx, &owned);
+    if (!op)
+    {
+        return -1;
+    }
+
+    int truthy = output_truthy(op, &owned);
+    if (truthy < 0)
+    {
+        goto cleanup;
+    }
+
+    if (!truthy && NTPY_Serializer_is_default(ctx->serializer))
+    {
+        // The default serializer leaves strings as they are.
+        rv = NT_RenderContext_append_text(ctx, buf, node->str, node->bytes);
+        goto cleanup;
+    }
+
+    str = serialize_output(ctx, truthy ? op : node->str);
+    if (!str)
+    {
+        goto cleanup;
+    }
+
+    rv = StringBuffer_append(buf, str);
+
+cleanup:
     Py_XDECREF(str);
-    return -1;
+    Py_XDECREF(owned);
+    return rv;
 }
 
 static int render_if_tag(const NT_Node *node, NT_RenderContext *ctx,
-                         PyObject *buf)
+                         NT_StringBuffer *buf)
 {
-    int rv = 0;
-    NT_Node *child = NULL;
-    NT_NodePage *page = node->head;
+    const NT_Node *block = NULL;
 
-    while (page)
+    if (if_tag_branch(node, ctx, &block) < 0)
+    {
+        return -1;
+    }
+
+    return block ? render_block((NT_Node *)block, ctx, buf) : 0;
+}
+
+static int if_tag_branch(const NT_Node *node, NT_RenderContext *ctx,
+                         const NT_Node **block)
+{
+    *block = NULL;
+
+    for (NT_NodePage *page = node->head; page; page = page->next)
     {
         for (Py_ssize_t i = 0; i < page->count; i++)
         {
-            child = page->nodes[i];
+            NT_Node *child = page->nodes[i];
 
             if (child->kind == NODE_ELSE_BLOCK)
             {
-                return render_block(child, ctx, buf);
+                *block = child;
+                return 0;
             }
 
-            rv = render_conditional_block(child, ctx, buf);
-
-            if (rv == 0)
+            if (!child->expr)
             {
                 continue;
             }
 
-            return rv;
-        }
+            int truthy = NT_Expr_truthy(child->expr, ctx);
 
-        page = page->next;
+            if (truthy < 0)
+            {
+                return -1;
+            }
+
+            if (truthy)
+            {
+                *block = child;
+                return 0;
+            }
+        }
     }
 
     return 0;
 }
 
 static int render_for_tag(const NT_Node *node, NT_RenderContext *ctx,
-                          PyObject *buf)
+                          NT_StringBuffer *buf)
 {
-    if (!node->head)
+    NT_LoopCursor cursor = {0};
+    int rc = for_tag_begin(node, ctx, buf, &cursor, true);
+
+    if (rc == 1)
     {
         return 0;
     }
 
-    // We assume a single page. A for tag can have 1 or 2 children.
-    Py_ssize_t child_count = node->head->count;
+    if (rc == 2)
+    {
+        NT_Node *orelse = for_tag_else(node);
+        return orelse ? render_block(orelse, ctx, buf) : 0;
+    }
 
-    if (child_count < 1)
+    if (rc < 0)
     {
-        return 0;
+        return -1;
     }
 
-    PyObject *key = node->str;
-    NT_Node *block = node->head->nodes[0];
-    PyObject *op = NULL;
-    PyObject *it = NULL;
-    PyObject *namespace = NULL;
-    PyObject *item = NULL;
+    bool rendered = false;
 
-    op = NT_Expr_evaluate(node->expr, ctx);
-    if (!op)
+    while ((rc = for_tag_next(node, ctx, &cursor)) == 1)
     {
-        return -1;
+        rendered = true;
+
+        if (for_tag_render_item(node, ctx, buf) < 0)
+        {
+            goto fail;
+        }
+
+        // Send output on its way once there's a chunk's worth, so rows from
+        // slow iterators are not held back.
+        if (NT_RenderContext_maybe_flush(ctx, buf) < 0)
+        {
+            goto fail;
+        }
     }
 
-    int rc = iter(op, &it);
-    Py_DECREF(op);
+    loop_cursor_clear(&cursor);
 
-    if (rc == -1)
+    if (rc < 0)
     {
         return -1;
     }
 
-    if (rc == 1)
+    NT_Node *orelse = for_tag_else(node);
+
+    if (!rendered && orelse)
     {
-        // not iterable
-        if (child_count == 2)
-        {
-            // else block
-            render_block(node->head->nodes[1], ctx, buf);
-        }
+        return render_block(orelse, ctx, buf);
+    }
 
-        return 0;
+    return 0;
+
+fail:
+    Py_CLEAR(ctx->bindings[node->binding]);
+    if (node->str2)
+    {
+        Py_CLEAR(ctx->bindings[node->binding + 1]);
+    }
+    loop_cursor_clear(&cursor);
+    return -1;
+}
+
+static int for_tag_begin(const NT_Node *node, NT_RenderContext *ctx,
+                         NT_StringBuffer *buf, NT_LoopCursor *cursor,
+                         bool whole)
+{
+    // We assume a single page. A for tag can have 1 or 2 children.
+    if (!node->head || node->head->count < 1)
+    {
+        return 1;
     }
 
-    namespace = PyDict_New();
-    if (!namespace)
+    Py_ssize_t binding_count = node->str2 ? 2 : 1;
+
+    if (node->binding < 0 ||
+        node->binding + binding_count > ctx->binding_count)
     {
-        goto fail;
+        PyErr_SetString(PyExc_RuntimeError, "unbound loop variable");
+        return -1;
     }
 
-    if (NT_RenderContext_push(ctx, namespace) < 0)
+    PyObject *owned = NULL;
+    PyObject *op = NT_Expr_evaluate_borrowed(node->expr, ctx, &owned);
+    if (!op)
     {
-        goto fail;
+        return -1;
     }
 
-    bool rendered = false;
+    int rc = 1;
 
-    for (;;)
+    // Numbers from buffers are formatted natively when the default
+    // serializer would have called `str()` on them anyway.
+    if (whole && node->kind == NODE_FOR_JOIN_TAG &&
+        NTPY_Serializer_is_default(ctx->serializer))
     {
-        item = PyIter_Next(it);
-        if (!item)
+        rc = render_numeric_loop(node, ctx, buf, op);
+        if (rc <= 0)
         {
-            if (PyErr_Occurred())
-            {
-                goto fail;
-            }
-            break;
+            Py_XDECREF(owned);
+            return rc < 0 ? -1 : 1;
         }
+    }
 
-        if (PyDict_SetItem(namespace, key, item) < 0)
-        {
-            goto fail;
-        }
+    rc = loop_cursor_init(ctx, op, cursor);
+    Py_XDECREF(owned);
 
-        Py_DECREF(item);
-        rendered = true;
+    if (rc < 0)
+    {
+        return -1;
+    }
+
+    return rc == 1 ? 2 : 0;
+}
+
+static int for_tag_next(const NT_Node *node, NT_RenderContext *ctx,
+                        NT_LoopCursor *cursor)
+{
+    // Loop variables are bound to slots in the render context, so looping
+    // doesn't allocate a namespace or write to one on every iteration.
+    PyObject **key = &ctx->bindings[node->binding];
+    int rc;
+
+    // Release the previous item first, so a dict's (key, value) pair can be
+    // reused.
+    Py_CLEAR(*key);
+
+    if (node->str2)
+    {
+        PyObject **value = key + 1;
+        Py_CLEAR(*value);
+        rc = loop_cursor_next_pair(cursor, key, value);
 
-        if (render_block(block, ctx, buf) < 0)
+        if (rc < 0)
         {
-            goto fail;
+            Py_CLEAR(*key);
+            Py_CLEAR(*value);
         }
     }
-
-    Py_DECREF(it);
-    NT_RenderContext_pop(ctx);
-    Py_DECREF(namespace);
-
-    if (!rendered && child_count == 2)
+    else
     {
-        if (render_block(node->head->nodes[1], ctx, buf) < 0)
+        rc = loop_cursor_next(cursor, key);
+
+        if (rc < 0)
         {
-            goto fail;
+            Py_CLEAR(*key);
         }
     }
 
-    return 0;
+    return rc;
+}
 
-fail:
-    Py_XDECREF(namespace);
-    Py_XDECREF(it);
-    Py_XDECREF(item);
-    return -1;
+static int for_tag_render_item(const NT_Node *node, NT_RenderContext *ctx,
+                               NT_StringBuffer *buf)
+{
+    NT_Node *block = node->head->nodes[0];
+
+    if (node->kind == NODE_FOR_JOIN_TAG)
+    {
+        return render_join_block(block, ctx, buf,
+                                 ctx->bindings[node->binding]);
+    }
+
+    return render_block(block, ctx, buf);
 }
 
 static int render_text(const NT_Node *node, NT_RenderContext *ctx,
-                       PyObject *buf)
+                       NT_StringBuffer *buf)
 {
-    (void)ctx;
-
     if (!node->str)
     {
         return 0;
     }
 
-    return StringBuffer_append(buf, node->str);
+    return NT_RenderContext_append_text(ctx, buf, node->str, node->bytes);
 }
 
-static int render_block(NT_Node *node, NT_RenderContext *ctx, PyObject *buf)
+static int render_block(NT_Node *node, NT_RenderContext *ctx,
+                        NT_StringBuffer *buf)
 {
     NT_NodePage *page = node->head;
     while (page)
@@ -261,79 +557,878 @@ static int render_block(NT_Node *node, NT_RenderContext *ctx, PyObject *buf)
     return 0;
 }
 
-static int render_conditional_block(NT_Node *node, NT_RenderContext *ctx,
-                                    PyObject *buf)
+static int render_join_block(const NT_Node *node, NT_RenderContext *ctx,
+                             NT_StringBuffer *buf, PyObject *item)
 {
-    if (!node->expr)
+    PyObject *owned = NULL;
+    PyObject *str = NULL;
+    int rv = -1;
+
+    if (NTPY_Lazy_Check(item))
     {
-        return 0;
+        item = NT_RenderContext_force(ctx, item, &owned);
+        if (!item)
+        {
+            return -1;
+        }
     }
 
-    PyObject *op = NT_Expr_evaluate(node->expr, ctx);
-    if (!op)
+    for (NT_NodePage *page = node->head; page; page = page->next)
     {
-        return -1;
-    }
+        for (Py_ssize_t i = 0; i < page->count; i++)
+        {
+            NT_Node *child = page->nodes[i];
 
-    int truthy = PyObject_IsTrue(op);
-    Py_XDECREF(op);
+            if (child->kind == NODE_TEXT)
+            {
+                if (child->str &&
+                    NT_RenderContext_append_text(ctx, buf, child->str,
+                                                 child->bytes) < 0)
+                {
+                    goto cleanup;
+                }
+                continue;
+            }
 
-    if (!truthy)
-    {
-        return 0;
-    }
+            if (!str)
+            {
+                str = serialize_output(ctx, item);
+                if (!str)
+                {
+                    goto cleanup;
+                }
+            }
 
-    if (render_block(node, ctx, buf) < 0)
-    {
-        return -1;
+            if (StringBuffer_append(buf, str) < 0)
+            {
+                goto cleanup;
+            }
+        }
     }
 
-    return 1;
+    rv = 0;
+
+cleanup:
+    Py_XDECREF(str);
+    Py_XDECREF(owned);
+    return rv;
 }
 
-static int iter(PyObject *op, PyObject **out_iter)
+static int render_numeric_loop(const NT_Node *node, NT_RenderContext *ctx,
+                               NT_StringBuffer *buf, PyObject *op)
 {
-    PyObject *it = NULL;
-    *out_iter = NULL;
-
-    PyObject *items = PyMapping_Items(op);
-
-    if (items)
+    NT_NumericBuffer nb = {0};
+    NT_Node *block = node->head->nodes[0];
+    PyObject **parts = NULL; // UTF-8 encoded text, or NULL for an output
+    Py_ssize_t part_count = 0;
+    Py_ssize_t text_size = 0;
+    char *out = NULL;
+    Py_ssize_t out_size = 0;
+    int rv = -1;
+
+    int rc = NT_NumericBuffer_init(&nb, op);
+    if (rc != 0)
     {
-        it = PyObject_GetIter(items);
-        Py_DECREF(items);
-
-        if (!it)
-        {
-            return -1;
-        }
+        return rc;
+    }
 
-        *out_iter = it;
-        return 0;
+    if (nb.size == 0)
+    {
+        // Leave else blocks to the general case.
+        rv = 1;
+        goto cleanup;
     }
 
-    if (PyErr_ExceptionMatches(PyExc_TypeError) ||
-        PyErr_ExceptionMatches(PyExc_AttributeError))
+    for (NT_NodePage *page = block->head; page; page = page->next)
     {
-        PyErr_Clear(); // not a mapping
+        part_count += page->count;
     }
-    else if (PyErr_Occurred())
+
+    parts = PyMem_Calloc(part_count ? (size_t)part_count : 1,
+                         sizeof(PyObject *));
+    if (!parts)
     {
-        return -1; // unexpected error
+        PyErr_NoMemory();
+        goto cleanup;
     }
 
-    it = PyObject_GetIter(op);
-    if (it)
+    Py_ssize_t n = 0;
+    Py_ssize_t output_count = 0;
+
+    for (NT_NodePage *page = block->head; page; page = page->next)
     {
-        *out_iter = it;
-        return 0;
+        for (Py_ssize_t i = 0; i < page->count; i++, n++)
+        {
+            NT_Node *child = page->nodes[i];
+
+            if (child->kind != NODE_TEXT)
+            {
+                output_count++;
+                continue;
+            }
+
+            if (child->str && !child->bytes)
+            {
+                // Text that can't be encoded to UTF-8 is left to the general
+                // case.
+                rv = 1;
+                goto cleanup;
+            }
+
+            parts[n] = child->bytes ? Py_NewRef(child->bytes)
+                                    : PyBytes_FromStringAndSize(NULL, 0);
+            if (!parts[n])
+            {
+                goto cleanup;
+            }
+
+            text_size += PyBytes_Size(parts[n]);
+        }
     }
 
-    if (PyErr_ExceptionMatches(PyExc_TypeError))
+    // Output is formatted into a bounded scratch buffer and passed on each
+    // time it fills up, so a big loop never holds all of its output twice.
+    Py_ssize_t item_size = text_size + output_count * NT_NUMBER_MAX;
+    Py_ssize_t out_capacity =
+        item_size > NT_NUMERIC_CHUNK_SIZE ? item_size : NT_NUMERIC_CHUNK_SIZE;
+    char number[NT_NUMBER_MAX];
+    Py_ssize_t number_size = 0;
+
+    out = PyMem_Malloc((size_t)out_capacity);
+    if (!out)
     {
-        PyErr_Clear(); // not iterable
-        return 1;
+        PyErr_NoMemory();
+        goto cleanup;
     }
 
-    return -1; // unexpected error
-}
\ No newline at end of file
+    for (Py_ssize_t index = 0; index < nb.size; index++)
+    {
+        number_size = -1;
+
+        for (Py_ssize_t i = 0; i < part_count; i++)
+        {
+            if (parts[i])
+            {
+                Py_ssize_t size = PyBytes_Size(parts[i]);
+                memcpy(out + out_size, PyBytes_AsString(parts[i]),
+                       (size_t)size);
+                out_size += size;
+                continue;
+            }
+
+            if (number_size < 0)
+            {
+                number_size = NT_NumericBuffer_format(&nb, index, number);
+                if (number_size < 0)
+                {
+                    goto cleanup;
+                }
+            }
+
+            memcpy(out + out_size, number, (size_t)number_size);
+            out_size += number_size;
+        }
+
+        // When streaming, output is also passed on once there's a chunk of
+        // it, like any other loop.
+        if (out_capacity - out_size < item_size ||
+            (NT_RenderContext_streaming(ctx) && out_size >= ctx->chunk_size))
+        {
+            if (StringBuffer_append_utf8(buf, out, out_size) < 0 ||
+                NT_RenderContext_maybe_flush(ctx, buf) < 0)
+            {
+                goto cleanup;
+            }
+
+            out_size = 0;
+        }
+    }
+
+    if (StringBuffer_append_utf8(buf, out, out_size) < 0)
+    {
+        goto cleanup;
+    }
+
+    rv = NT_RenderContext_maybe_flush(ctx, buf);
+
+cleanup:
+    for (Py_ssize_t i = 0; parts && i < part_count; i++)
+    {
+        Py_XDECREF(parts[i]);
+    }
+
+    PyMem_Free(parts);
+    PyMem_Free(out);
+    NT_NumericBuffer_clear(&nb);
+    return rv;
+}
+
+static PyObject *serialize_output(NT_RenderContext *ctx, PyObject *op)
+{
+    // JSON views are only turned into Python objects once they reach the
+    // serializer. Either way `value` is a new reference, so a serializer
+    // that changes the data `op` was borrowed from can't free it.
+    PyObject *value = NTPY_JSONView_materialize(op);
+    if (!value)
+    {
+        return NULL;
+    }
+
+    PyObject *str = NULL;
+
+    if (NTPY_Serializer_is_default(ctx->serializer))
+    {
+        str = serialize(NULL, value);
+    }
+    else
+    {
+        str = PyObject_CallFunctionObjArgs(ctx->serializer, value, NULL);
+    }
+
+    Py_DECREF(value);
+    return str;
+}
+
+static int loop_cursor_init(NT_RenderContext *ctx, PyObject *op,
+                            NT_LoopCursor *cursor)
+{
+    // Tuples are immutable, so borrowing their items is always safe.
+    if (PyTuple_CheckExact(op))
+    {
+        cursor->obj = Py_NewRef(op);
+        return 0;
+    }
+
+    // A list's own iterator is as quick as walking it by index with the
+    // limited API, and copes with the list changing size.
+    if (PyList_CheckExact(op))
+    {
+        cursor->it = PyObject_GetIter(op);
+        return cursor->it ? 0 : -1;
+    }
+
+    // Dicts could be changed by another thread on free-threaded builds.
+#ifndef Py_GIL_DISABLED
+    if (PyDict_CheckExact(op))
+    {
+        cursor->obj = Py_NewRef(op);
+        cursor->size = PyDict_Size(op);
+        return 0;
+    }
+#endif
+
+    return iter(ctx, op, &cursor->it);
+}
+
+static int loop_cursor_next_dict(NT_LoopCursor *cursor, PyObject **key,
+                                 PyObject **value)
+{
+    if (PyDict_Size(cursor->obj) != cursor->size)
+    {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "dictionary changed size during iteration");
+        return -1;
+    }
+
+    return PyDict_Next(cursor->obj, &cursor->pos, key, value) ? 1 : 0;
+}
+
+static int loop_cursor_next(NT_LoopCursor *cursor, PyObject **item)
+{
+    PyObject *obj = cursor->obj;
+    *item = NULL;
+
+    if (!obj)
+    {
+        *item = PyIter_Next(cursor->it);
+        if (!*item)
+        {
+            return PyErr_Occurred() ? -1 : 0;
+        }
+        return 1;
+    }
+
+    if (PyTuple_CheckExact(obj))
+    {
+        if (cursor->pos >= PyTuple_Size(obj))
+        {
+            return 0;
+        }
+
+        *item = Py_NewRef(PyTuple_GetItem(obj, cursor->pos++));
+        return 1;
+    }
+
+    // An exact dict.
+    PyObject *key = NULL;
+    PyObject *value = NULL;
+    int rc = loop_cursor_next_dict(cursor, &key, &value);
+
+    if (rc <= 0)
+    {
+        return rc;
+    }
+
+    // Reuse the last pair if nothing else is holding on to it.
+    if (cursor->pair && Py_REFCNT(cursor->pair) == 1)
+    {
+        PyTuple_SetItem(cursor->pair, 0, Py_NewRef(key));
+        PyTuple_SetItem(cursor->pair, 1, Py_NewRef(value));
+
+        // The collector untracks tuples that only hold atomic values, like
+        // an earlier pair might have, but this pair could be in a cycle.
+        if (!PyObject_GC_IsTracked(cursor->pair))
+        {
+            PyObject_GC_Track(cursor->pair);
+        }
+    }
+    else
+    {
+        Py_XDECREF(cursor->pair);
+        cursor->pair = PyTuple_Pack(2, key, value);
+        if (!cursor->pair)
+        {
+            return -1;
+        }
+    }
+
+    *item = Py_NewRef(cursor->pair);
+    return 1;
+}
+
+static int loop_cursor_next_pair(NT_LoopCursor *cursor, PyObject **key,
+                                 PyObject **value)
+{
+    PyObject *item = NULL;
+    PyObject *seq = NULL;
+    *key = NULL;
+    *value = NULL;
+
+    // Bind keys and values straight from a dict, without making a pair.
+    if (cursor->obj && PyDict_CheckExact(cursor->obj))
+    {
+        int rc = loop_cursor_next_dict(cursor, key, value);
+        if (rc == 1)
+        {
+            Py_INCREF(*key);
+            Py_INCREF(*value);
+        }
+        return rc;
+    }
+
+    int rc = loop_cursor_next(cursor, &item);
+    if (rc <= 0)
+    {
+        return rc;
+    }
+
+    if (PyTuple_CheckExact(item))
+    {
+        seq = item;
+        item = NULL;
+    }
+    else
+    {
+        seq = PySequence_Tuple(item);
+        Py_CLEAR(item);
+        if (!seq)
+        {
+            return -1;
+        }
+    }
+
+    Py_ssize_t size = PyTuple_Size(seq);
+    if (size != 2)
+    {
+        PyErr_Format(PyExc_ValueError,
+                     "expected 2 values to unpack in for tag, found %zd",
+                     size);
+        Py_DECREF(seq);
+        return -1;
+    }
+
+    *key = Py_NewRef(PyTuple_GetItem(seq, 0));
+    *value = Py_NewRef(PyTuple_GetItem(seq, 1));
+    Py_DECREF(seq);
+    return 1;
+}
+
+static void loop_cursor_clear(NT_LoopCursor *cursor)
+{
+    Py_CLEAR(cursor->obj);
+    Py_CLEAR(cursor->it);
+    Py_CLEAR(cursor->pair);
+}
+
+static int iter(NT_RenderContext *ctx, PyObject *op, PyObject **out_iter)
+{
+    PyObject *it = NULL;
+    *out_iter = NULL;
+
+    PyObject *items = PyMapping_Items(op);
+
+    if (items)
+    {
+        it = PyObject_GetIter(items);
+        Py_DECREF(items);
+
+        if (!it)
+        {
+            return -1;
+        }
+
+        *out_iter = it;
+        return 0;
+    }
+
+    if (PyErr_ExceptionMatches(PyExc_TypeError) ||
+        PyErr_ExceptionMatches(PyExc_AttributeError))
+    {
+        PyErr_Clear(); // not a mapping
+    }
+    else if (PyErr_Occurred())
+    {
+        return -1; // unexpected error
+    }
+
+    it = PyObject_GetIter(op);
+    if (it)
+    {
+        *out_iter = it;
+        return 0;
+    }
+
+    if (PyErr_ExceptionMatches(PyExc_TypeError))
+    {
+        PyErr_Clear(); // not iterable
+
+        if (!ctx->aiter || !PyObject_HasAttrString(op, "__aiter__"))
+        {
+            return 1;
+        }
+
+        it = PyObject_CallFunctionObjArgs(ctx->aiter, op, NULL);
+        if (!it)
+        {
+            ctx->aiter_failed = true;
+            return -1;
+        }
+
+        *out_iter = it;
+        return 0;
+    }
+
+    return -1; // unexpected error
+}
+/// @brief A block or for tag that a suspended render is part way through.
+typedef struct NT_RenderFrame
+{
+    const NT_Node *node; // A block, or a for tag if `loop` is true
+    NT_NodePage *page;   // The page holding a block's next child
+    Py_ssize_t index;    // The index of a block's next child on `page`
+    bool loop;           // Whether this frame is a for tag
+    bool rendered;       // Whether a for tag has rendered any items
+    NT_LoopCursor cursor;
+} NT_RenderFrame;
+
+struct NT_RenderStack
+{
+    NT_RenderFrame *frames;
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+};
+
+/// @brief Push a frame for block or for tag `node` onto `stack`.
+/// @return The new frame, or NULL on failure with an exception set.
+static NT_RenderFrame *render_stack_push(NT_RenderStack *stack,
+                                         const NT_Node *node, bool loop)
+{
+    if (stack->size == stack->capacity)
+    {
+        Py_ssize_t capacity = stack->capacity ? stack->capacity * 2 : 8;
+        NT_RenderFrame *frames = PyMem_Realloc(
+            stack->frames, sizeof(NT_RenderFrame) * (size_t)capacity);
+
+        if (!frames)
+        {
+            PyErr_NoMemory();
+            return NULL;
+        }
+
+        stack->frames = frames;
+        stack->capacity = capacity;
+    }
+
+    NT_RenderFrame *frame = &stack->frames[stack->size++];
+    frame->node = node;
+    frame->page = node->head;
+    frame->index = 0;
+    frame->loop = loop;
+    frame->rendered = false;
+    frame->cursor = (NT_LoopCursor){0};
+    return frame;
+}
+
+static void render_stack_pop(NT_RenderStack *stack)
+{
+    NT_RenderFrame *frame = &stack->frames[--stack->size];
+
+    if (frame->loop)
+    {
+        loop_cursor_clear(&frame->cursor);
+    }
+}
+
+/// @brief Start rendering `node`, the next child of the block at the top of
+/// `stack`. Blocks and loops are pushed onto the stack to be rendered a
+/// step at a time. Other nodes are rendered straight away.
+/// @return 0 on success, -1 on failure with an exception set.
+static int render_stack_enter(NT_RenderStack *stack, const NT_Node *node,
+                              NT_RenderContext *ctx, NT_StringBuffer *buf)
+{
+    if (node->kind == NODE_IF_TAG)
+    {
+        const NT_Node *block = NULL;
+
+        if (if_tag_branch(node, ctx, &block) < 0)
+        {
+            return -1;
+        }
+
+        if (block && !render_stack_push(stack, block, false))
+        {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (node->kind != NODE_FOR_TAG && node->kind != NODE_FOR_JOIN_TAG)
+    {
+        return NT_Node_render(node, ctx, buf);
+    }
+
+    NT_LoopCursor cursor = {0};
+    // Numeric loops are rendered an item at a time, like any other loop, so
+    // that rendering can pause between items.
+    int rc = for_tag_begin(node, ctx, buf, &cursor, false);
+
+    if (rc < 0)
+    {
+        return -1;
+    }
+
+    if (rc == 2)
+    {
+        NT_Node *orelse = for_tag_else(node);
+
+        if (orelse && !render_stack_push(stack, orelse, false))
+        {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (rc == 1)
+    {
+        return 0;
+    }
+
+    NT_RenderFrame *frame = render_stack_push(stack, node, true);
+    if (!frame)
+    {
+        loop_cursor_clear(&cursor);
+        return -1;
+    }
+
+    frame->cursor = cursor;
+    return 0;
+}
+
+/// @brief Advance the for tag at the top of `stack` by one item.
+/// @return 0 on success, -1 on failure with an exception set.
+static int render_stack_step_loop(NT_RenderStack *stack,
+                                  NT_RenderContext *ctx,
+                                  NT_StringBuffer *buf)
+{
+    NT_RenderFrame *frame = &stack->frames[stack->size - 1];
+    const NT_Node *node = frame->node;
+    int rc = for_tag_next(node, ctx, &frame->cursor);
+
+    if (rc < 0)
+    {
+        return -1;
+    }
+
+    if (rc == 0)
+    {
+        bool rendered = frame->rendered;
+        NT_Node *orelse = for_tag_else(node);
+        render_stack_pop(stack);
+
+        if (!rendered && orelse && !render_stack_push(stack, orelse, false))
+        {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    frame->rendered = true;
+
+    // Join blocks are only text and outputs, so they render in one step.
+    if (node->kind == NODE_FOR_JOIN_TAG)
+    {
+        return for_tag_render_item(node, ctx, buf);
+    }
+
+    return render_stack_push(stack, node->head->nodes[0], false) ? 0 : -1;
+}
+
+NT_RenderStack *NT_RenderStack_new(const NT_Node *root)
+{
+    NT_RenderStack *stack = PyMem_Malloc(sizeof(NT_RenderStack));
+    if (!stack)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    stack->frames = NULL;
+    stack->size = 0;
+    stack->capacity = 0;
+
+    if (!render_stack_push(stack, root, false))
+    {
+        NT_RenderStack_free(stack);
+        return NULL;
+    }
+
+    return stack;
+}
+
+void NT_RenderStack_free(NT_RenderStack *stack)
+{
+    if (!stack)
+    {
+        return;
+    }
+
+    while (stack->size)
+    {
+        render_stack_pop(stack);
+    }
+
+    PyMem_Free(stack->frames);
+    PyMem_Free(stack);
+}
+
+int NT_RenderStack_traverse(const NT_RenderStack *stack, visitproc visit,
+                            void *arg)
+{
+    for (Py_ssize_t i = 0; stack && i < stack->size; i++)
+    {
+        const NT_LoopCursor *cursor = &stack->frames[i].cursor;
+        Py_VISIT(cursor->obj);
+        Py_VISIT(cursor->it);
+        Py_VISIT(cursor->pair);
+    }
+
+    return 0;
+}
+
+int NT_RenderStack_resume(NT_RenderStack *stack, NT_RenderContext *ctx,
+                          NT_StringBuffer *buf, Py_ssize_t chunk_size)
+{
+    while (stack->size)
+    {
+        Py_ssize_t length = StringBuffer_length(buf);
+
+        if (length && length >= chunk_size)
+        {
+            return 1;
+        }
+
+        NT_RenderFrame *frame = &stack->frames[stack->size - 1];
+
+        if (frame->loop)
+        {
+            if (render_stack_step_loop(stack, ctx, buf) < 0)
+            {
+                return -1;
+            }
+
+            continue;
+        }
+
+        while (frame->page && frame->index >= frame->page->count)
+        {
+            frame->page = frame->page->next;
+            frame->index = 0;
+        }
+
+        if (!frame->page)
+        {
+            render_stack_pop(stack);
+            continue;
+        }
+
+        const NT_Node *node = frame->page->nodes[frame->index++];
+        ctx->aiter_failed = false;
+
+        if (render_stack_enter(stack, node, ctx, buf) < 0)
+        {
+            // Nothing has been rendered for a for tag whose iterable
+            // couldn't be consumed, so it can be entered again on resume.
+            if (ctx->aiter_failed && (node->kind == NODE_FOR_TAG ||
+                                      node->kind == NODE_FOR_JOIN_TAG))
+            {
+                stack->frames[stack->size - 1].index--;
+            }
+            else
+            {
+                ctx->aiter_failed = false;
+            }
+
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+PyObject *NT_Node_take_text_prefix(NT_Node *root)
+{
+    PyObject *parts = PyList_New(0);
+    if (!parts)
+    {
+        return NULL;
+    }
+
+    Py_ssize_t count = 0;
+
+    for (NT_NodePage *page = root->head; page; page = page->next)
+    {
+        for (Py_ssize_t i = 0; i < page->count; i++, count++)
+        {
+            NT_Node *child = page->nodes[i];
+
+            if (child->kind != NODE_TEXT)
+            {
+                goto done;
+            }
+
+            if (child->str && PyList_Append(parts, child->str) < 0)
+            {
+                Py_DECREF(parts);
+                return NULL;
+            }
+        }
+    }
+
+done:
+    if (count)
+    {
+        // Shift the remaining children to the front. Nodes are only ever
+        // moved to a position we've already read from.
+        NT_NodePage *dest = root->head;
+        Py_ssize_t index = 0;
+        Py_ssize_t skipped = 0;
+
+        for (NT_NodePage *page = root->head; page; page = page->next)
+        {
+            for (Py_ssize_t i = 0; i < page->count; i++)
+            {
+                if (skipped < count)
+                {
+                    skipped++;
+                    continue;
+                }
+
+                if (index == NT_CHILDREN_PER_PAGE)
+                {
+                    dest->count = index;
+                    dest = dest->next;
+                    index = 0;
+                }
+
+                dest->nodes[index++] = page->nodes[i];
+            }
+        }
+
+        dest->count = index;
+        dest->next = NULL;
+        root->tail = dest;
+    }
+
+    PyObject *sep = PyUnicode_FromStringAndSize(NULL, 0);
+    PyObject *prefix = sep ? PyUnicode_Join(sep, parts) : NULL;
+    Py_XDECREF(sep);
+    Py_DECREF(parts);
+    return prefix;
+}
+
+/// @brief Encode `str` to UTF-8, with the result owned by `mem`, setting
+/// `out` to a borrowed reference to the encoded bytes. Text that can't be
+/// encoded, like a lone surrogate, is left unencoded with `out` set to
+/// NULL, as it only fails to render as UTF-8.
+/// @return 0 on success, -1 on failure with an exception set.
+static int encode_text(NT_Mem *mem, PyObject *str, PyObject **out)
+{
+    *out = NULL;
+
+    PyObject *bytes = PyUnicode_AsUTF8String(str);
+    if (!bytes)
+    {
+        if (PyErr_ExceptionMatches(PyExc_UnicodeEncodeError))
+        {
+            PyErr_Clear();
+            return 0;
+        }
+        return -1;
+    }
+
+    if (NT_Mem_steal_ref(mem, bytes) < 0)
+    {
+        Py_DECREF(bytes);
+        return -1;
+    }
+
+    *out = bytes;
+    return 0;
+}
+
+int NT_Node_encode_text(NT_Mem *mem, NT_Node *root)
+{
+    for (NT_NodePage *page = root->head; page; page = page->next)
+    {
+        for (Py_ssize_t i = 0; i < page->count; i++)
+        {
+            if (NT_Node_encode_text(mem, page->nodes[i]) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    // Other node kinds use `str` and `str2` for the names of loop
+    // variables.
+    if (root->kind != NODE_TEXT && root->kind != NODE_TEXT_OUTPUT &&
+        root->kind != NODE_OUTPUT_DEFAULT)
+    {
+        return 0;
+    }
+
+    if (root->str && encode_text(mem, root->str, &root->bytes) < 0)
+    {
+        return -1;
+    }
+
+    if (root->str2 && encode_text(mem, root->str2, &root->bytes2) < 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
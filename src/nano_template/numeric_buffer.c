@@ -0,0 +1,305 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/numeric_buffer.h"
+#include "nano_template/py_json.h"
+
+/// @brief Return the size of native `struct` format character `format`, or
+/// 0 if we don't format items of that type.
+static Py_ssize_t format_size(char format)
+{
+    switch (format)
+    {
+    case 'b':
+    case 'B':
+        return sizeof(char);
+    case 'h':
+    case 'H':
+        return sizeof(short);
+    case 'i':
+    case 'I':
+        return sizeof(int);
+    case 'l':
+    case 'L':
+        return sizeof(long);
+    case 'q':
+    case 'Q':
+        return sizeof(long long);
+    case 'n':
+    case 'N':
+        return sizeof(size_t);
+    case '?':
+        return sizeof(bool);
+    case 'd':
+        return sizeof(double);
+    default:
+        // Single precision floats are left to the exporter, as numpy and
+        // array.array disagree on how they should be formatted.
+        return 0;
+    }
+}
+
+/// @brief Get integer attribute `name` from `obj`.
+/// @return The attribute's value, or -1 on error with an exception set.
+static Py_ssize_t get_size_attr(PyObject *obj, const char *name)
+{
+    PyObject *attr = PyObject_GetAttrString(obj, name);
+    if (!attr)
+    {
+        return -1;
+    }
+
+    Py_ssize_t value = PyLong_AsSsize_t(attr);
+    Py_DECREF(attr);
+    return value;
+}
+
+/// @brief Get the format character from memoryview `view`.
+/// @return The format character, 0 if the format is not a single native
+/// type, or -1 on error with an exception set.
+static int get_format(PyObject *view)
+{
+    PyObject *format = NULL;
+    PyObject *encoded = NULL;
+    int rv = -1;
+
+    format = PyObject_GetAttrString(view, "format");
+    if (!format)
+    {
+        goto cleanup;
+    }
+
+    encoded = PyUnicode_AsUTF8String(format);
+    if (!encoded)
+    {
+        goto cleanup;
+    }
+
+    const char *s = PyBytes_AsString(encoded);
+    if (!s)
+    {
+        goto cleanup;
+    }
+
+    // '@' is native byte order, size and alignment, same as no prefix.
+    if (*s == '@')
+    {
+        s++;
+    }
+
+    rv = (s[0] && !s[1]) ? s[0] : 0;
+
+cleanup:
+    Py_XDECREF(format);
+    Py_XDECREF(encoded);
+    return rv;
+}
+
+/// @brief Check if `op` might export a buffer, without raising an exception
+/// for objects that don't.
+static bool may_export_buffer(PyObject *op)
+{
+#ifndef Py_LIMITED_API
+    return PyObject_CheckBuffer(op);
+#else
+    // PyObject_CheckBuffer isn't in the limited API before 3.11, so rule out
+    // common iterables that never export buffers.
+    return !(PyUnicode_Check(op) || PyList_CheckExact(op) ||
+             PyTuple_CheckExact(op) || PyDict_CheckExact(op) ||
+             PyAnySet_Check(op) || Py_TYPE(op) == &PyRange_Type ||
+             PyIter_Check(op) || NTPY_JSONView_Check(op));
+#endif
+}
+
+int NT_NumericBuffer_init(NT_NumericBuffer *nb, PyObject *op)
+{
+    PyObject *view = NULL;
+    int rv = -1;
+
+    nb->bytes = NULL;
+    nb->data = NULL;
+    nb->size = 0;
+    nb->itemsize = 0;
+    nb->format = 0;
+
+    if (!may_export_buffer(op))
+    {
+        return 1;
+    }
+
+    view = PyMemoryView_FromObject(op);
+    if (!view)
+    {
+        if (PyErr_ExceptionMatches(PyExc_TypeError))
+        {
+            PyErr_Clear();
+            return 1;
+        }
+        return -1;
+    }
+
+    Py_ssize_t ndim = get_size_attr(view, "ndim");
+    if (ndim == -1 && PyErr_Occurred())
+    {
+        goto cleanup;
+    }
+
+    int format = get_format(view);
+    if (format < 0)
+    {
+        goto cleanup;
+    }
+
+    Py_ssize_t itemsize = get_size_attr(view, "itemsize");
+    if (itemsize == -1 && PyErr_Occurred())
+    {
+        goto cleanup;
+    }
+
+    if (ndim != 1 || itemsize != format_size((char)format) || !itemsize)
+    {
+        rv = 1;
+        goto cleanup;
+    }
+
+    // The copy is laid out contiguously, whatever the exporter's strides.
+    nb->bytes = PyObject_CallMethod(view, "tobytes", NULL);
+    if (!nb->bytes)
+    {
+        goto cleanup;
+    }
+
+    nb->data = PyBytes_AsString(nb->bytes);
+    if (!nb->data)
+    {
+        goto cleanup;
+    }
+
+    nb->itemsize = itemsize;
+    nb->size = PyBytes_Size(nb->bytes) / itemsize;
+    nb->format = (char)format;
+    rv = 0;
+
+cleanup:
+    if (rv != 0)
+    {
+        Py_CLEAR(nb->bytes);
+    }
+
+    Py_XDECREF(view);
+    return rv;
+}
+
+void NT_NumericBuffer_clear(NT_NumericBuffer *nb)
+{
+    Py_CLEAR(nb->bytes);
+    nb->data = NULL;
+    nb->size = 0;
+}
+
+/// @brief Read a value of type `type` from possibly unaligned memory `p`.
+#define READ_ITEM(type, p, out)                                               \
+    do                                                                        \
+    {                                                                         \
+        type v_;                                                              \
+        memcpy(&v_, (p), sizeof(type));                                       \
+        (out) = v_;                                                           \
+    } while (0)
+
+Py_ssize_t NT_NumericBuffer_format(const NT_NumericBuffer *nb,
+                                   Py_ssize_t index, char *out)
+{
+    const char *p = nb->data + index * nb->itemsize;
+    long long signed_value = 0;
+    unsigned long long unsigned_value = 0;
+    bool is_signed = true;
+
+    switch (nb->format)
+    {
+    case 'b':
+        READ_ITEM(signed char, p, signed_value);
+        break;
+    case 'B':
+        READ_ITEM(unsigned char, p, signed_value);
+        break;
+    case 'h':
+        READ_ITEM(short, p, signed_value);
+        break;
+    case 'H':
+        READ_ITEM(unsigned short, p, signed_value);
+        break;
+    case 'i':
+        READ_ITEM(int, p, signed_value);
+        break;
+    case 'I':
+        READ_ITEM(unsigned int, p, signed_value);
+        break;
+    case 'l':
+        READ_ITEM(long, p, signed_value);
+        break;
+    case 'L':
+        READ_ITEM(unsigned long, p, unsigned_value);
+        is_signed = false;
+        break;
+    case 'q':
+        READ_ITEM(long long, p, signed_value);
+        break;
+    case 'Q':
+        READ_ITEM(unsigned long long, p, unsigned_value);
+        is_signed = false;
+        break;
+    case 'n':
+        READ_ITEM(Py_ssize_t, p, signed_value);
+        break;
+    case 'N':
+        READ_ITEM(size_t, p, unsigned_value);
+        is_signed = false;
+        break;
+    case '?':
+    {
+        bool value = false;
+        READ_ITEM(bool, p, value);
+        const char *s = value ? "True" : "False";
+        Py_ssize_t length = (Py_ssize_t)strlen(s);
+        memcpy(out, s, (size_t)length);
+        return length;
+    }
+    case 'd':
+    {
+        double value = 0;
+        READ_ITEM(double, p, value);
+
+        // The same shortest round-trip repr as Python's float.__str__.
+        char *s = PyOS_double_to_string(value, 'r', 0, Py_DTSF_ADD_DOT_0,
+                                        NULL);
+        if (!s)
+        {
+            return -1;
+        }
+
+        Py_ssize_t length = (Py_ssize_t)strlen(s);
+        if (length > NT_NUMBER_MAX)
+        {
+            length = NT_NUMBER_MAX;
+        }
+
+        memcpy(out, s, (size_t)length);
+        PyMem_Free(s);
+        return length;
+    }
+    default:
+        PyErr_SetString(PyExc_ValueError, "unsupported buffer format");
+        return -1;
+    }
+
+    int length = is_signed
+                     ? snprintf(out, NT_NUMBER_MAX, "%lld", signed_value)
+                     : snprintf(out, NT_NUMBER_MAX, "%llu", unsigned_value);
+
+    if (length < 0)
+    {
+        PyErr_SetString(PyExc_SystemError, "failed to format number");
+        return -1;
+    }
+
+    return (Py_ssize_t)length;
+}
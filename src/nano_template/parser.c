@@ -51,6 +51,22 @@ static NT_Expr *NT_Parser_make_expr(NT_Parser *p, NT_ExprKind kind,
 /// @return 0 on success, -1 on failure.
 static int NT_Parser_add_obj(NT_Parser *p, NT_Expr *expr, PyObject *obj);
 
+/// @brief Assign variable expression `expr` a memo slot, shared with any
+/// other variable expression that has the same path, and a loop binding if
+/// its root is an enclosing loop variable.
+/// @return 0 on success, -1 on failure.
+static int NT_Parser_intern_path(NT_Parser *p, NT_Expr *expr);
+
+/// @brief Return true if for block `block` contains nothing but text and
+/// output statements of `tag`'s loop variable, like
+/// `{% for x in xs %}<li>{{ x }}</li>{% endfor %}`.
+static bool NT_Parser_is_join_block(const NT_Node *tag, const NT_Node *block);
+
+/// @brief Find the innermost enclosing loop variable called `name`.
+/// @return The loop variable's binding index, -1 if `name` is not a loop
+/// variable, or -2 on failure with an exception set.
+static Py_ssize_t NT_Parser_find_binding(NT_Parser *p, PyObject *name);
+
 /// Return the precedence for the given token kind.
 static inline Precedence precedence(NT_TokenKind kind);
 
@@ -149,6 +165,21 @@ NT_Parser *NT_Parser_new(NT_Mem *mem, PyObject *str, NT_Token *tokens,
     parser->token_count = token_count;
     parser->pos = 0;
     parser->whitespace_carry = TOK_WC_NONE;
+
+    parser->paths = PyDict_New();
+    parser->root_paths = PyDict_New();
+    parser->loop_vars = PyList_New(0);
+    parser->binding_count = 0;
+    if (!parser->paths || !parser->root_paths || !parser->loop_vars)
+    {
+        Py_DECREF(str);
+        Py_XDECREF(parser->paths);
+        Py_XDECREF(parser->root_paths);
+        Py_XDECREF(parser->loop_vars);
+        PyMem_Free(parser);
+        return NULL;
+    }
+
     return parser;
 }
 
@@ -161,6 +192,9 @@ void NT_Parser_free(NT_Parser *p)
     }
 
     Py_XDECREF(p->str);
+    Py_XDECREF(p->paths);
+    Py_XDECREF(p->root_paths);
+    Py_XDECREF(p->loop_vars);
     PyMem_Free(p);
 }
 
@@ -177,6 +211,10 @@ static NT_Node *NT_Parser_make_node(NT_Parser *p, NT_NodeKind kind)
     node->head = NULL;
     node->tail = NULL;
     node->str = NULL;
+    node->str2 = NULL;
+    node->bytes = NULL;
+    node->bytes2 = NULL;
+    node->binding = -1;
     return node;
 }
 
@@ -230,6 +268,9 @@ static NT_Expr *NT_Parser_make_expr(NT_Parser *p, NT_ExprKind kind,
     expr->tail = NULL;
     expr->left = NULL;
     expr->right = NULL;
+    expr->slot = -1;
+    expr->path = NULL;
+    expr->binding = -1;
     return expr;
 }
 
@@ -779,6 +820,22 @@ static NT_Node *NT_Parser_parse_for_tag(NT_Parser *p)
     NT_Mem_steal_ref(p->mem, ident);
     ident = NULL;
 
+    // Optional second loop variable, for destructuring (key, value) pairs.
+    if (NT_Parser_current(p)->kind == TOK_COMMA)
+    {
+        NT_Parser_next(p);
+
+        ident = NT_Parser_parse_identifier(p);
+        if (!ident)
+        {
+            goto fail;
+        }
+
+        tag->str2 = ident;
+        NT_Mem_steal_ref(p->mem, ident);
+        ident = NULL;
+    }
+
     if (!NT_Parser_eat(p, TOK_IN))
     {
         goto fail;
@@ -811,11 +868,38 @@ static NT_Node *NT_Parser_parse_for_tag(NT_Parser *p)
         goto fail;
     }
 
-    if (NT_Parser_parse(p, node, END_FOR_MASK) < 0)
+    // Loop variables are only bound while rendering the for block, not the
+    // else block.
+    Py_ssize_t loop_var_count = tag->str2 ? 2 : 1;
+    tag->binding = PyList_Size(p->loop_vars);
+
+    if (tag->binding + loop_var_count > p->binding_count)
+    {
+        p->binding_count = tag->binding + loop_var_count;
+    }
+
+    if (PyList_Append(p->loop_vars, tag->str) < 0 ||
+        (tag->str2 && PyList_Append(p->loop_vars, tag->str2) < 0))
+    {
+        goto fail;
+    }
+
+    int rc = NT_Parser_parse(p, node, END_FOR_MASK);
+    Py_ssize_t loop_vars_size = PyList_Size(p->loop_vars);
+
+    if (PyList_SetSlice(p->loop_vars, loop_vars_size - loop_var_count,
+                        loop_vars_size, NULL) < 0 ||
+        rc < 0)
     {
         goto fail;
     }
 
+    // Simple loops are rendered without evaluating their block's nodes.
+    if (NT_Parser_is_join_block(tag, node))
+    {
+        tag->kind = NODE_FOR_JOIN_TAG;
+    }
+
     if (NT_Parser_add_node(p, tag, node) < 0)
     {
         goto fail;
@@ -990,6 +1074,11 @@ static NT_Expr *NT_Parser_parse_group(NT_Parser *p)
 static PyObject *NT_Parser_parse_identifier(NT_Parser *p)
 {
     NT_Token *token = NT_Parser_eat(p, TOK_WORD);
+    if (!token)
+    {
+        return NULL;
+    }
+
     if (NT_Token_member(NT_Parser_current(p)->kind, PATH_PUNCTUATION_MASK))
     {
         return nt_parser_error(token, "expected an identifier, found a path");
@@ -1010,7 +1099,7 @@ static NT_Expr *NT_Parser_parse_not(NT_Parser *p)
         return NULL;
     }
 
-    NT_Expr *expr = NT_Parser_parse_primary(p, PREC_LOWEST);
+    NT_Expr *expr = NT_Parser_parse_primary(p, PREC_PRE);
     if (!expr)
     {
         return NULL;
@@ -1086,6 +1175,9 @@ static NT_Expr *NT_Parser_parse_path(NT_Parser *p)
             goto cleanup;
         }
 
+        // Interned segments compare by identity with prepared data keys.
+        PyUnicode_InternInPlace(&str);
+
         if (NT_Parser_add_obj(p, expr, str) == -1)
         {
             Py_DECREF(str);
@@ -1107,7 +1199,10 @@ static NT_Expr *NT_Parser_parse_path(NT_Parser *p)
             break;
         default:
             p->pos--;
-            result = expr;
+            if (NT_Parser_intern_path(p, expr) == 0)
+            {
+                result = expr;
+            }
             goto cleanup;
         }
 
@@ -1116,10 +1211,17 @@ static NT_Expr *NT_Parser_parse_path(NT_Parser *p)
             goto cleanup;
         }
 
+        if (PyUnicode_CheckExact(obj))
+        {
+            PyUnicode_InternInPlace(&obj);
+        }
+
         if (NT_Parser_add_obj(p, expr, obj) == -1)
         {
             goto cleanup;
         }
+
+        Py_CLEAR(obj);
     }
 
 cleanup:
@@ -1127,6 +1229,141 @@ cleanup:
     return result;
 }
 
+static int NT_Parser_intern_path(NT_Parser *p, NT_Expr *expr)
+{
+    PyObject *path = NULL;
+    PyObject *slot = NULL;
+    Py_ssize_t size = 0;
+    int rv = -1;
+
+    if (!expr->head || expr->head->count == 0)
+    {
+        return 0;
+    }
+
+    expr->binding = NT_Parser_find_binding(p, expr->head->objs[0]);
+    if (expr->binding == -2)
+    {
+        return -1;
+    }
+
+    for (NT_ObjPage *page = expr->head; page; page = page->next)
+    {
+        size += (Py_ssize_t)page->count;
+    }
+
+    path = PyTuple_New(size);
+    if (!path)
+    {
+        goto cleanup;
+    }
+
+    Py_ssize_t pos = 0;
+    for (NT_ObjPage *page = expr->head; page; page = page->next)
+    {
+        for (size_t i = 0; i < page->count; i++)
+        {
+            PyTuple_SetItem(path, pos++, Py_NewRef(page->objs[i]));
+        }
+    }
+
+    if (NT_Mem_ref(p->mem, path) < 0)
+    {
+        goto cleanup;
+    }
+
+    expr->path = path;
+
+    if (expr->binding == -1 &&
+        PyDict_SetItem(p->root_paths, path, Py_None) < 0)
+    {
+        goto cleanup;
+    }
+
+    slot = PyDict_GetItemWithError(p->paths, path);
+    if (slot)
+    {
+        expr->slot = PyLong_AsSsize_t(slot);
+        rv = 0;
+        goto cleanup;
+    }
+
+    if (PyErr_Occurred())
+    {
+        goto cleanup;
+    }
+
+    slot = PyLong_FromSsize_t(PyDict_Size(p->paths));
+    if (!slot)
+    {
+        goto cleanup;
+    }
+
+    rv = PyDict_SetItem(p->paths, path, slot);
+    if (rv == 0)
+    {
+        expr->slot = PyLong_AsSsize_t(slot);
+    }
+
+    Py_DECREF(slot);
+
+cleanup:
+    Py_XDECREF(path);
+    return rv;
+}
+
+static bool NT_Parser_is_join_block(const NT_Node *tag, const NT_Node *block)
+{
+    if (tag->str2)
+    {
+        return false;
+    }
+
+    for (NT_NodePage *page = block->head; page; page = page->next)
+    {
+        for (Py_ssize_t i = 0; i < page->count; i++)
+        {
+            NT_Node *child = page->nodes[i];
+
+            if (child->kind == NODE_TEXT)
+            {
+                continue;
+            }
+
+            NT_Expr *expr = child->expr;
+
+            if (child->kind != NODE_OUPUT || !expr ||
+                expr->kind != EXPR_VAR || expr->binding != tag->binding ||
+                !expr->head || expr->head->count != 1 || expr->head->next)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static Py_ssize_t NT_Parser_find_binding(NT_Parser *p, PyObject *name)
+{
+    for (Py_ssize_t i = PyList_Size(p->loop_vars) - 1; i >= 0; i--)
+    {
+        int eq = PyObject_RichCompareBool(PyList_GetItem(p->loop_vars, i),
+                                          name, Py_EQ);
+        if (eq < 0)
+        {
+            return -2;
+        }
+
+        if (eq)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 static PyObject *NT_Parser_parse_bracketed_path_segment(NT_Parser *p)
 {
     PyObject *segment = NULL;
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/peephole.h"
+
+/// @brief Optimize `node`'s children, and their children.
+static int optimize_node(NT_Mem *mem, NT_Node *node);
+
+/// @brief Rebuild the list of statements in block `node`, fusing adjacent
+/// text and output nodes.
+static int fuse_statements(NT_Mem *mem, NT_Node *node);
+
+/// @brief Rewrite `node` in place if it is an if tag or output statement
+/// with a fused equivalent.
+static void fuse_node(NT_Node *node);
+
+/// @brief Append `child` to the list of pages from `*head` to `*tail`.
+/// @return 0 on success, -1 on failure.
+static int append_node(NT_Mem *mem, NT_NodePage **head, NT_NodePage **tail,
+                       NT_Node *child);
+
+/// @brief Return true if `expr` is a variable expression.
+static inline bool is_var(const NT_Expr *expr)
+{
+    return expr && expr->kind == EXPR_VAR && expr->slot >= 0;
+}
+
+/// @brief Return true if `node` holds a list of statements.
+static inline bool is_block(const NT_Node *node)
+{
+    switch (node->kind)
+    {
+    case NODE_ROOT:
+    case NODE_IF_BLOCK:
+    case NODE_ELIF_BLOCK:
+    case NODE_ELSE_BLOCK:
+    case NODE_FOR_BLOCK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int NT_Peephole_optimize(NT_Mem *mem, NT_Node *root)
+{
+    if (!root)
+    {
+        return 0;
+    }
+
+    return optimize_node(mem, root);
+}
+
+static int optimize_node(NT_Mem *mem, NT_Node *node)
+{
+    // The block of a join tag is rendered without dispatching on its
+    // children, which must stay plain text and output nodes. Its else block
+    // is rendered as usual.
+    bool skip_first = node->kind == NODE_FOR_JOIN_TAG;
+
+    for (NT_NodePage *page = node->head; page; page = page->next)
+    {
+        for (Py_ssize_t i = 0; i < page->count; i++)
+        {
+            if (skip_first)
+            {
+                skip_first = false;
+                continue;
+            }
+
+            if (optimize_node(mem, page->nodes[i]) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    if (is_block(node))
+    {
+        return fuse_statements(mem, node);
+    }
+
+    return 0;
+}
+
+static int fuse_statements(NT_Mem *mem, NT_Node *node)
+{
+    NT_NodePage *head = NULL;
+    NT_NodePage *tail = NULL;
+    NT_Node *text = NULL; // Text waiting to see if an output follows.
+    NT_Node *fused = NULL;
+
+    for (NT_NodePage *page = node->head; page; page = page->next)
+    {
+        for (Py_ssize_t i = 0; i < page->count; i++)
+        {
+            NT_Node *child = page->nodes[i];
+
+            // Text following a fused output is that output's trailing text.
+            if (child->kind == NODE_TEXT && fused && !fused->str2)
+            {
+                fused->str2 = child->str;
+                fused = NULL;
+                continue;
+            }
+
+            fused = NULL;
+
+            // `{{ x or "literal" }}` saves more as NODE_OUTPUT_DEFAULT than
+            // it would fused with surrounding text.
+            fuse_node(child);
+
+            if (child->kind == NODE_TEXT)
+            {
+                if (text && append_node(mem, &head, &tail, text) < 0)
+                {
+                    return -1;
+                }
+
+                text = child;
+                continue;
+            }
+
+            if (child->kind == NODE_OUPUT)
+            {
+                fused = NT_Mem_alloc(mem, sizeof(NT_Node));
+                if (!fused)
+                {
+                    return -1;
+                }
+
+                *fused = *child;
+                fused->kind = NODE_TEXT_OUTPUT;
+                fused->str = text ? text->str : NULL;
+                fused->str2 = NULL;
+                text = NULL;
+
+                if (append_node(mem, &head, &tail, fused) < 0)
+                {
+                    return -1;
+                }
+
+                continue;
+            }
+
+            if (text && append_node(mem, &head, &tail, text) < 0)
+            {
+                return -1;
+            }
+
+            text = NULL;
+
+            if (append_node(mem, &head, &tail, child) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    if (text && append_node(mem, &head, &tail, text) < 0)
+    {
+        return -1;
+    }
+
+    node->head = head;
+    node->tail = tail;
+    return 0;
+}
+
+static void fuse_node(NT_Node *node)
+{
+    if (node->kind == NODE_OUPUT)
+    {
+        NT_Expr *expr = node->expr;
+
+        if (expr && expr->kind == EXPR_OR && is_var(expr->left) &&
+            expr->right && expr->right->kind == EXPR_STR &&
+            expr->right->head && expr->right->head->count == 1)
+        {
+            node->kind = NODE_OUTPUT_DEFAULT;
+            node->str = expr->right->head->objs[0];
+            node->expr = expr->left;
+        }
+
+        return;
+    }
+
+    if (node->kind != NODE_IF_TAG)
+    {
+        return;
+    }
+
+    // A single if block, without elif or else, with a single output of the
+    // same variable it tests.
+    NT_NodePage *page = node->head;
+    if (!page || page->count != 1 || page->next)
+    {
+        return;
+    }
+
+    NT_Node *block = page->nodes[0];
+    if (block->kind != NODE_IF_BLOCK || !is_var(block->expr))
+    {
+        return;
+    }
+
+    page = block->head;
+    if (!page || page->count != 1 || page->next)
+    {
+        return;
+    }
+
+    NT_Node *output = page->nodes[0];
+    if (output->kind != NODE_OUPUT || !is_var(output->expr))
+    {
+        return;
+    }
+
+    // Identical paths share a memo slot, but a path rooted at a loop
+    // variable is not the same as one rooted at render data.
+    if (output->expr->slot != block->expr->slot ||
+        output->expr->binding != block->expr->binding)
+    {
+        return;
+    }
+
+    node->kind = NODE_IF_OUTPUT;
+    node->expr = block->expr;
+}
+
+static int append_node(NT_Mem *mem, NT_NodePage **head, NT_NodePage **tail,
+                       NT_Node *child)
+{
+    if (!*tail || (*tail)->count == NT_CHILDREN_PER_PAGE)
+    {
+        NT_NodePage *page = NT_Mem_alloc(mem, sizeof(NT_NodePage));
+        if (!page)
+        {
+            return -1;
+        }
+
+        page->next = NULL;
+        page->count = 0;
+
+        if (*tail)
+        {
+            (*tail)->next = page;
+        }
+        else
+        {
+            *head = page;
+        }
+
+        *tail = page;
+    }
+
+    (*tail)->nodes[(*tail)->count++] = child;
+    return 0;
+}
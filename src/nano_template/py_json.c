@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/py_json.h"
+
+static PyTypeObject *JSONView_TypeObject = NULL;
+
+static const char *TAPE_CAPSULE_NAME = "nano_template.json_tape";
+
+static void tape_capsule_destructor(PyObject *capsule)
+{
+    NT_JsonTape_free(PyCapsule_GetPointer(capsule, TAPE_CAPSULE_NAME));
+}
+
+/// @brief Wrap the object or array at `index` on the tape owned by `doc`.
+/// @return A new reference, or NULL on error with an exception set.
+static PyObject *JSONView_new(PyObject *doc, NT_JsonTape *tape,
+                              Py_ssize_t index)
+{
+    PyObject *obj = PyType_GenericNew(JSONView_TypeObject, NULL, NULL);
+    if (!obj)
+    {
+        return NULL;
+    }
+
+    NTPY_JSONViewObject *op = (NTPY_JSONViewObject *)obj;
+    op->doc = Py_NewRef(doc);
+    op->tape = tape;
+    op->index = index;
+    return obj;
+}
+
+/// @brief Return a view of the container at `index`, or a Python object for
+/// the scalar at `index`.
+static PyObject *JSONView_child(NTPY_JSONViewObject *op, Py_ssize_t index)
+{
+    NT_JsonKind kind = op->tape->entries[index].kind;
+
+    if (kind == JSON_OBJECT || kind == JSON_ARRAY)
+    {
+        return JSONView_new(op->doc, op->tape, index);
+    }
+
+    return NT_JsonTape_scalar(op->tape, index);
+}
+
+static inline NT_JsonEntry *JSONView_entry(NTPY_JSONViewObject *op)
+{
+    return &op->tape->entries[op->index];
+}
+
+PyObject *NTPY_JSONView_parse(PyObject *buf)
+{
+    PyObject *bytes = NULL;
+    PyObject *doc = NULL;
+    PyObject *view = NULL;
+
+    if (!JSONView_TypeObject)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "JSONView type not initialized");
+        return NULL;
+    }
+
+    if (PyBytes_CheckExact(buf))
+    {
+        bytes = Py_NewRef(buf);
+    }
+    else if (PyUnicode_Check(buf))
+    {
+        bytes = PyUnicode_AsUTF8String(buf);
+    }
+    else if (PyByteArray_Check(buf))
+    {
+        bytes = PyBytes_FromObject(buf);
+    }
+    else
+    {
+        PyErr_SetString(PyExc_TypeError,
+                        "expected JSON as str, bytes or bytearray");
+        return NULL;
+    }
+
+    if (!bytes)
+    {
+        return NULL;
+    }
+
+    NT_JsonTape *tape = NT_JsonTape_new(bytes);
+    Py_DECREF(bytes);
+
+    if (!tape)
+    {
+        return NULL;
+    }
+
+    if (tape->entries[0].kind != JSON_OBJECT)
+    {
+        NT_JsonTape_free(tape);
+        PyErr_SetString(PyExc_ValueError,
+                        "expected a JSON object at the top level");
+        return NULL;
+    }
+
+    doc = PyCapsule_New(tape, TAPE_CAPSULE_NAME, tape_capsule_destructor);
+    if (!doc)
+    {
+        NT_JsonTape_free(tape);
+        return NULL;
+    }
+
+    view = JSONView_new(doc, tape, 0);
+    Py_DECREF(doc);
+    return view;
+}
+
+bool NTPY_JSONView_Check(PyObject *op)
+{
+    return JSONView_TypeObject && Py_TYPE(op) == JSONView_TypeObject;
+}
+
+PyObject *NTPY_JSONView_materialize(PyObject *op)
+{
+    if (NTPY_JSONView_Check(op))
+    {
+        NTPY_JSONViewObject *view = (NTPY_JSONViewObject *)op;
+        return NT_JsonTape_materialize(view->tape, view->index);
+    }
+
+    // Items from looping over a JSON object are (key, view) tuples.
+    if (!PyTuple_CheckExact(op))
+    {
+        return Py_NewRef(op);
+    }
+
+    Py_ssize_t size = PyTuple_Size(op);
+    bool has_views = false;
+
+    for (Py_ssize_t i = 0; i < size; i++)
+    {
+        if (NTPY_JSONView_Check(PyTuple_GetItem(op, i)))
+        {
+            has_views = true;
+            break;
+        }
+    }
+
+    if (!has_views)
+    {
+        return Py_NewRef(op);
+    }
+
+    PyObject *result = PyTuple_New(size);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    for (Py_ssize_t i = 0; i < size; i++)
+    {
+        PyObject *item = NTPY_JSONView_materialize(PyTuple_GetItem(op, i));
+        if (!item)
+        {
+            Py_DECREF(result);
+            return NULL;
+        }
+
+        PyTuple_SetItem(result, i, item);
+    }
+
+    return result;
+}
+
+static PyObject *JSONView_subscript(PyObject *self, PyObject *key)
+{
+    NTPY_JSONViewObject *op = (NTPY_JSONViewObject *)self;
+    NT_JsonEntry *entry = JSONView_entry(op);
+    Py_ssize_t index = -1;
+
+    if (entry->kind == JSON_OBJECT)
+    {
+        if (PyUnicode_Check(key))
+        {
+            index = NT_JsonTape_find(op->tape, op->index, key);
+            if (index == -2)
+            {
+                return NULL;
+            }
+        }
+
+        if (index < 0)
+        {
+            PyErr_SetObject(PyExc_KeyError, key);
+            return NULL;
+        }
+
+        return JSONView_child(op, index);
+    }
+
+    if (!PyLong_Check(key))
+    {
+        PyErr_SetString(PyExc_TypeError,
+                        "JSON array indices must be integers");
+        return NULL;
+    }
+
+    Py_ssize_t n = PyLong_AsSsize_t(key);
+    if (n == -1 && PyErr_Occurred())
+    {
+        return NULL;
+    }
+
+    if (n < 0)
+    {
+        n += entry->count;
+    }
+
+    index = NT_JsonTape_item(op->tape, op->index, n);
+    if (index < 0)
+    {
+        PyErr_SetString(PyExc_IndexError, "JSON array index out of range");
+        return NULL;
+    }
+
+    return JSONView_child(op, index);
+}
+
+static Py_ssize_t JSONView_length(PyObject *self)
+{
+    return JSONView_entry((NTPY_JSONViewObject *)self)->count;
+}
+
+/// @brief Build a list of an array's items, or of an object's keys or
+/// (key, value) pairs.
+static PyObject *JSONView_list(NTPY_JSONViewObject *op, bool with_values)
+{
+    NT_JsonEntry *entry = JSONView_entry(op);
+    bool is_object = entry->kind == JSON_OBJECT;
+    PyObject *list = PyList_New(entry->count);
+
+    if (!list)
+    {
+        return NULL;
+    }
+
+    NT_JsonEntry *entries = op->tape->entries;
+    Py_ssize_t i = op->index + 1;
+
+    for (Py_ssize_t n = 0; n < entry->count; n++)
+    {
+        PyObject *item = NULL;
+
+        if (!is_object)
+        {
+            item = JSONView_child(op, i);
+            i = entries[i].next;
+        }
+        else if (!with_values)
+        {
+            item = NT_JsonTape_scalar(op->tape, i);
+            i = entries[i + 1].next;
+        }
+        else
+        {
+            PyObject *key = NT_JsonTape_scalar(op->tape, i);
+            PyObject *value = key ? JSONView_child(op, i + 1) : NULL;
+
+            if (value)
+            {
+                item = PyTuple_Pack(2, key, value);
+            }
+
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            i = entries[i + 1].next;
+        }
+
+        if (!item)
+        {
+            Py_DECREF(list);
+            return NULL;
+        }
+
+        PyList_SetItem(list, n, item);
+    }
+
+    return list;
+}
+
+static PyObject *JSONView_iter(PyObject *self)
+{
+    PyObject *list = JSONView_list((NTPY_JSONViewObject *)self, false);
+    if (!list)
+    {
+        return NULL;
+    }
+
+    PyObject *it = PyObject_GetIter(list);
+    Py_DECREF(list);
+    return it;
+}
+
+static PyObject *JSONView_items(PyObject *self, PyObject *Py_UNUSED(args))
+{
+    NTPY_JSONViewObject *op = (NTPY_JSONViewObject *)self;
+
+    if (JSONView_entry(op)->kind != JSON_OBJECT)
+    {
+        PyErr_SetString(PyExc_AttributeError,
+                        "JSON array has no attribute 'items'");
+        return NULL;
+    }
+
+    return JSONView_list(op, true);
+}
+
+static PyObject *JSONView_repr(PyObject *self)
+{
+    NTPY_JSONViewObject *op = (NTPY_JSONViewObject *)self;
+    PyObject *value = NT_JsonTape_materialize(op->tape, op->index);
+    if (!value)
+    {
+        return NULL;
+    }
+
+    PyObject *repr = PyUnicode_FromFormat("<JSONView %R>", value);
+    Py_DECREF(value);
+    return repr;
+}
+
+static PyObject *JSONView_new_instance(PyTypeObject *Py_UNUSED(type),
+                                       PyObject *Py_UNUSED(args),
+                                       PyObject *Py_UNUSED(kwds))
+{
+    PyErr_SetString(PyExc_TypeError,
+                    "JSONView objects are created by Template.render_json()");
+    return NULL;
+}
+
+static void JSONView_dealloc(PyObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    NTPY_JSONViewObject *op = (NTPY_JSONViewObject *)self;
+    Py_CLEAR(op->doc);
+    freefunc tp_free = (freefunc)PyType_GetSlot(tp, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(tp);
+}
+
+static PyMethodDef JSONView_methods[] = {
+    {"items", JSONView_items, METH_NOARGS,
+     "Return a list of (key, value) pairs"},
+    {NULL, NULL, 0, NULL}};
+
+static PyType_Slot JSONView_slots[] = {
+    {Py_tp_doc, "Read-only view of an object or array in a JSON document"},
+    {Py_tp_new, (void *)JSONView_new_instance},
+    {Py_tp_dealloc, (void *)JSONView_dealloc},
+    {Py_tp_iter, (void *)JSONView_iter},
+    {Py_tp_repr, (void *)JSONView_repr},
+    {Py_tp_methods, JSONView_methods},
+    {Py_mp_subscript, (void *)JSONView_subscript},
+    {Py_mp_length, (void *)JSONView_length},
+    {0, NULL}};
+
+static PyType_Spec JSONView_spec = {
+    .name = "nano_template.JSONView",
+    .basicsize = sizeof(NTPY_JSONViewObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = JSONView_slots,
+};
+
+int nt_register_json_view_type(PyObject *module)
+{
+    PyObject *type_obj = PyType_FromSpec(&JSONView_spec);
+    if (!type_obj)
+    {
+        return -1;
+    }
+
+    JSONView_TypeObject = (PyTypeObject *)type_obj;
+
+    if (PyModule_AddObject(module, "JSONView", type_obj) < 0)
+    {
+        Py_DECREF(type_obj);
+        JSONView_TypeObject = NULL;
+        return -1;
+    }
+
+    return 0;
+}
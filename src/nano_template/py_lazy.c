@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/py_lazy.h"
+
+static PyTypeObject *Lazy_TypeObject = NULL;
+
+/// @brief Allocate a new instance of `type` wrapping callable `fn`.
+static PyObject *Lazy_wrap(PyTypeObject *type, PyObject *fn)
+{
+    if (!PyCallable_Check(fn))
+    {
+        PyErr_SetString(PyExc_TypeError, "lazy() argument must be callable");
+        return NULL;
+    }
+
+    PyObject *obj = PyType_GenericNew(type, NULL, NULL);
+    if (!obj)
+    {
+        return NULL;
+    }
+
+    NTPY_LazyObject *op = (NTPY_LazyObject *)obj;
+    op->fn = Py_NewRef(fn);
+    return obj;
+}
+
+PyObject *lazy(PyObject *Py_UNUSED(self), PyObject *fn)
+{
+    if (!Lazy_TypeObject)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Lazy type not initialized");
+        return NULL;
+    }
+
+    return Lazy_wrap(Lazy_TypeObject, fn);
+}
+
+static PyObject *Lazy_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"fn", NULL};
+    PyObject *fn = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:Lazy", kwlist, &fn))
+    {
+        return NULL;
+    }
+
+    return Lazy_wrap(type, fn);
+}
+
+bool NTPY_Lazy_Check(PyObject *op)
+{
+    return Lazy_TypeObject && Py_TYPE(op) == Lazy_TypeObject;
+}
+
+static PyObject *Lazy_call(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    NTPY_LazyObject *op = (NTPY_LazyObject *)self;
+    return PyObject_Call(op->fn, args, kwargs);
+}
+
+static PyObject *Lazy_repr(PyObject *self)
+{
+    NTPY_LazyObject *op = (NTPY_LazyObject *)self;
+    return PyUnicode_FromFormat("<Lazy %R>", op->fn);
+}
+
+// Lazy objects are GC tracked, as it's common for a wrapped closure to
+// reference the data it is stored in.
+
+static int Lazy_traverse(PyObject *self, visitproc visit, void *arg)
+{
+    NTPY_LazyObject *op = (NTPY_LazyObject *)self;
+    Py_VISIT(Py_TYPE(self));
+    Py_VISIT(op->fn);
+    return 0;
+}
+
+static int Lazy_clear(PyObject *self)
+{
+    NTPY_LazyObject *op = (NTPY_LazyObject *)self;
+    Py_CLEAR(op->fn);
+    return 0;
+}
+
+static void Lazy_dealloc(PyObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    PyObject_GC_UnTrack(self);
+    Lazy_clear(self);
+    freefunc tp_free = (freefunc)PyType_GetSlot(tp, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(tp);
+}
+
+static PyType_Slot Lazy_slots[] = {
+    {Py_tp_doc, "A callable that is called at most once per render"},
+    {Py_tp_new, (void *)Lazy_new},
+    {Py_tp_dealloc, (void *)Lazy_dealloc},
+    {Py_tp_traverse, (void *)Lazy_traverse},
+    {Py_tp_clear, (void *)Lazy_clear},
+    {Py_tp_call, (void *)Lazy_call},
+    {Py_tp_repr, (void *)Lazy_repr},
+    {0, NULL}};
+
+static PyType_Spec Lazy_spec = {
+    .name = "nano_template.Lazy",
+    .basicsize = sizeof(NTPY_LazyObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .slots = Lazy_slots,
+};
+
+int nt_register_lazy_type(PyObject *module)
+{
+    PyObject *type_obj = PyType_FromSpec(&Lazy_spec);
+    if (!type_obj)
+    {
+        return -1;
+    }
+
+    Lazy_TypeObject = (PyTypeObject *)type_obj;
+
+    if (PyModule_AddObject(module, "Lazy", type_obj) < 0)
+    {
+        Py_DECREF(type_obj);
+        Lazy_TypeObject = NULL;
+        return -1;
+    }
+
+    return 0;
+}
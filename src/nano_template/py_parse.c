@@ -4,6 +4,7 @@
 #include "nano_template/allocator.h"
 #include "nano_template/lexer.h"
 #include "nano_template/parser.h"
+#include "nano_template/peephole.h"
 #include "nano_template/py_template.h"
 
 PyObject *parse(PyObject *Py_UNUSED(self), PyObject *args)
@@ -16,12 +17,17 @@ PyObject *parse(PyObject *Py_UNUSED(self), PyObject *args)
     NT_Mem *ast = NULL;
     NT_Node *root = NULL;
     PyObject *template = NULL;
+    PyObject *root_paths = NULL;
+    PyObject *prefix = NULL;
 
     PyObject *src;
     PyObject *serializer;
     PyObject *undefined;
+    PyObject *globals = Py_None;
+    int optimize = 1;
 
-    if (!PyArg_ParseTuple(args, "OOO", &src, &serializer, &undefined))
+    if (!PyArg_ParseTuple(args, "OOO|Op", &src, &serializer, &undefined,
+                          &globals, &optimize))
     {
         return NULL;
     }
@@ -77,7 +83,36 @@ PyObject *parse(PyObject *Py_UNUSED(self), PyObject *args)
         goto cleanup;
     }
 
-    template = NTPY_Template_new(src, root, ast, serializer, undefined);
+    // Leading text doesn't depend on render data, so it can be written
+    // before anything is evaluated. This comes first, as the optimizer
+    // would otherwise fuse it with a following output statement.
+    prefix = NT_Node_take_text_prefix(root);
+    if (!prefix)
+    {
+        goto cleanup;
+    }
+
+    if (optimize && NT_Peephole_optimize(ast, root) < 0)
+    {
+        goto cleanup;
+    }
+
+    if (NT_Node_encode_text(ast, root) < 0)
+    {
+        goto cleanup;
+    }
+
+    root_paths = PySequence_Tuple(parser->root_paths);
+    if (!root_paths)
+    {
+        goto cleanup;
+    }
+
+    template = NTPY_Template_new(src, prefix, root, ast,
+                                 PyDict_Size(parser->paths),
+                                 parser->binding_count, root_paths,
+                                 serializer, undefined,
+                                 globals == Py_None ? NULL : globals);
     if (!template)
     {
         goto cleanup;
@@ -87,6 +122,9 @@ PyObject *parse(PyObject *Py_UNUSED(self), PyObject *args)
     ast = NULL;
 
 cleanup:
+    Py_XDECREF(root_paths);
+    Py_XDECREF(prefix);
+
     if (tokens)
     {
         PyMem_Free(tokens);
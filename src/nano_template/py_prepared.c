@@ -0,0 +1,451 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/py_prepared.h"
+
+static PyTypeObject *Prepared_TypeObject = NULL;
+
+/// @brief Return a copy of mapping `obj` as a dict with interned str keys,
+/// and values copied with copy_value.
+/// @param memo A dict of ids of dicts and lists already copied, to their
+/// copies, so shared and cyclic data keeps its shape.
+/// @return A new dict, or NULL on error with an exception set.
+static PyObject *intern_keys(PyObject *obj, PyObject *memo);
+
+/// @brief Return a private copy of `obj` if it is an exact dict or list,
+/// copying nested dicts and lists too, or a new reference to `obj`.
+/// Flattened paths are a snapshot of nested dicts, so the caller must not be
+/// able to change them afterwards.
+/// @return A new reference, or NULL on error with an exception set.
+static PyObject *copy_value(PyObject *obj, PyObject *memo);
+
+/// @brief Add an entry to `paths` for every key in `dict`, prefixed with
+/// `prefix`, descending into nested dicts.
+/// @param seen A set of ids of the dicts we're currently descending into, so
+/// we don't follow cycles.
+/// @return 0 on success, -1 on failure with an exception set.
+static int flatten(PyObject *paths, PyObject *dict, PyObject *prefix,
+                   PyObject *seen);
+
+/// @brief Allocate a new instance of `type` with data from `mapping`.
+static PyObject *Prepared_build(PyTypeObject *type, PyObject *mapping)
+{
+    PyObject *obj = NULL;
+    PyObject *prefix = NULL;
+    PyObject *seen = NULL;
+    PyObject *memo = NULL;
+
+    if (!PyMapping_Check(mapping))
+    {
+        PyErr_SetString(PyExc_TypeError,
+                        "prepare() argument must be a mapping");
+        return NULL;
+    }
+
+    obj = PyType_GenericNew(type, NULL, NULL);
+    if (!obj)
+    {
+        return NULL;
+    }
+
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)obj;
+
+    memo = PyDict_New();
+    if (!memo)
+    {
+        goto fail;
+    }
+
+    op->root = intern_keys(mapping, memo);
+    Py_CLEAR(memo);
+    if (!op->root)
+    {
+        goto fail;
+    }
+
+    op->paths = PyDict_New();
+    if (!op->paths)
+    {
+        goto fail;
+    }
+
+    prefix = PyTuple_New(0);
+    seen = PySet_New(NULL);
+    if (!prefix || !seen)
+    {
+        goto fail;
+    }
+
+    if (flatten(op->paths, op->root, prefix, seen) < 0)
+    {
+        goto fail;
+    }
+
+    Py_DECREF(prefix);
+    Py_DECREF(seen);
+    return obj;
+
+fail:
+    Py_XDECREF(prefix);
+    Py_XDECREF(seen);
+    Py_XDECREF(memo);
+    Py_DECREF(obj);
+    return NULL;
+}
+
+PyObject *prepare(PyObject *Py_UNUSED(self), PyObject *mapping)
+{
+    if (!Prepared_TypeObject)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Prepared type not initialized");
+        return NULL;
+    }
+
+    return Prepared_build(Prepared_TypeObject, mapping);
+}
+
+static PyObject *Prepared_new(PyTypeObject *type, PyObject *args,
+                              PyObject *kwds)
+{
+    static char *kwlist[] = {"mapping", NULL};
+    PyObject *mapping = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:Prepared", kwlist,
+                                     &mapping))
+    {
+        return NULL;
+    }
+
+    return Prepared_build(type, mapping);
+}
+
+bool NTPY_Prepared_Check(PyObject *op)
+{
+    return Prepared_TypeObject && Py_TYPE(op) == Prepared_TypeObject;
+}
+
+/// @brief Look up the copy of `obj` in `memo`, or add `copy` as its copy.
+/// Entries keep `obj` alive too, so its id can't be reused while copying.
+/// @return A borrowed reference to an earlier copy, NULL with no exception
+/// set if `copy` was added, or NULL on error with an exception set.
+static PyObject *memo_copy(PyObject *memo, PyObject *obj, PyObject *copy)
+{
+    PyObject *entry = NULL;
+    PyObject *found = NULL;
+
+    PyObject *id = PyLong_FromVoidPtr(obj);
+    if (!id)
+    {
+        return NULL;
+    }
+
+    entry = PyDict_GetItemWithError(memo, id);
+    if (entry)
+    {
+        found = PyTuple_GetItem(entry, 1);
+        goto cleanup;
+    }
+
+    if (PyErr_Occurred())
+    {
+        goto cleanup;
+    }
+
+    entry = PyTuple_Pack(2, obj, copy);
+    if (entry)
+    {
+        PyDict_SetItem(memo, id, entry);
+        Py_DECREF(entry);
+    }
+
+cleanup:
+    Py_DECREF(id);
+    return found;
+}
+
+static PyObject *copy_value(PyObject *obj, PyObject *memo)
+{
+    if (PyDict_CheckExact(obj))
+    {
+        return intern_keys(obj, memo);
+    }
+
+    if (!PyList_CheckExact(obj))
+    {
+        return Py_NewRef(obj);
+    }
+
+    Py_ssize_t size = PyList_Size(obj);
+    PyObject *list = PyList_New(size);
+    if (!list)
+    {
+        return NULL;
+    }
+
+    PyObject *found = memo_copy(memo, obj, list);
+    if (found || PyErr_Occurred())
+    {
+        Py_DECREF(list);
+        return Py_XNewRef(found);
+    }
+
+    if (Py_EnterRecursiveCall(" while preparing data"))
+    {
+        Py_DECREF(list);
+        return NULL;
+    }
+
+    for (Py_ssize_t i = 0; i < size; i++)
+    {
+        PyObject *item = PyList_GetItem(obj, i);
+        PyObject *copy = item ? copy_value(item, memo) : NULL;
+
+        // On failure, the copy is discarded with any items still unset.
+        if (!copy || PyList_SetItem(list, i, copy) < 0)
+        {
+            Py_LeaveRecursiveCall();
+            Py_DECREF(list);
+            return NULL;
+        }
+    }
+
+    Py_LeaveRecursiveCall();
+    return list;
+}
+
+static PyObject *intern_keys(PyObject *obj, PyObject *memo)
+{
+    PyObject *items = NULL;
+    PyObject *dict = NULL;
+    PyObject *result = NULL;
+    bool entered = false;
+
+    dict = PyDict_New();
+    if (!dict)
+    {
+        goto cleanup;
+    }
+
+    PyObject *found = memo_copy(memo, obj, dict);
+    if (found || PyErr_Occurred())
+    {
+        result = Py_XNewRef(found);
+        goto cleanup;
+    }
+
+    if (Py_EnterRecursiveCall(" while preparing data"))
+    {
+        goto cleanup;
+    }
+
+    entered = true;
+
+    items = PyMapping_Items(obj);
+    if (!items)
+    {
+        goto cleanup;
+    }
+
+    Py_ssize_t size = PyList_Size(items);
+    for (Py_ssize_t i = 0; i < size; i++)
+    {
+        PyObject *item = PyList_GetItem(items, i);
+        PyObject *key = NULL;
+        PyObject *value = NULL;
+
+        if (!PyArg_ParseTuple(item, "OO", &key, &value))
+        {
+            goto cleanup;
+        }
+
+        value = copy_value(value, memo);
+        if (!value)
+        {
+            goto cleanup;
+        }
+
+        Py_INCREF(key);
+        if (PyUnicode_CheckExact(key))
+        {
+            PyUnicode_InternInPlace(&key);
+        }
+
+        int rv = PyDict_SetItem(dict, key, value);
+        Py_DECREF(key);
+        Py_DECREF(value);
+
+        if (rv < 0)
+        {
+            goto cleanup;
+        }
+    }
+
+    result = Py_NewRef(dict);
+
+cleanup:
+    if (entered)
+    {
+        Py_LeaveRecursiveCall();
+    }
+
+    Py_XDECREF(items);
+    Py_XDECREF(dict);
+    return result;
+}
+
+static int flatten(PyObject *paths, PyObject *dict, PyObject *prefix,
+                   PyObject *seen)
+{
+    PyObject *id = NULL;
+    PyObject *key = NULL;
+    PyObject *value = NULL;
+    PyObject *path = NULL;
+    Py_ssize_t pos = 0;
+    int rv = -1;
+
+    id = PyLong_FromVoidPtr(dict);
+    if (!id)
+    {
+        return -1;
+    }
+
+    int found = PySet_Contains(seen, id);
+    if (found != 0)
+    {
+        Py_DECREF(id);
+        return found < 0 ? -1 : 0;
+    }
+
+    if (PySet_Add(seen, id) < 0)
+    {
+        goto cleanup;
+    }
+
+    Py_ssize_t prefix_size = PyTuple_Size(prefix);
+
+    while (PyDict_Next(dict, &pos, &key, &value))
+    {
+        path = PyTuple_New(prefix_size + 1);
+        if (!path)
+        {
+            goto cleanup;
+        }
+
+        for (Py_ssize_t i = 0; i < prefix_size; i++)
+        {
+            PyTuple_SetItem(path, i, Py_NewRef(PyTuple_GetItem(prefix, i)));
+        }
+
+        PyTuple_SetItem(path, prefix_size, Py_NewRef(key));
+
+        // Single segment paths are looked up in `root`.
+        if (prefix_size > 0 && PyDict_SetItem(paths, path, value) < 0)
+        {
+            goto cleanup;
+        }
+
+        if (PyDict_CheckExact(value) &&
+            flatten(paths, value, path, seen) < 0)
+        {
+            goto cleanup;
+        }
+
+        Py_CLEAR(path);
+    }
+
+    rv = PySet_Discard(seen, id) < 0 ? -1 : 0;
+
+cleanup:
+    Py_XDECREF(path);
+    Py_DECREF(id);
+    return rv;
+}
+
+static PyObject *Prepared_subscript(PyObject *self, PyObject *key)
+{
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)self;
+    return PyObject_GetItem(op->root, key);
+}
+
+static Py_ssize_t Prepared_length(PyObject *self)
+{
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)self;
+    return PyDict_Size(op->root);
+}
+
+static PyObject *Prepared_iter(PyObject *self)
+{
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)self;
+    return PyObject_GetIter(op->root);
+}
+
+static PyObject *Prepared_repr(PyObject *self)
+{
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)self;
+    return PyUnicode_FromFormat("<Prepared %R>", op->root);
+}
+
+static int Prepared_traverse(PyObject *self, visitproc visit, void *arg)
+{
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)self;
+    Py_VISIT(Py_TYPE(self));
+    Py_VISIT(op->root);
+    Py_VISIT(op->paths);
+    return 0;
+}
+
+static int Prepared_clear(PyObject *self)
+{
+    NTPY_PreparedObject *op = (NTPY_PreparedObject *)self;
+    Py_CLEAR(op->root);
+    Py_CLEAR(op->paths);
+    return 0;
+}
+
+static void Prepared_dealloc(PyObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    PyObject_GC_UnTrack(self);
+    Prepared_clear(self);
+    freefunc tp_free = (freefunc)PyType_GetSlot(tp, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(tp);
+}
+
+static PyType_Slot Prepared_slots[] = {
+    {Py_tp_doc, "Render data frozen for fast repeated lookups"},
+    {Py_tp_new, (void *)Prepared_new},
+    {Py_tp_dealloc, (void *)Prepared_dealloc},
+    {Py_tp_traverse, (void *)Prepared_traverse},
+    {Py_tp_clear, (void *)Prepared_clear},
+    {Py_tp_iter, (void *)Prepared_iter},
+    {Py_tp_repr, (void *)Prepared_repr},
+    {Py_mp_subscript, (void *)Prepared_subscript},
+    {Py_mp_length, (void *)Prepared_length},
+    {0, NULL}};
+
+static PyType_Spec Prepared_spec = {
+    .name = "nano_template.Prepared",
+    .basicsize = sizeof(NTPY_PreparedObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .slots = Prepared_slots,
+};
+
+int nt_register_prepared_type(PyObject *module)
+{
+    PyObject *type_obj = PyType_FromSpec(&Prepared_spec);
+    if (!type_obj)
+    {
+        return -1;
+    }
+
+    Prepared_TypeObject = (PyTypeObject *)type_obj;
+
+    if (PyModule_AddObject(module, "Prepared", type_obj) < 0)
+    {
+        Py_DECREF(type_obj);
+        Prepared_TypeObject = NULL;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/py_render_iterator.h"
+
+static PyTypeObject *RenderIterator_TypeObject = NULL;
+
+PyObject *NTPY_RenderIterator_new(PyObject *template, const NT_Node *root,
+                                  PyObject *prefix, bool flush_prefix,
+                                  NT_RenderContext *ctx,
+                                  Py_ssize_t chunk_size)
+{
+    if (!RenderIterator_TypeObject)
+    {
+        NT_RenderContext_free(ctx);
+        PyErr_SetString(PyExc_RuntimeError,
+                        "RenderIterator type not initialized");
+        return NULL;
+    }
+
+    PyObject *obj = PyType_GenericNew(RenderIterator_TypeObject, NULL, NULL);
+    if (!obj)
+    {
+        NT_RenderContext_free(ctx);
+        return NULL;
+    }
+
+    NTPY_RenderIteratorObject *op = (NTPY_RenderIteratorObject *)obj;
+    op->template = Py_NewRef(template);
+    op->ctx = ctx;
+    op->chunk_size = chunk_size;
+    op->running = false;
+    op->prefix_pending = prefix && flush_prefix;
+    op->buf = StringBuffer_new();
+    op->stack = op->buf ? NT_RenderStack_new(root) : NULL;
+
+    if (!op->stack)
+    {
+        Py_DECREF(obj);
+        return NULL;
+    }
+
+    if (prefix && StringBuffer_append(op->buf, prefix) < 0)
+    {
+        Py_DECREF(obj);
+        return NULL;
+    }
+
+    return obj;
+}
+
+/// @brief Let go of everything needed to carry on rendering.
+static void RenderIterator_stop(NTPY_RenderIteratorObject *op)
+{
+    NT_RenderStack_free(op->stack);
+    op->stack = NULL;
+
+    if (op->ctx)
+    {
+        NT_RenderContext_free(op->ctx);
+        op->ctx = NULL;
+    }
+}
+
+/// @brief Render the next chunk.
+/// @return A new reference to the chunk, or NULL if there are no more
+/// chunks or on error with an exception set.
+static PyObject *RenderIterator_next_chunk(NTPY_RenderIteratorObject *op)
+{
+    if (op->running)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "render iterator is already executing");
+        return NULL;
+    }
+
+    // A static prefix that is flushed early is yielded before anything is
+    // evaluated.
+    if (op->prefix_pending)
+    {
+        op->prefix_pending = false;
+        return StringBuffer_flush(op->buf);
+    }
+
+    if (op->stack)
+    {
+        op->running = true;
+        int rc = NT_RenderStack_resume(op->stack, op->ctx, op->buf,
+                                       op->chunk_size);
+        op->running = false;
+
+        if (rc < 0 && op->ctx->aiter_failed)
+        {
+            // The render can carry on from the same place once its async
+            // iteration callback can consume the loop's iterable. Output so
+            // far stays buffered.
+            op->ctx->aiter_failed = false;
+            return NULL;
+        }
+
+        if (rc <= 0)
+        {
+            RenderIterator_stop(op);
+        }
+
+        if (rc < 0)
+        {
+            StringBuffer_free(op->buf);
+            op->buf = NULL;
+            return NULL;
+        }
+    }
+
+    if (!op->buf || StringBuffer_length(op->buf) == 0)
+    {
+        return NULL;
+    }
+
+    return StringBuffer_flush(op->buf);
+}
+
+static PyObject *RenderIterator_next(PyObject *self)
+{
+    PyObject *chunk = NULL;
+
+#ifdef Py_GIL_DISABLED
+    Py_BEGIN_CRITICAL_SECTION(self);
+    chunk = RenderIterator_next_chunk((NTPY_RenderIteratorObject *)self);
+    Py_END_CRITICAL_SECTION();
+#else
+    chunk = RenderIterator_next_chunk((NTPY_RenderIteratorObject *)self);
+#endif
+
+    return chunk;
+}
+
+static PyObject *RenderIterator_iter(PyObject *self)
+{
+    return Py_NewRef(self);
+}
+
+static PyObject *RenderIterator_new_instance(PyTypeObject *Py_UNUSED(type),
+                                             PyObject *Py_UNUSED(args),
+                                             PyObject *Py_UNUSED(kwds))
+{
+    PyErr_SetString(PyExc_TypeError, "RenderIterator objects are created by "
+                                     "Template.iter_render()");
+    return NULL;
+}
+
+// Render iterators are GC tracked, as render data can refer back to the
+// iterator rendering it.
+
+static int RenderIterator_traverse(PyObject *self, visitproc visit, void *arg)
+{
+    NTPY_RenderIteratorObject *op = (NTPY_RenderIteratorObject *)self;
+    Py_VISIT(Py_TYPE(self));
+    Py_VISIT(op->template);
+
+    if (op->ctx)
+    {
+        int rv = NT_RenderContext_traverse(op->ctx, visit, arg);
+        if (rv)
+        {
+            return rv;
+        }
+    }
+
+    return NT_RenderStack_traverse(op->stack, visit, arg);
+}
+
+static int RenderIterator_clear(PyObject *self)
+{
+    NTPY_RenderIteratorObject *op = (NTPY_RenderIteratorObject *)self;
+
+    // A render in progress is still using its context, its stack and the
+    // template's nodes.
+    if (op->running)
+    {
+        return 0;
+    }
+
+    RenderIterator_stop(op);
+    Py_CLEAR(op->template);
+    return 0;
+}
+
+static void RenderIterator_dealloc(PyObject *self)
+{
+    PyTypeObject *tp = Py_TYPE(self);
+    NTPY_RenderIteratorObject *op = (NTPY_RenderIteratorObject *)self;
+    PyObject_GC_UnTrack(self);
+    RenderIterator_stop(op);
+    StringBuffer_free(op->buf);
+    Py_CLEAR(op->template);
+    freefunc tp_free = (freefunc)PyType_GetSlot(tp, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(tp);
+}
+
+static PyType_Slot RenderIterator_slots[] = {
+    {Py_tp_doc, "Iterator of rendered chunks"},
+    {Py_tp_new, (void *)RenderIterator_new_instance},
+    {Py_tp_dealloc, (void *)RenderIterator_dealloc},
+    {Py_tp_traverse, (void *)RenderIterator_traverse},
+    {Py_tp_clear, (void *)RenderIterator_clear},
+    {Py_tp_iter, (void *)RenderIterator_iter},
+    {Py_tp_iternext, (void *)RenderIterator_next},
+    {0, NULL}};
+
+static PyType_Spec RenderIterator_spec = {
+    .name = "nano_template.RenderIterator",
+    .basicsize = sizeof(NTPY_RenderIteratorObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .slots = RenderIterator_slots,
+};
+
+int nt_register_render_iterator_type(PyObject *module)
+{
+    PyObject *type_obj = PyType_FromSpec(&RenderIterator_spec);
+    if (!type_obj)
+    {
+        return -1;
+    }
+
+    RenderIterator_TypeObject = (PyTypeObject *)type_obj;
+
+    if (PyModule_AddObject(module, "RenderIterator", type_obj) < 0)
+    {
+        Py_DECREF(type_obj);
+        RenderIterator_TypeObject = NULL;
+        return -1;
+    }
+
+    return 0;
+}
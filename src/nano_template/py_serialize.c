@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: MIT
+
+#include "nano_template/py_serialize.h"
+
+static PyObject *default_serializer = NULL;
+static PyObject *json_dumps = NULL;
+
+PyObject *serialize(PyObject *Py_UNUSED(self), PyObject *obj)
+{
+    if (PyUnicode_CheckExact(obj))
+    {
+        return Py_NewRef(obj);
+    }
+
+    if (!PyList_Check(obj) && !PyDict_Check(obj) && !PyTuple_Check(obj))
+    {
+        return PyObject_Str(obj);
+    }
+
+    if (!json_dumps)
+    {
+        PyObject *json = PyImport_ImportModule("json");
+        if (!json)
+        {
+            return NULL;
+        }
+
+        json_dumps = PyObject_GetAttrString(json, "dumps");
+        Py_DECREF(json);
+
+        if (!json_dumps)
+        {
+            return NULL;
+        }
+    }
+
+    return PyObject_CallFunctionObjArgs(json_dumps, obj, NULL);
+}
+
+bool NTPY_Serializer_is_default(PyObject *op)
+{
+    return op == default_serializer;
+}
+
+int nt_register_serializer(PyObject *module)
+{
+    default_serializer = PyObject_GetAttrString(module, "serialize");
+    return default_serializer ? 0 : -1;
+}
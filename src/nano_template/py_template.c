@@ -1,23 +1,87 @@
 // SPDX-License-Identifier: MIT
 
 #include "nano_template/py_template.h"
+#include "nano_template/compress_sink.h"
 #include "nano_template/context.h"
+#include "nano_template/fd_sink.h"
+#include "nano_template/py_json.h"
+#include "nano_template/py_render_iterator.h"
 #include "nano_template/string_buffer.h"
 
+/// @brief The default least output, in characters, that render_to passes
+/// to its sink at once, and that iter_render yields.
+#define NT_DEFAULT_CHUNK_SIZE 65536
+
+/// @brief How a render outputs a template's static prefix.
+typedef enum
+{
+    PREFIX_OMIT = 1, // Leave it out, as it has already been output
+    PREFIX_INLINE,   // Output it like any other text
+    PREFIX_FLUSH,    // Pass it on by itself, before evaluating anything
+} NT_PrefixMode;
+
+// Size estimates are shared by every render of a template. On free-threaded
+// builds they're read and written with relaxed atomics, so renders on other
+// threads can lose an update, but never see a torn value.
+#ifdef Py_GIL_DISABLED
+#define NT_LOAD_SSIZE_RELAXED(p) _Py_atomic_load_ssize_relaxed(p)
+#define NT_STORE_SSIZE_RELAXED(p, v) _Py_atomic_store_ssize_relaxed(p, v)
+#define NT_LOAD_UCS4_RELAXED(p) _Py_atomic_load_uint32_relaxed(p)
+#define NT_STORE_UCS4_RELAXED(p, v) _Py_atomic_store_uint32_relaxed(p, v)
+#else
+#define NT_LOAD_SSIZE_RELAXED(p) (*(p))
+#define NT_STORE_SSIZE_RELAXED(p, v) (*(p) = (v))
+#define NT_LOAD_UCS4_RELAXED(p) (*(p))
+#define NT_STORE_UCS4_RELAXED(p, v) (*(p) = (v))
+#endif
+
 static PyTypeObject *Template_TypeObject = NULL;
 
-void NTPY_Template_free(PyObject *self)
+// Templates are GC tracked, as globals, or a serializer, can refer back to
+// the template.
+
+static int Template_traverse(PyObject *self, visitproc visit, void *arg)
+{
+    NTPY_Template *op = (NTPY_Template *)self;
+    Py_VISIT(Py_TYPE(self));
+    Py_VISIT(op->serializer);
+    Py_VISIT(op->undefined);
+    Py_VISIT(op->globals);
+    return 0;
+}
+
+static int Template_clear(PyObject *self)
+{
+    // Render contexts hold their own references to these, so renders that
+    // are already under way are not affected.
+    NTPY_Template *op = (NTPY_Template *)self;
+    Py_CLEAR(op->serializer);
+    Py_CLEAR(op->undefined);
+    Py_CLEAR(op->globals);
+    return 0;
+}
+
+static void Template_dealloc(PyObject *self)
 {
+    PyTypeObject *tp = Py_TYPE(self);
     NTPY_Template *op = (NTPY_Template *)self;
+    PyObject_GC_UnTrack(self);
+    Template_clear(self);
     NT_Mem_free(op->ast);
     Py_XDECREF(op->str);
-    Py_XDECREF(op->serializer);
-    Py_XDECREF(op->undefined);
-    PyObject_Free(op);
+    Py_XDECREF(op->prefix);
+    Py_XDECREF(op->prefix_bytes);
+    Py_XDECREF(op->root_paths);
+    freefunc tp_free = (freefunc)PyType_GetSlot(tp, Py_tp_free);
+    tp_free(self);
+    Py_DECREF(tp);
 }
 
-PyObject *NTPY_Template_new(PyObject *str, NT_Node *root, NT_Mem *ast,
-                            PyObject *serializer, PyObject *undefined)
+PyObject *NTPY_Template_new(PyObject *str, PyObject *prefix, NT_Node *root,
+                            NT_Mem *ast,
+                            Py_ssize_t path_count, Py_ssize_t binding_count,
+                            PyObject *root_paths, PyObject *serializer,
+                            PyObject *undefined, PyObject *globals)
 {
 
     if (!Template_TypeObject)
@@ -34,59 +98,225 @@ PyObject *NTPY_Template_new(PyObject *str, NT_Node *root, NT_Mem *ast,
 
     NTPY_Template *op = (NTPY_Template *)obj;
 
+    if (PyUnicode_GetLength(prefix))
+    {
+        op->prefix_bytes = PyUnicode_AsUTF8String(prefix);
+
+        // A prefix that can't be encoded, like one with a lone surrogate,
+        // only fails to render as UTF-8.
+        if (!op->prefix_bytes)
+        {
+            if (!PyErr_ExceptionMatches(PyExc_UnicodeEncodeError))
+            {
+                Py_DECREF(obj);
+                return NULL;
+            }
+
+            PyErr_Clear();
+        }
+    }
+
     Py_INCREF(str);
     Py_INCREF(serializer);
     Py_INCREF(undefined);
 
     op->str = str;
+    op->prefix = PyUnicode_GetLength(prefix) ? Py_NewRef(prefix) : NULL;
     op->root = root;
     op->ast = ast;
+    op->path_count = path_count;
+    op->binding_count = binding_count;
+    op->root_paths = Py_NewRef(root_paths);
     op->serializer = serializer;
     op->undefined = undefined;
+    op->globals = Py_XNewRef(globals);
     return obj;
 }
 
-/// @brief Render template with data from `globals`.
-/// @param globals dict[str, Any]
-/// @return The rendered string on success, or `NULL` on error with an
-/// exception set.
-static PyObject *NTPY_Template_render(PyObject *self, PyObject *globals)
+/// @brief Fold the length and width of rendered output in `buf` into
+/// template `op`'s estimates for the next render.
+static void update_size_estimate(NTPY_Template *op, const NT_StringBuffer *buf)
 {
-    NTPY_Template *op = (NTPY_Template *)self;
-    NT_RenderContext *ctx = NULL;
-    PyObject *buf = NULL;
-    PyObject *rv = NULL;
+    Py_ssize_t length = StringBuffer_length(buf);
+    bool utf8 = StringBuffer_is_utf8(buf);
+    Py_ssize_t *field = utf8 ? &op->utf8_size_estimate : &op->size_estimate;
+    Py_ssize_t estimate = NT_LOAD_SSIZE_RELAXED(field);
+
+    if (estimate == 0)
+    {
+        estimate = length;
+    }
+    else
+    {
+        // An exponential moving average, weighting the latest render by 1/4.
+        // The step is rounded away from zero so the estimate reaches the
+        // latest length, including zero, rather than stalling short of it.
+        Py_ssize_t delta = length - estimate;
+        estimate += (delta + (delta < 0 ? -3 : 3)) / 4;
+    }
+
+    NT_STORE_SSIZE_RELAXED(field, estimate);
+
+    // A narrower buffer is widened cheaply if it turns out to be needed, so
+    // follow the latest render's width rather than the widest ever seen.
+    if (!utf8)
+    {
+        NT_STORE_UCS4_RELAXED(&op->last_maxchar, StringBuffer_maxchar(buf));
+    }
+}
+
+/// @brief Create a render context for template `op`, with `overrides`, if
+/// it is not None, taking priority over `data`. Template globals, if any,
+/// sit beneath `data` in the scope stack.
+/// @return The new context, or NULL on failure with an exception set.
+static NT_RenderContext *render_context_new(NTPY_Template *op, PyObject *data,
+                                            PyObject *overrides)
+{
+    if (!op->serializer)
+    {
+        // Only the garbage collector clears a template, so this can only be
+        // reached from a finalizer running as part of the same collection.
+        PyErr_SetString(PyExc_RuntimeError, "template has been cleared");
+        return NULL;
+    }
+
+    NT_RenderContext *ctx = NT_RenderContext_new(
+        op->str, op->globals ? op->globals : data, op->serializer,
+        op->undefined, op->path_count, op->binding_count);
 
-    ctx =
-        NT_RenderContext_new(op->str, globals, op->serializer, op->undefined);
     if (!ctx)
     {
-        goto fail;
+        return NULL;
     }
 
-    buf = StringBuffer_new();
-    if (!buf)
+    // Lookups fall through overrides, then data, then template globals.
+    if ((op->globals && NT_RenderContext_push(ctx, data) < 0) ||
+        (overrides != Py_None && NT_RenderContext_push(ctx, overrides) < 0))
     {
-        goto fail;
+        NT_RenderContext_free(ctx);
+        return NULL;
     }
 
-    NT_Node *root = op->root;
-    NT_NodePage *page = root->head;
+    return ctx;
+}
 
-    while (page)
+/// @brief Render template `op`, with its static prefix output as `prefix`
+/// says, to `buf` with render context `ctx`.
+/// @return 0 on success, -1 on failure with an exception set.
+static int render_nodes(NTPY_Template *op, NT_RenderContext *ctx,
+                        NT_StringBuffer *buf, NT_PrefixMode prefix)
+{
+    if (op->prefix && prefix != PREFIX_OMIT)
+    {
+        if (NT_RenderContext_append_text(ctx, buf, op->prefix,
+                                         op->prefix_bytes) < 0)
+        {
+            return -1;
+        }
+
+        // Static text doesn't wait for render data, which might be slow to
+        // resolve, nor for the rest of the first chunk.
+        if (prefix == PREFIX_FLUSH && NT_RenderContext_flush(ctx, buf) < 0)
+        {
+            return -1;
+        }
+    }
+
+    for (NT_NodePage *page = op->root->head; page; page = page->next)
     {
         for (Py_ssize_t i = 0; i < page->count; i++)
         {
             if (NT_Node_render(page->nodes[i], ctx, buf) < 0)
             {
-                goto fail;
+                return -1;
             }
         }
+    }
+
+    return 0;
+}
+
+/// @brief Return the buffer size to start a render of `op` with, given a
+/// `size_hint` argument that is -1 if it wasn't given.
+static Py_ssize_t initial_size(const NTPY_Template *op, Py_ssize_t size_hint,
+                               bool utf8)
+{
+    if (size_hint >= 0)
+    {
+        return size_hint;
+    }
+
+    // Leave some headroom so that slightly longer output doesn't double the
+    // buffer.
+    Py_ssize_t estimate =
+        NT_LOAD_SSIZE_RELAXED(utf8 ? &op->utf8_size_estimate
+                                   : &op->size_estimate);
+    return estimate + estimate / 8;
+}
+
+/// @brief Render template `op` with data from `data`, and optionally
+/// `overrides`, which takes priority over `data`. Template globals, if any,
+/// sit beneath `data` in the scope stack.
+/// @param write Optional callable that receives output as it is rendered.
+/// @param aiter Optional callable that turns async iterables into iterators.
+/// @param size_hint Expected output length in characters, or -1 to use the
+/// template's estimate from previous renders.
+/// @param chunk_size The least output, in characters, to collect before
+/// passing it to `write`.
+/// @param prefix How to output the template's static prefix.
+/// @param utf8 If true, render UTF-8 encoded bytes rather than a string.
+/// `size_hint` and `chunk_size` are then in bytes.
+/// @return The rendered string or bytes on success, or None if output was
+/// passed to `write`. `NULL` on error with an exception set.
+static PyObject *render(NTPY_Template *op, PyObject *data,
+                        PyObject *overrides, PyObject *write,
+                        PyObject *aiter, Py_ssize_t size_hint,
+                        Py_ssize_t chunk_size, NT_PrefixMode prefix,
+                        bool utf8)
+{
+    NT_StringBuffer *buf = NULL;
+    PyObject *rv = NULL;
+
+    NT_RenderContext *ctx = render_context_new(op, data, overrides);
+    if (!ctx)
+    {
+        goto fail;
+    }
+
+    ctx->write = Py_XNewRef(write);
+    ctx->chunk_size = chunk_size;
+    ctx->aiter = Py_XNewRef(aiter);
+
+    // When writing, output is flushed as it goes and the buffer is reused.
+    size_hint = write ? chunk_size : initial_size(op, size_hint, utf8);
+
+    Py_UCS4 maxchar = NT_LOAD_UCS4_RELAXED(&op->last_maxchar);
+    buf = utf8 ? StringBuffer_acquire_utf8(size_hint)
+               : StringBuffer_acquire(size_hint, maxchar);
+
+    if (!buf || render_nodes(op, ctx, buf, prefix) < 0)
+    {
+        goto fail;
+    }
+
+    if (write)
+    {
+        if (NT_RenderContext_flush(ctx, buf) < 0)
+        {
+            goto fail;
+        }
 
-        page = page->next;
+        rv = Py_NewRef(Py_None);
+    }
+    else
+    {
+        update_size_estimate(op, buf);
+        rv = StringBuffer_flush(buf);
     }
 
-    rv = StringBuffer_finish(buf);
+    StringBuffer_release(buf);
+    buf = NULL;
+
     if (!rv)
     {
         goto fail;
@@ -100,25 +330,894 @@ fail:
     {
         NT_RenderContext_free(ctx);
     }
-    Py_XDECREF(buf);
+    StringBuffer_release(buf);
     Py_XDECREF(rv);
     return NULL;
 }
 
+/// @brief Convert `obj`, a `size_hint` argument, to a length, leaving
+/// `size_hint` as it is if `obj` is None.
+/// @return 0 on success, -1 on failure with an exception set.
+static int parse_size_hint(PyObject *obj, Py_ssize_t *size_hint)
+{
+    if (obj == Py_None)
+    {
+        return 0;
+    }
+
+    Py_ssize_t value = PyLong_AsSsize_t(obj);
+    if (value == -1 && PyErr_Occurred())
+    {
+        return -1;
+    }
+
+    if (value < 0)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "size_hint must be a non-negative integer");
+        return -1;
+    }
+
+    *size_hint = value;
+    return 0;
+}
+
+/// @brief Render template with data from `data`, and optionally
+/// `overrides`.
+/// @param data Mapping[str, Any] | Prepared
+/// @param overrides Mapping[str, Any] | None
+/// @param size_hint int | None
+/// @return The rendered string on success, or `NULL` on error with an
+/// exception set.
+static PyObject *NTPY_Template_render(PyObject *self, PyObject *args,
+                                      PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "overrides", "size_hint", NULL};
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    PyObject *size_hint_obj = Py_None;
+    Py_ssize_t size_hint = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O$O:render", kwlist,
+                                     &data, &overrides, &size_hint_obj))
+    {
+        return NULL;
+    }
+
+    if (parse_size_hint(size_hint_obj, &size_hint) < 0)
+    {
+        return NULL;
+    }
+
+    return render((NTPY_Template *)self, data, overrides, NULL, NULL,
+                  size_hint, 0, PREFIX_INLINE, false);
+}
+
+/// @brief Render template with data from `data`, and optionally
+/// `overrides`, to UTF-8 encoded bytes. Literal text is encoded at parse
+/// time, so only output values are encoded while rendering.
+/// @param size_hint int | None, in bytes
+/// @return The rendered bytes on success, or `NULL` on error with an
+/// exception set.
+static PyObject *NTPY_Template_render_bytes(PyObject *self, PyObject *args,
+                                            PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "overrides", "size_hint", NULL};
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    PyObject *size_hint_obj = Py_None;
+    Py_ssize_t size_hint = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O$O:render_bytes",
+                                     kwlist, &data, &overrides,
+                                     &size_hint_obj))
+    {
+        return NULL;
+    }
+
+    if (parse_size_hint(size_hint_obj, &size_hint) < 0)
+    {
+        return NULL;
+    }
+
+    return render((NTPY_Template *)self, data, overrides, NULL, NULL,
+                  size_hint, 0, PREFIX_INLINE, true);
+}
+
+/// @brief Copy `size` bytes from `s` into bytearray `target` at `offset`,
+/// growing `target` if it is too short.
+/// @return 0 on success, -1 on failure with an exception set.
+static int copy_into_bytearray(PyObject *target, Py_ssize_t offset,
+                               const char *s, Py_ssize_t size)
+{
+    Py_ssize_t length = PyByteArray_Size(target);
+
+    if (offset > length)
+    {
+        PyErr_Format(PyExc_ValueError,
+                     "offset %zd is past the end of a bytearray of length %zd",
+                     offset, length);
+        return -1;
+    }
+
+    if (size > length - offset &&
+        PyByteArray_Resize(target, offset + size) < 0)
+    {
+        return -1;
+    }
+
+    if (size)
+    {
+        memcpy(PyByteArray_AsString(target) + offset, s, (size_t)size);
+    }
+
+    return 0;
+}
+
+/// @brief Copy `size` bytes from `s` into writable buffer `target` at
+/// `offset`. Buffers other than bytearrays can't grow.
+///
+/// The limited API can't borrow a buffer's memory, so bytes are copied
+/// with slice assignment to a memoryview, as they would be from Python.
+/// @return 0 on success, -1 on failure with an exception set.
+static int copy_into_buffer(PyObject *target, Py_ssize_t offset,
+                            const char *s, Py_ssize_t size)
+{
+    PyObject *view = NULL;
+    PyObject *bytes_view = NULL;
+    PyObject *src = NULL;
+    PyObject *slice = NULL;
+    int rv = -1;
+
+    view = PyMemoryView_FromObject(target);
+    if (!view)
+    {
+        if (PyErr_ExceptionMatches(PyExc_TypeError))
+        {
+            PyErr_SetString(PyExc_TypeError,
+                            "expected a bytearray or a writable buffer");
+        }
+        goto cleanup;
+    }
+
+    PyObject *readonly = PyObject_GetAttrString(view, "readonly");
+    int is_readonly = readonly ? PyObject_IsTrue(readonly) : -1;
+    Py_XDECREF(readonly);
+
+    if (is_readonly)
+    {
+        if (is_readonly > 0)
+        {
+            PyErr_SetString(PyExc_TypeError, "buffer is read-only");
+        }
+        goto cleanup;
+    }
+
+    // Address each byte, whatever the buffer's item type.
+    bytes_view = PyObject_CallMethod(view, "cast", "s", "B");
+    if (!bytes_view)
+    {
+        goto cleanup;
+    }
+
+    Py_ssize_t capacity = PyObject_Length(bytes_view);
+    if (capacity < 0)
+    {
+        goto cleanup;
+    }
+
+    if (offset > capacity || size > capacity - offset)
+    {
+        PyErr_Format(PyExc_ValueError,
+                     "buffer too small: output is %zd bytes, but only %zd "
+                     "bytes are available from offset %zd",
+                     size, capacity > offset ? capacity - offset : 0,
+                     offset);
+        goto cleanup;
+    }
+
+    src = PyMemoryView_FromMemory((char *)s, size, PyBUF_READ);
+    if (!src)
+    {
+        goto cleanup;
+    }
+
+    PyObject *start = PyLong_FromSsize_t(offset);
+    PyObject *stop = start ? PyLong_FromSsize_t(offset + size) : NULL;
+    slice = stop ? PySlice_New(start, stop, NULL) : NULL;
+    Py_XDECREF(start);
+    Py_XDECREF(stop);
+
+    if (!slice || PyObject_SetItem(bytes_view, slice, src) < 0)
+    {
+        goto cleanup;
+    }
+
+    rv = 0;
+
+cleanup:
+    Py_XDECREF(slice);
+    Py_XDECREF(src);
+    Py_XDECREF(bytes_view);
+    Py_XDECREF(view);
+    return rv;
+}
+
+/// @brief Render template with data from `data` to UTF-8, and copy the
+/// output into `buffer` at `offset`. Output is built in the thread's
+/// scratch buffer, so nothing is allocated per render once it has grown.
+/// @param buffer A bytearray, which grows if it is too short, or another
+/// writable buffer.
+/// @param offset int
+/// @return A tuple of the number of bytes written and the offset just past
+/// them, or `NULL` on error with an exception set. Nothing is written to
+/// fixed size buffers that are too small.
+static PyObject *NTPY_Template_render_into(PyObject *self, PyObject *args,
+                                           PyObject *kwargs)
+{
+    static char *kwlist[] = {"buffer", "data", "overrides", "offset", NULL};
+    NTPY_Template *op = (NTPY_Template *)self;
+    PyObject *target = NULL;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    Py_ssize_t offset = 0;
+    NT_StringBuffer *buf = NULL;
+    PyObject *rv = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O$n:render_into",
+                                     kwlist, &target, &data, &overrides,
+                                     &offset))
+    {
+        return NULL;
+    }
+
+    if (offset < 0)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "offset must be a non-negative integer");
+        return NULL;
+    }
+
+    NT_RenderContext *ctx = render_context_new(op, data, overrides);
+    if (!ctx)
+    {
+        return NULL;
+    }
+
+    buf = StringBuffer_acquire_utf8(initial_size(op, -1, true));
+    if (!buf || render_nodes(op, ctx, buf, PREFIX_INLINE) < 0)
+    {
+        goto cleanup;
+    }
+
+    update_size_estimate(op, buf);
+
+    const char *s = StringBuffer_utf8_data(buf);
+    Py_ssize_t size = StringBuffer_length(buf);
+    int rc = PyByteArray_Check(target)
+                 ? copy_into_bytearray(target, offset, s, size)
+                 : copy_into_buffer(target, offset, s, size);
+
+    if (rc == 0)
+    {
+        rv = Py_BuildValue("(nn)", size, offset + size);
+    }
+
+cleanup:
+    StringBuffer_release(buf);
+    NT_RenderContext_free(ctx);
+    return rv;
+}
+
+/// @brief Render template with data from the JSON object in `buf`, without
+/// first loading the whole document into Python objects.
+/// @param buf str | bytes | bytearray
+/// @param overrides Mapping[str, Any] | None
+/// @return The rendered string on success, or `NULL` on error with an
+/// exception set.
+static PyObject *NTPY_Template_render_json(PyObject *self, PyObject *args,
+                                           PyObject *kwargs)
+{
+    static char *kwlist[] = {"buf", "overrides", NULL};
+    PyObject *buf = NULL;
+    PyObject *overrides = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O:render_json", kwlist,
+                                     &buf, &overrides))
+    {
+        return NULL;
+    }
+
+    PyObject *data = NTPY_JSONView_parse(buf);
+    if (!data)
+    {
+        return NULL;
+    }
+
+    PyObject *rv =
+        render((NTPY_Template *)self, data, overrides, NULL, NULL, -1, 0,
+               PREFIX_INLINE, false);
+    Py_DECREF(data);
+    return rv;
+}
+
+/// @brief Render template with data from `data`, passing output to `write`
+/// as it is rendered. This is the synchronous half of async rendering, and
+/// is expected to run in a worker thread.
+/// @param write Callable[[str], object]
+/// @param aiter Callable[[AsyncIterable], Iterator] | None
+/// @param prefix bool, false if the static prefix has already been output.
+/// @return None on success, or `NULL` on error with an exception set.
+static PyObject *NTPY_Template_render_stream(PyObject *self, PyObject *args,
+                                             PyObject *kwargs)
+{
+    static char *kwlist[] = {"write", "data", "overrides", "aiter", "prefix",
+                             NULL};
+    PyObject *write = NULL;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    PyObject *aiter = Py_None;
+    int prefix = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|OOp:_render_stream",
+                                     kwlist, &write, &data, &overrides,
+                                     &aiter, &prefix))
+    {
+        return NULL;
+    }
+
+    return render((NTPY_Template *)self, data, overrides, write,
+                  aiter == Py_None ? NULL : aiter, -1, 0,
+                  prefix ? PREFIX_INLINE : PREFIX_OMIT, false);
+}
+
+/// @brief Return the callable that output for `sink` should be passed to:
+/// its `write` method if it has one, otherwise `sink` itself.
+/// @return New reference to the callable, or NULL on failure with an
+/// exception set.
+static PyObject *sink_write(PyObject *sink)
+{
+    PyObject *write = PyObject_GetAttrString(sink, "write");
+    if (write)
+    {
+        return write;
+    }
+
+    if (!PyErr_ExceptionMatches(PyExc_AttributeError))
+    {
+        return NULL;
+    }
+
+    PyErr_Clear();
+
+    if (!PyCallable_Check(sink))
+    {
+        PyErr_SetString(PyExc_TypeError,
+                        "expected a sink with a write method, or a callable");
+        return NULL;
+    }
+
+    return Py_NewRef(sink);
+}
+
+/// @brief Render template with data from `data`, passing output to `sink`
+/// in chunks of at least `chunk_size` characters, so the whole output is
+/// never held in memory at once.
+/// @param sink A file-like object with a `write` method, or a callable.
+/// @param chunk_size int
+/// @param flush_prefix bool, pass the static prefix on by itself first.
+/// @return None on success, or `NULL` on error with an exception set.
+static PyObject *NTPY_Template_render_to(PyObject *self, PyObject *args,
+                                         PyObject *kwargs)
+{
+    static char *kwlist[] = {"sink",       "data",         "overrides",
+                             "chunk_size", "flush_prefix", NULL};
+    PyObject *sink = NULL;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    Py_ssize_t chunk_size = NT_DEFAULT_CHUNK_SIZE;
+    int flush_prefix = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O$np:render_to",
+                                     kwlist, &sink, &data, &overrides,
+                                     &chunk_size, &flush_prefix))
+    {
+        return NULL;
+    }
+
+    if (chunk_size < 0)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "chunk_size must be a non-negative integer");
+        return NULL;
+    }
+
+    PyObject *write = sink_write(sink);
+    if (!write)
+    {
+        return NULL;
+    }
+
+    PyObject *rv =
+        render((NTPY_Template *)self, data, overrides, write, NULL, -1,
+               chunk_size, flush_prefix ? PREFIX_FLUSH : PREFIX_INLINE,
+               false);
+    Py_DECREF(write);
+    return rv;
+}
+
+/// @brief Set the `characters_written` attribute of the OSError being
+/// raised, if any, to `written`, as io does for BlockingIOError. Failing to
+/// set it leaves the original exception in place.
+static void set_characters_written(Py_ssize_t written)
+{
+    if (!PyErr_ExceptionMatches(PyExc_OSError))
+    {
+        return;
+    }
+
+    PyObject *type = NULL;
+    PyObject *value = NULL;
+    PyObject *traceback = NULL;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+
+    PyObject *count = PyLong_FromSsize_t(written);
+    if (!count ||
+        PyObject_SetAttrString(value, "characters_written", count) < 0)
+    {
+        PyErr_Clear();
+    }
+
+    Py_XDECREF(count);
+    PyErr_Restore(type, value, traceback);
+}
+
+/// @brief Render template with data from `data` as UTF-8, writing output
+/// to file descriptor `fd` in chunks of at least `chunk_size` bytes. Long
+/// literal text is written from where it was encoded at parse time, rather
+/// than being copied into the render buffer first.
+/// @param fd int, or an object with a `fileno` method.
+/// @param chunk_size int
+/// @param flush_prefix bool, write the static prefix by itself first.
+/// @return The number of bytes written, or `NULL` on error with an exception
+/// set. Output written before an error stays written, and an OSError's
+/// `characters_written` is the number of bytes that were.
+static PyObject *NTPY_Template_render_to_fd(PyObject *self, PyObject *args,
+                                            PyObject *kwargs)
+{
+    static char *kwlist[] = {"fd",         "data",         "overrides",
+                             "chunk_size", "flush_prefix", NULL};
+    NTPY_Template *op = (NTPY_Template *)self;
+    PyObject *fd_obj = NULL;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    Py_ssize_t chunk_size = NT_DEFAULT_CHUNK_SIZE;
+    NT_StringBuffer *buf = NULL;
+    PyObject *rv = NULL;
+    int flush_prefix = 0;
+    NT_FdSink sink;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|O$np:render_to_fd",
+                                     kwlist, &fd_obj, &data, &overrides,
+                                     &chunk_size, &flush_prefix))
+    {
+        return NULL;
+    }
+
+    if (chunk_size < 0)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "chunk_size must be a non-negative integer");
+        return NULL;
+    }
+
+    int fd = PyObject_AsFileDescriptor(fd_obj);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    NT_RenderContext *ctx = render_context_new(op, data, overrides);
+    if (!ctx)
+    {
+        return NULL;
+    }
+
+    NT_FdSink_init(&sink, fd, chunk_size);
+    ctx->sink = &sink.base;
+    ctx->chunk_size = chunk_size;
+
+    buf = StringBuffer_acquire_utf8(chunk_size);
+    if (!buf ||
+        render_nodes(op, ctx, buf,
+                     flush_prefix ? PREFIX_FLUSH : PREFIX_INLINE) < 0 ||
+        NT_RenderContext_flush(ctx, buf) < 0)
+    {
+        goto cleanup;
+    }
+
+    rv = PyLong_FromSsize_t(sink.written);
+
+cleanup:
+    if (!rv)
+    {
+        set_characters_written(sink.written);
+    }
+
+    StringBuffer_release(buf);
+    NT_RenderContext_free(ctx);
+    return rv;
+}
+
+/// @brief Render template with data from `data` as UTF-8, compressing it
+/// every `chunk_size` bytes, so neither the whole rendered string nor its
+/// encoding is held in memory.
+/// @param encoding "gzip" or "deflate", as used in HTTP Content-Encoding.
+/// @param level int, the zlib compression level.
+/// @param chunk_size int
+/// @param sink A file-like object with a `write` method, a callable, or
+/// None to return compressed output.
+/// @param flush_prefix bool, compress and pass on the static prefix by
+/// itself first.
+/// @return The compressed output, or None if it was passed to `sink`.
+/// `NULL` on error with an exception set.
+static PyObject *NTPY_Template_render_compressed(PyObject *self,
+                                                 PyObject *args,
+                                                 PyObject *kwargs)
+{
+    static char *kwlist[] = {"data",         "overrides",  "encoding",
+                             "level",        "chunk_size", "sink",
+                             "flush_prefix", NULL};
+    NTPY_Template *op = (NTPY_Template *)self;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    const char *encoding = "gzip";
+    int level = 6;
+    Py_ssize_t chunk_size = NT_DEFAULT_CHUNK_SIZE;
+    PyObject *sink_obj = Py_None;
+    int flush_prefix = 0;
+    PyObject *write = NULL;
+    NT_RenderContext *ctx = NULL;
+    NT_StringBuffer *buf = NULL;
+    PyObject *rv = NULL;
+    NT_CompressSink sink;
+    int wbits = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|O$sinOp:render_compressed", kwlist, &data,
+            &overrides, &encoding, &level, &chunk_size, &sink_obj,
+            &flush_prefix))
+    {
+        return NULL;
+    }
+
+    // Window sizes that select zlib's gzip and zlib containers.
+    if (strcmp(encoding, "gzip") == 0)
+    {
+        wbits = 31;
+    }
+    else if (strcmp(encoding, "deflate") == 0)
+    {
+        wbits = 15;
+    }
+    else
+    {
+        PyErr_Format(PyExc_ValueError,
+                     "expected encoding 'gzip' or 'deflate', found '%s'",
+                     encoding);
+        return NULL;
+    }
+
+    if (chunk_size < 0)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "chunk_size must be a non-negative integer");
+        return NULL;
+    }
+
+    if (sink_obj != Py_None)
+    {
+        write = sink_write(sink_obj);
+        if (!write)
+        {
+            return NULL;
+        }
+    }
+
+    int rc = NT_CompressSink_init(&sink, level, wbits, write);
+    Py_XDECREF(write);
+
+    if (rc < 0)
+    {
+        return NULL;
+    }
+
+    ctx = render_context_new(op, data, overrides);
+    if (!ctx)
+    {
+        goto cleanup;
+    }
+
+    ctx->sink = &sink.base;
+    ctx->chunk_size = chunk_size;
+
+    buf = StringBuffer_acquire_utf8(chunk_size);
+    if (!buf ||
+        render_nodes(op, ctx, buf,
+                     flush_prefix ? PREFIX_FLUSH : PREFIX_INLINE) < 0 ||
+        NT_RenderContext_flush(ctx, buf) < 0)
+    {
+        goto cleanup;
+    }
+
+    rv = NT_CompressSink_finish(&sink);
+
+cleanup:
+    StringBuffer_release(buf);
+    if (ctx)
+    {
+        NT_RenderContext_free(ctx);
+    }
+    NT_CompressSink_clear(&sink);
+    return rv;
+}
+
+/// @brief Render template with data from `data` one chunk at a time, each
+/// at least `chunk_size` characters long except the last. Rendering is
+/// paused between chunks.
+/// @param chunk_size int
+/// @param flush_prefix bool, yield the static prefix by itself first.
+/// @return An iterator of rendered chunks, or `NULL` on error with an
+/// exception set.
+static PyObject *NTPY_Template_iter_render(PyObject *self, PyObject *args,
+                                          PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "overrides", "chunk_size",
+                             "flush_prefix", NULL};
+    NTPY_Template *op = (NTPY_Template *)self;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    Py_ssize_t chunk_size = NT_DEFAULT_CHUNK_SIZE;
+    int flush_prefix = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O$np:iter_render",
+                                     kwlist, &data, &overrides, &chunk_size,
+                                     &flush_prefix))
+    {
+        return NULL;
+    }
+
+    if (chunk_size < 0)
+    {
+        PyErr_SetString(PyExc_ValueError,
+                        "chunk_size must be a non-negative integer");
+        return NULL;
+    }
+
+    NT_RenderContext *ctx = render_context_new(op, data, overrides);
+    if (!ctx)
+    {
+        return NULL;
+    }
+
+    return NTPY_RenderIterator_new(self, op->root, op->prefix, flush_prefix,
+                                   ctx, chunk_size);
+}
+
+/// @brief Return an iterator that renders template with data from `data`
+/// in a single chunk, consuming async iterables with `aiter`. If `aiter`
+/// raises, the render is paused at the for tag that called it, with output
+/// so far kept, and the next call to `next()` retries that for tag. This is
+/// how async rendering carries on a render that reaches an async iterable.
+/// @param aiter Callable[[AsyncIterable], Iterator]
+/// @return A RenderIterator, or `NULL` on error with an exception set.
+static PyObject *NTPY_Template_iter_stream(PyObject *self, PyObject *args,
+                                           PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "overrides", "aiter", NULL};
+    NTPY_Template *op = (NTPY_Template *)self;
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    PyObject *aiter = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO:_iter_stream",
+                                     kwlist, &data, &overrides, &aiter))
+    {
+        return NULL;
+    }
+
+    NT_RenderContext *ctx = render_context_new(op, data, overrides);
+    if (!ctx)
+    {
+        return NULL;
+    }
+
+    ctx->aiter = Py_NewRef(aiter);
+    return NTPY_RenderIterator_new(self, op->root, op->prefix, false, ctx,
+                                   PY_SSIZE_T_MAX);
+}
+
+/// @brief Call function `name` from nano_template._async with the template,
+/// `data`, `overrides` and keyword arguments `kwargs`, which can be NULL.
+/// Awaiting things is left to asyncio, in Python.
+/// @return The function's return value, or `NULL` on error with an exception
+/// set.
+static PyObject *call_async(PyObject *self, const char *name, PyObject *data,
+                            PyObject *overrides, PyObject *kwargs)
+{
+    PyObject *func = NULL;
+    PyObject *args = NULL;
+    PyObject *rv = NULL;
+
+    PyObject *module = PyImport_ImportModule("nano_template._async");
+    if (!module)
+    {
+        return NULL;
+    }
+
+    func = PyObject_GetAttrString(module, name);
+    Py_DECREF(module);
+    if (!func)
+    {
+        goto cleanup;
+    }
+
+    args = Py_BuildValue("(OOO)", self, data, overrides);
+    if (!args)
+    {
+        goto cleanup;
+    }
+
+    rv = PyObject_Call(func, args, kwargs);
+
+cleanup:
+    Py_XDECREF(func);
+    Py_XDECREF(args);
+    return rv;
+}
+
+/// @brief Render template with data from `data`, awaiting awaitables that
+/// the template would reach concurrently before rendering.
+/// @return An awaitable that resolves to the rendered string, or `NULL` on
+/// error with an exception set.
+static PyObject *NTPY_Template_render_async(PyObject *self, PyObject *args,
+                                            PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "overrides", NULL};
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O:render_async",
+                                     kwlist, &data, &overrides))
+    {
+        return NULL;
+    }
+
+    return call_async(self, "render_async", data, overrides, NULL);
+}
+
+/// @brief Render template with data from `data`, consuming async iterables
+/// in for tags.
+/// @param flush_prefix bool, yield the static prefix by itself before
+/// awaiting anything.
+/// @return An async iterator of rendered chunks, or `NULL` on error with an
+/// exception set.
+static PyObject *NTPY_Template_render_async_iter(PyObject *self,
+                                                 PyObject *args,
+                                                 PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "overrides", "flush_prefix", NULL};
+    PyObject *data = NULL;
+    PyObject *overrides = Py_None;
+    int flush_prefix = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O$p:render_async_iter",
+                                     kwlist, &data, &overrides,
+                                     &flush_prefix))
+    {
+        return NULL;
+    }
+
+    PyObject *call_kwargs = Py_BuildValue(
+        "{s:O}", "flush_prefix", flush_prefix ? Py_True : Py_False);
+    if (!call_kwargs)
+    {
+        return NULL;
+    }
+
+    PyObject *rv =
+        call_async(self, "render_async_iter", data, overrides, call_kwargs);
+    Py_DECREF(call_kwargs);
+    return rv;
+}
+
+static PyObject *Template_paths(PyObject *self, void *Py_UNUSED(closure))
+{
+    NTPY_Template *op = (NTPY_Template *)self;
+    return Py_NewRef(op->root_paths);
+}
+
+static PyObject *Template_static_prefix(PyObject *self,
+                                        void *Py_UNUSED(closure))
+{
+    NTPY_Template *op = (NTPY_Template *)self;
+
+    if (!op->prefix)
+    {
+        return PyUnicode_FromStringAndSize(NULL, 0);
+    }
+
+    return Py_NewRef(op->prefix);
+}
+
+static PyObject *Template_globals(PyObject *self, void *Py_UNUSED(closure))
+{
+    NTPY_Template *op = (NTPY_Template *)self;
+    return Py_NewRef(op->globals ? op->globals : Py_None);
+}
+
+static PyGetSetDef Template_getset[] = {
+    {"paths", Template_paths, NULL,
+     "Variable paths that are resolved from render data", NULL},
+    {"static_prefix", Template_static_prefix, NULL,
+     "Leading text that is output before any expression is evaluated",
+     NULL},
+    {"globals", Template_globals, NULL,
+     "Variables available to every render of the template, or None", NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
 static PyMethodDef Template_methods[] = {
-    {"render", NTPY_Template_render, METH_O, "Render the template"},
+    {"render", (PyCFunction)(void (*)(void))NTPY_Template_render,
+     METH_VARARGS | METH_KEYWORDS, "Render the template"},
+    {"render_bytes", (PyCFunction)(void (*)(void))NTPY_Template_render_bytes,
+     METH_VARARGS | METH_KEYWORDS, "Render the template to UTF-8 bytes"},
+    {"render_into", (PyCFunction)(void (*)(void))NTPY_Template_render_into,
+     METH_VARARGS | METH_KEYWORDS,
+     "Render the template to UTF-8, into a bytearray or writable buffer"},
+    {"render_json", (PyCFunction)(void (*)(void))NTPY_Template_render_json,
+     METH_VARARGS | METH_KEYWORDS, "Render the template with JSON data"},
+    {"render_to", (PyCFunction)(void (*)(void))NTPY_Template_render_to,
+     METH_VARARGS | METH_KEYWORDS,
+     "Render the template to a file-like object or callable"},
+    {"render_to_fd", (PyCFunction)(void (*)(void))NTPY_Template_render_to_fd,
+     METH_VARARGS | METH_KEYWORDS,
+     "Render the template to UTF-8, writing it to a file descriptor"},
+    {"render_compressed",
+     (PyCFunction)(void (*)(void))NTPY_Template_render_compressed,
+     METH_VARARGS | METH_KEYWORDS,
+     "Render the template to gzip or deflate compressed UTF-8"},
+    {"iter_render", (PyCFunction)(void (*)(void))NTPY_Template_iter_render,
+     METH_VARARGS | METH_KEYWORDS,
+     "Return an iterator of rendered chunks"},
+    {"_iter_stream", (PyCFunction)(void (*)(void))NTPY_Template_iter_stream,
+     METH_VARARGS | METH_KEYWORDS,
+     "Return an iterator that renders the template in a single chunk"},
+    {"_render_stream",
+     (PyCFunction)(void (*)(void))NTPY_Template_render_stream,
+     METH_VARARGS | METH_KEYWORDS, "Render the template to a callable"},
+    {"render_async", (PyCFunction)(void (*)(void))NTPY_Template_render_async,
+     METH_VARARGS | METH_KEYWORDS,
+     "Render the template after awaiting awaitables in data"},
+    {"render_async_iter",
+     (PyCFunction)(void (*)(void))NTPY_Template_render_async_iter,
+     METH_VARARGS | METH_KEYWORDS,
+     "Render the template asynchronously, one chunk at a time"},
     {NULL, NULL, 0, NULL}};
 
 static PyType_Slot Template_slots[] = {
     {Py_tp_doc, "Compiled template"},
-    {Py_tp_free, (void *)NTPY_Template_free},
+    {Py_tp_dealloc, (void *)Template_dealloc},
+    {Py_tp_traverse, (void *)Template_traverse},
+    {Py_tp_clear, (void *)Template_clear},
     {Py_tp_methods, Template_methods},
+    {Py_tp_getset, Template_getset},
     {0, NULL}};
 
 static PyType_Spec Template_spec = {
     .name = "nano_template.Template",
     .basicsize = sizeof(NTPY_Template),
-    .flags = Py_TPFLAGS_DEFAULT,
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
     .slots = Template_slots,
 };
 
@@ -2,33 +2,1138 @@
 
 #include "nano_template/string_buffer.h"
 
-PyObject *StringBuffer_new()
+/// @brief The smallest number of characters we allocate.
+#define NT_STRING_BUFFER_MIN_CAPACITY 256
+
+/// @brief The most bytes of storage a thread's scratch buffer can keep.
+#define NT_SCRATCH_MAX_SIZE (16 * 1024 * 1024)
+
+/// @brief How many renders pass between checks for oversized scratch
+/// storage.
+#define NT_SCRATCH_TRIM_INTERVAL 32
+
+/// @brief A thread's cached scratch buffer. Slots are kept in thread state
+/// dicts, wrapped in a capsule, so they are freed with their thread.
+typedef struct NT_ScratchSlot
+{
+    NT_StringBuffer *buf; // NULL while the buffer is in use
+    Py_ssize_t peak;      // Most characters a render needed this interval
+    int renders;          // Renders since the last trim check
+} NT_ScratchSlot;
+
+static const char *SCRATCH_CAPSULE_NAME = "nano_template.scratch";
+
+/// @brief The longest string we encode to UTF-8 ourselves with the limited
+/// API, rather than building an intermediate bytes object.
+#define NT_ENCODE_MAX_CHARS 256
+
+#ifdef Py_LIMITED_API
+
+/// @brief The width of Latin-1 characters stored with the limited API, in
+/// bytes.
+#define NT_KIND_LATIN1 1
+
+/// @brief The width of UCS4 characters stored with the limited API, in
+/// bytes.
+#define NT_KIND_UCS4 4
+
+#endif
+
+// Thread state dict keys for character and UTF-8 scratch slots.
+static PyObject *scratch_key = NULL;
+static PyObject *scratch_utf8_key = NULL;
+
+// Each of the following has one implementation per character storage
+// backend, and is only called for buffers that aren't in UTF-8 mode.
+
+/// @brief Append a string's characters to the buffer.
+static int StringBuffer_append_chars(NT_StringBuffer *sb, PyObject *str);
+
+/// @brief Build a string from the buffer's contents and empty the buffer.
+static PyObject *StringBuffer_build_chars(NT_StringBuffer *sb);
+
+/// @brief Make sure empty buffer `sb` has room for `capacity` characters
+/// up to `maxchar`.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_presize_chars(NT_StringBuffer *sb,
+                                      Py_ssize_t capacity, Py_UCS4 maxchar);
+
+/// @brief Discard the buffer's contents, keeping its storage.
+static void StringBuffer_clear_chars(NT_StringBuffer *sb);
+
+/// @brief Return the number of bytes of storage held by the buffer.
+static size_t StringBuffer_storage_chars(const NT_StringBuffer *sb);
+
+/// @brief Free the buffer's storage. The buffer must be empty.
+static void StringBuffer_release_storage_chars(NT_StringBuffer *sb);
+
+/// @brief Make room for at least `extra` more bytes in UTF-8 buffer `sb`.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_reserve_bytes(NT_StringBuffer *sb, Py_ssize_t extra)
 {
-    return PyList_New(0);
+    if (sb->capacity - sb->length >= extra)
+    {
+        return 0;
+    }
+
+    if (sb->length > PY_SSIZE_T_MAX - extra)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    Py_ssize_t capacity =
+        sb->capacity ? sb->capacity * 2 : NT_STRING_BUFFER_MIN_CAPACITY;
+
+    if (capacity - sb->length < extra)
+    {
+        capacity = sb->length + extra;
+    }
+
+    char *bytes = PyMem_Realloc(sb->bytes, (size_t)capacity);
+    if (!bytes)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    sb->bytes = bytes;
+    sb->capacity = capacity;
+    return 0;
 }
 
-int StringBuffer_append(PyObject *sb, PyObject *str)
+#ifdef Py_LIMITED_API
+
+/// @brief Append `str`, encoded to UTF-8 by Python, to UTF-8 buffer `sb`.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_encode_with_bytes(NT_StringBuffer *sb, PyObject *str)
 {
-    return PyList_Append(sb, str);
+    PyObject *bytes = PyUnicode_AsUTF8String(str);
+    if (!bytes)
+    {
+        return -1;
+    }
+
+    int rv = StringBuffer_append_utf8(sb, PyBytes_AsString(bytes),
+                                      PyBytes_Size(bytes));
+    Py_DECREF(bytes);
+    return rv;
 }
 
-PyObject *StringBuffer_finish(PyObject *sb)
+#endif
+
+/// @brief Append `str` encoded as UTF-8 to UTF-8 buffer `sb`. Lone
+/// surrogates can't be encoded, and raise a UnicodeEncodeError, as they do
+/// with `str.encode()`.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_encode(NT_StringBuffer *sb, PyObject *str)
 {
+#ifndef Py_LIMITED_API
+    // ASCII strings are their own UTF-8, and other strings cache their
+    // encoding, so this doesn't usually allocate.
+    Py_ssize_t size = 0;
+    const char *s = PyUnicode_AsUTF8AndSize(str, &size);
+    if (!s)
+    {
+        return -1;
+    }
+
+    return StringBuffer_append_utf8(sb, s, size);
+#else
+    Py_ssize_t length = PyUnicode_GetLength(str);
+    if (length <= 0)
+    {
+        return (int)length;
+    }
+
+    if (length > NT_ENCODE_MAX_CHARS)
+    {
+        return StringBuffer_encode_with_bytes(sb, str);
+    }
+
+    // Short strings, like most serialized values, are copied out and
+    // encoded here, without allocating.
+    Py_UCS4 chars[NT_ENCODE_MAX_CHARS];
+    if (!PyUnicode_AsUCS4(str, chars, NT_ENCODE_MAX_CHARS, 0))
+    {
+        return -1;
+    }
+
+    if (StringBuffer_reserve_bytes(sb, length * 4) < 0)
+    {
+        return -1;
+    }
+
+    unsigned char *dest = (unsigned char *)sb->bytes + sb->length;
+
+    for (Py_ssize_t i = 0; i < length; i++)
+    {
+        Py_UCS4 ch = chars[i];
+
+        if (ch < 0x80)
+        {
+            *dest++ = (unsigned char)ch;
+        }
+        else if (ch < 0x800)
+        {
+            *dest++ = (unsigned char)(0xc0 | (ch >> 6));
+            *dest++ = (unsigned char)(0x80 | (ch & 0x3f));
+        }
+        else if (ch < 0x10000)
+        {
+            if (ch >= 0xd800 && ch <= 0xdfff)
+            {
+                // Let Python raise its usual error.
+                return StringBuffer_encode_with_bytes(sb, str);
+            }
+
+            *dest++ = (unsigned char)(0xe0 | (ch >> 12));
+            *dest++ = (unsigned char)(0x80 | ((ch >> 6) & 0x3f));
+            *dest++ = (unsigned char)(0x80 | (ch & 0x3f));
+        }
+        else
+        {
+            *dest++ = (unsigned char)(0xf0 | (ch >> 18));
+            *dest++ = (unsigned char)(0x80 | ((ch >> 12) & 0x3f));
+            *dest++ = (unsigned char)(0x80 | ((ch >> 6) & 0x3f));
+            *dest++ = (unsigned char)(0x80 | (ch & 0x3f));
+        }
+    }
+
+    sb->length = (Py_ssize_t)((char *)dest - sb->bytes);
+    return 0;
+#endif
+}
+
+int StringBuffer_append(NT_StringBuffer *sb, PyObject *str)
+{
+    if (sb->utf8)
+    {
+        return StringBuffer_encode(sb, str);
+    }
+
+    return StringBuffer_append_chars(sb, str);
+}
+
+int StringBuffer_append_utf8(NT_StringBuffer *sb, const char *s,
+                             Py_ssize_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    if (!sb->utf8)
+    {
+        PyObject *str = PyUnicode_DecodeUTF8(s, size, NULL);
+        if (!str)
+        {
+            return -1;
+        }
+
+        int rv = StringBuffer_append_chars(sb, str);
+        Py_DECREF(str);
+        return rv;
+    }
+
+    if (StringBuffer_reserve_bytes(sb, size) < 0)
+    {
+        return -1;
+    }
+
+    memcpy(sb->bytes + sb->length, s, (size_t)size);
+    sb->length += size;
+    return 0;
+}
+
+static PyObject *StringBuffer_build(NT_StringBuffer *sb)
+{
+    if (!sb->utf8)
+    {
+        return StringBuffer_build_chars(sb);
+    }
+
+    PyObject *result = PyBytes_FromStringAndSize(sb->bytes, sb->length);
+    sb->length = 0;
+    return result;
+}
+
+static int StringBuffer_presize(NT_StringBuffer *sb, Py_ssize_t capacity,
+                                Py_UCS4 maxchar)
+{
+    if (!sb->utf8)
+    {
+        return StringBuffer_presize_chars(sb, capacity, maxchar);
+    }
+
+    return StringBuffer_reserve_bytes(sb, capacity);
+}
+
+static void StringBuffer_clear(NT_StringBuffer *sb)
+{
+    if (!sb->utf8)
+    {
+        StringBuffer_clear_chars(sb);
+        return;
+    }
+
+    sb->length = 0;
+}
+
+static size_t StringBuffer_storage(const NT_StringBuffer *sb)
+{
+    if (!sb->utf8)
+    {
+        return StringBuffer_storage_chars(sb);
+    }
+
+    return (size_t)sb->capacity;
+}
+
+static void StringBuffer_release_storage(NT_StringBuffer *sb)
+{
+    if (!sb->utf8)
+    {
+        StringBuffer_release_storage_chars(sb);
+        return;
+    }
+
+    PyMem_Free(sb->bytes);
+    sb->bytes = NULL;
+    sb->capacity = 0;
+}
+
+NT_StringBuffer *StringBuffer_new(void)
+{
+    return StringBuffer_new_sized(0, 0);
+}
+
+/// @brief Allocate a new empty buffer, in UTF-8 mode if `utf8` is true.
+/// @return The new buffer, or NULL on failure with an exception set.
+static NT_StringBuffer *StringBuffer_alloc(bool utf8, Py_ssize_t capacity,
+                                           Py_UCS4 maxchar)
+{
+    NT_StringBuffer *sb = PyMem_Malloc(sizeof(NT_StringBuffer));
     if (!sb)
     {
+        PyErr_NoMemory();
         return NULL;
     }
 
-    PyObject *empty = PyUnicode_FromString("");
-    if (!empty)
+#if !defined(Py_LIMITED_API) && PY_VERSION_HEX >= 0x030E0000
+    sb->writer = NULL;
+#elif !defined(Py_LIMITED_API)
+    sb->data = NULL;
+    sb->kind = PyUnicode_1BYTE_KIND;
+    sb->maxchar = 0;
+#else
+    sb->data = NULL;
+    sb->kind = NT_KIND_LATIN1;
+    sb->maxchar = 0;
+#endif
+    sb->bytes = NULL;
+    sb->utf8 = utf8;
+    sb->length = 0;
+    sb->capacity = 0;
+    sb->peak = 0;
+
+    if (capacity > 0 && StringBuffer_presize(sb, capacity, maxchar) < 0)
     {
-        Py_DECREF(sb);
+        StringBuffer_free(sb);
         return NULL;
     }
 
-    PyObject *result = PyUnicode_Join(empty, sb);
+    return sb;
+}
+
+NT_StringBuffer *StringBuffer_new_sized(Py_ssize_t capacity, Py_UCS4 maxchar)
+{
+    return StringBuffer_alloc(false, capacity, maxchar);
+}
+
+NT_StringBuffer *StringBuffer_new_utf8(Py_ssize_t capacity)
+{
+    return StringBuffer_alloc(true, capacity, 0);
+}
+
+void StringBuffer_free(NT_StringBuffer *sb)
+{
+    if (!sb)
+    {
+        return;
+    }
+
+#if !defined(Py_LIMITED_API) && PY_VERSION_HEX >= 0x030E0000
+    PyUnicodeWriter_Discard(sb->writer);
+#else
+    PyMem_Free(sb->data);
+#endif
+    PyMem_Free(sb->bytes);
+    PyMem_Free(sb);
+}
+
+/// @brief Record the buffer's current length in its high-water mark.
+static inline void StringBuffer_note_peak(NT_StringBuffer *sb)
+{
+    if (sb->length > sb->peak)
+    {
+        sb->peak = sb->length;
+    }
+}
+
+void StringBuffer_reset(NT_StringBuffer *sb)
+{
+    StringBuffer_note_peak(sb);
+    StringBuffer_clear(sb);
+}
+
+PyObject *StringBuffer_flush(NT_StringBuffer *sb)
+{
+    StringBuffer_note_peak(sb);
+    return StringBuffer_build(sb);
+}
 
-    Py_DECREF(empty);
-    Py_DECREF(sb);
+PyObject *StringBuffer_finish(NT_StringBuffer *sb)
+{
+    if (!sb)
+    {
+        return NULL;
+    }
+
+    PyObject *result = StringBuffer_build(sb);
+    StringBuffer_free(sb);
     return result;
-}
\ No newline at end of file
+}
+
+static void scratch_capsule_destructor(PyObject *capsule)
+{
+    NT_ScratchSlot *slot =
+        PyCapsule_GetPointer(capsule, SCRATCH_CAPSULE_NAME);
+
+    if (slot)
+    {
+        StringBuffer_free(slot->buf);
+        PyMem_Free(slot);
+    }
+}
+
+int nt_init_scratch_buffers(void)
+{
+    if (!scratch_key)
+    {
+        scratch_key = PyUnicode_InternFromString(SCRATCH_CAPSULE_NAME);
+        if (!scratch_key)
+        {
+            return -1;
+        }
+    }
+
+    if (!scratch_utf8_key)
+    {
+        scratch_utf8_key =
+            PyUnicode_InternFromString("nano_template.scratch_utf8");
+        if (!scratch_utf8_key)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/// @brief Find the current thread's scratch slot for character buffers, or
+/// for UTF-8 buffers if `utf8` is true, creating it if `create` is true.
+/// @return The slot, or NULL if there is no slot or no thread state dict.
+/// NULL with an exception set on error.
+static NT_ScratchSlot *scratch_slot(bool utf8, bool create)
+{
+    PyObject *key = utf8 ? scratch_utf8_key : scratch_key;
+    PyObject *dict = PyThreadState_GetDict();
+    if (!dict || !key)
+    {
+        return NULL;
+    }
+
+    PyObject *capsule = PyDict_GetItemWithError(dict, key);
+    if (capsule)
+    {
+        return PyCapsule_GetPointer(capsule, SCRATCH_CAPSULE_NAME);
+    }
+
+    if (PyErr_Occurred() || !create)
+    {
+        return NULL;
+    }
+
+    NT_ScratchSlot *slot = PyMem_Malloc(sizeof(NT_ScratchSlot));
+    if (!slot)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    slot->buf = NULL;
+    slot->peak = 0;
+    slot->renders = 0;
+
+    capsule = PyCapsule_New(slot, SCRATCH_CAPSULE_NAME,
+                            scratch_capsule_destructor);
+    if (!capsule)
+    {
+        PyMem_Free(slot);
+        return NULL;
+    }
+
+    int rv = PyDict_SetItem(dict, key, capsule);
+    Py_DECREF(capsule);
+    return rv < 0 ? NULL : slot;
+}
+
+/// @brief Take the current thread's scratch buffer of the given mode, or
+/// allocate a new one.
+/// @return An empty buffer, or NULL on failure with an exception set.
+static NT_StringBuffer *scratch_acquire(bool utf8, Py_ssize_t capacity,
+                                       Py_UCS4 maxchar)
+{
+    NT_ScratchSlot *slot = scratch_slot(utf8, true);
+    if (!slot && PyErr_Occurred())
+    {
+        return NULL;
+    }
+
+    if (!slot || !slot->buf)
+    {
+        // A new thread, or an enclosing render is using the slot's buffer.
+        return StringBuffer_alloc(utf8, capacity, maxchar);
+    }
+
+    NT_StringBuffer *sb = slot->buf;
+
+    if (capacity > 0 && StringBuffer_presize(sb, capacity, maxchar) < 0)
+    {
+        return NULL;
+    }
+
+    slot->buf = NULL;
+    return sb;
+}
+
+NT_StringBuffer *StringBuffer_acquire(Py_ssize_t capacity, Py_UCS4 maxchar)
+{
+    return scratch_acquire(false, capacity, maxchar);
+}
+
+NT_StringBuffer *StringBuffer_acquire_utf8(Py_ssize_t capacity)
+{
+    return scratch_acquire(true, capacity, 0);
+}
+
+void StringBuffer_release(NT_StringBuffer *sb)
+{
+    if (!sb)
+    {
+        return;
+    }
+
+    StringBuffer_note_peak(sb);
+    StringBuffer_clear(sb);
+
+    // Don't disturb a pending exception by looking up the slot. The buffer
+    // is freed, and the slot gets a new one after the next render.
+    NT_ScratchSlot *slot = NULL;
+
+    if (!PyErr_Occurred())
+    {
+        slot = scratch_slot(sb->utf8, false);
+        if (!slot)
+        {
+            PyErr_Clear();
+        }
+    }
+
+    if (!slot || slot->buf)
+    {
+        StringBuffer_free(sb);
+        return;
+    }
+
+    if (sb->peak > slot->peak)
+    {
+        slot->peak = sb->peak;
+    }
+
+    sb->peak = 0;
+
+    if (++slot->renders >= NT_SCRATCH_TRIM_INTERVAL)
+    {
+        // Let go of storage that recent renders haven't come close to
+        // needing. The next render sizes a new buffer from its hint.
+        if (sb->capacity / 2 > slot->peak)
+        {
+            StringBuffer_release_storage(sb);
+        }
+
+        slot->peak = 0;
+        slot->renders = 0;
+    }
+
+    if (StringBuffer_storage(sb) > NT_SCRATCH_MAX_SIZE)
+    {
+        StringBuffer_release_storage(sb);
+    }
+
+    slot->buf = sb;
+}
+
+#if !defined(Py_LIMITED_API) && PY_VERSION_HEX >= 0x030E0000
+
+static int StringBuffer_append_chars(NT_StringBuffer *sb,
+                                     PyObject *str)
+{
+    Py_ssize_t length = PyUnicode_GET_LENGTH(str);
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    if (!sb->writer)
+    {
+        sb->writer = PyUnicodeWriter_Create(sb->capacity);
+        if (!sb->writer)
+        {
+            return -1;
+        }
+    }
+
+    if (PyUnicodeWriter_WriteStr(sb->writer, str) < 0)
+    {
+        return -1;
+    }
+
+    sb->length += length;
+    return 0;
+}
+
+static int StringBuffer_presize_chars(NT_StringBuffer *sb,
+                                      Py_ssize_t capacity,
+                                      Py_UCS4 Py_UNUSED(maxchar))
+{
+    // The writer is created with this capacity on first append.
+    sb->capacity = capacity;
+    return 0;
+}
+
+static void StringBuffer_clear_chars(NT_StringBuffer *sb)
+{
+    PyUnicodeWriter_Discard(sb->writer);
+    sb->writer = NULL;
+    sb->length = 0;
+}
+
+static size_t
+StringBuffer_storage_chars(const NT_StringBuffer *Py_UNUSED(sb))
+{
+    // Writers are consumed when they are finished, so there's nothing to
+    // keep between renders.
+    return 0;
+}
+
+static void StringBuffer_release_storage_chars(NT_StringBuffer *sb)
+{
+    sb->capacity = 0;
+}
+
+Py_UCS4 StringBuffer_maxchar(const NT_StringBuffer *Py_UNUSED(sb))
+{
+    return 0;
+}
+
+static PyObject *StringBuffer_build_chars(NT_StringBuffer *sb)
+{
+    PyUnicodeWriter *writer = sb->writer;
+    sb->writer = NULL;
+    sb->length = 0;
+
+    if (!writer)
+    {
+        return PyUnicode_FromStringAndSize(NULL, 0);
+    }
+
+    return PyUnicodeWriter_Finish(writer);
+}
+
+#elif !defined(Py_LIMITED_API)
+
+/// @brief Make room for at least `extra` more characters of width `kind`,
+/// widening existing characters if `kind` is wider than the buffer's.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_reserve(NT_StringBuffer *sb, Py_ssize_t extra,
+                                int kind)
+{
+    bool widen = kind > sb->kind;
+
+    if (!widen && sb->capacity - sb->length >= extra)
+    {
+        return 0;
+    }
+
+    if (sb->length > PY_SSIZE_T_MAX / 4 - extra)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    Py_ssize_t capacity = sb->capacity;
+
+    if (capacity - sb->length < extra)
+    {
+        capacity = capacity ? capacity * 2 : NT_STRING_BUFFER_MIN_CAPACITY;
+        if (capacity - sb->length < extra)
+        {
+            capacity = sb->length + extra;
+        }
+    }
+
+    if (!widen)
+    {
+        void *data = PyMem_Realloc(sb->data, (size_t)(capacity * sb->kind));
+        if (!data)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+
+        sb->data = data;
+        sb->capacity = capacity;
+        return 0;
+    }
+
+    void *data = PyMem_Malloc((size_t)(capacity * kind));
+    if (!data)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (Py_ssize_t i = 0; i < sb->length; i++)
+    {
+        PyUnicode_WRITE(kind, data, i, PyUnicode_READ(sb->kind, sb->data, i));
+    }
+
+    PyMem_Free(sb->data);
+    sb->data = data;
+    sb->kind = kind;
+    sb->capacity = capacity;
+    return 0;
+}
+
+static int StringBuffer_append_chars(NT_StringBuffer *sb,
+                                     PyObject *str)
+{
+    Py_ssize_t length = PyUnicode_GET_LENGTH(str);
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    int kind = PyUnicode_KIND(str);
+
+    if (StringBuffer_reserve(sb, length, kind) < 0)
+    {
+        return -1;
+    }
+
+    const void *src = PyUnicode_DATA(str);
+    char *dest = (char *)sb->data + sb->length * sb->kind;
+
+    if (kind == sb->kind)
+    {
+        memcpy(dest, src, (size_t)(length * kind));
+    }
+    else
+    {
+        for (Py_ssize_t i = 0; i < length; i++)
+        {
+            PyUnicode_WRITE(sb->kind, dest, i, PyUnicode_READ(kind, src, i));
+        }
+    }
+
+    Py_UCS4 maxchar = PyUnicode_MAX_CHAR_VALUE(str);
+    if (maxchar > sb->maxchar)
+    {
+        sb->maxchar = maxchar;
+    }
+
+    sb->length += length;
+    return 0;
+}
+
+static int StringBuffer_presize_chars(NT_StringBuffer *sb,
+                                      Py_ssize_t capacity, Py_UCS4 maxchar)
+{
+    int kind = PyUnicode_1BYTE_KIND;
+
+    if (maxchar > 0xffff)
+    {
+        kind = PyUnicode_4BYTE_KIND;
+    }
+    else if (maxchar > 0xff)
+    {
+        kind = PyUnicode_2BYTE_KIND;
+    }
+
+    if (kind < sb->kind)
+    {
+        // Nothing is stored, so narrower characters can reuse the memory.
+        sb->capacity = sb->capacity * sb->kind / kind;
+        sb->kind = kind;
+    }
+
+    return StringBuffer_reserve(sb, capacity, kind);
+}
+
+static void StringBuffer_clear_chars(NT_StringBuffer *sb)
+{
+    sb->length = 0;
+    sb->maxchar = 0;
+
+    // Start again from the narrowest kind, reusing the same memory, so
+    // `kind` never claims to be wider than `maxchar` once output is built.
+    sb->capacity = sb->capacity * sb->kind;
+    sb->kind = PyUnicode_1BYTE_KIND;
+}
+
+static size_t StringBuffer_storage_chars(const NT_StringBuffer *sb)
+{
+    return (size_t)(sb->capacity * sb->kind);
+}
+
+static void StringBuffer_release_storage_chars(NT_StringBuffer *sb)
+{
+    PyMem_Free(sb->data);
+    sb->data = NULL;
+    sb->kind = PyUnicode_1BYTE_KIND;
+    sb->capacity = 0;
+}
+
+Py_UCS4 StringBuffer_maxchar(const NT_StringBuffer *sb)
+{
+    return sb->maxchar;
+}
+
+static PyObject *StringBuffer_build_chars(NT_StringBuffer *sb)
+{
+    PyObject *result = PyUnicode_New(sb->length, sb->maxchar);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    // A presized buffer can be wider than its contents need.
+    int kind = PyUnicode_KIND(result);
+    void *data = PyUnicode_DATA(result);
+
+    if (kind == sb->kind)
+    {
+        memcpy(data, sb->data, (size_t)(sb->length * kind));
+    }
+    else
+    {
+        for (Py_ssize_t i = 0; i < sb->length; i++)
+        {
+            PyUnicode_WRITE(kind, data, i,
+                            PyUnicode_READ(sb->kind, sb->data, i));
+        }
+    }
+
+    StringBuffer_clear_chars(sb);
+    return result;
+}
+
+#else
+
+// The limited API can't write a str's characters directly, and decoding
+// UTF-16 would join surrogate pairs that were appended as lone surrogates,
+// so characters are stored as Latin-1, or as UCS4 once any character needs
+// more than a byte.
+
+/// @brief Make room for at least `extra` more characters of width `kind`,
+/// widening existing characters if `kind` is wider than the buffer's.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_reserve(NT_StringBuffer *sb, Py_ssize_t extra,
+                                int kind)
+{
+    bool widen = kind > sb->kind;
+
+    if (!widen && sb->capacity - sb->length >= extra)
+    {
+        return 0;
+    }
+
+    if (sb->length > PY_SSIZE_T_MAX / NT_KIND_UCS4 - extra)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    Py_ssize_t capacity = sb->capacity;
+
+    if (capacity - sb->length < extra)
+    {
+        capacity = capacity ? capacity * 2 : NT_STRING_BUFFER_MIN_CAPACITY;
+        if (capacity - sb->length < extra)
+        {
+            capacity = sb->length + extra;
+        }
+    }
+
+    if (!widen)
+    {
+        void *data = PyMem_Realloc(sb->data, (size_t)(capacity * sb->kind));
+        if (!data)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+
+        sb->data = data;
+        sb->capacity = capacity;
+        return 0;
+    }
+
+    Py_UCS4 *data = PyMem_Malloc(sizeof(Py_UCS4) * (size_t)capacity);
+    if (!data)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    const Py_UCS1 *src = sb->data;
+    for (Py_ssize_t i = 0; i < sb->length; i++)
+    {
+        data[i] = src[i];
+    }
+
+    PyMem_Free(sb->data);
+    sb->data = data;
+    sb->kind = NT_KIND_UCS4;
+    sb->capacity = capacity;
+    return 0;
+}
+
+/// @brief Raise `sb`'s bound on the largest character appended to it to
+/// `maxchar`, if that is larger.
+static inline void StringBuffer_note_maxchar(NT_StringBuffer *sb,
+                                             Py_UCS4 maxchar)
+{
+    if (maxchar > sb->maxchar)
+    {
+        sb->maxchar = maxchar;
+    }
+}
+
+/// @brief Return a bound on the largest of `length` characters at `s`, as
+/// PyUnicode_MAX_CHAR_VALUE gives with the full API. The bound is less
+/// than twice the largest character, and below 0x100 only if every
+/// character is Latin-1.
+static Py_UCS4 ucs4_maxchar(const Py_UCS4 *s, Py_ssize_t length)
+{
+    Py_UCS4 bits = 0;
+
+    for (Py_ssize_t i = 0; i < length; i++)
+    {
+        bits |= s[i];
+    }
+
+    return bits > 0x10ffff ? 0x10ffff : bits;
+}
+
+/// @brief Copy `length` characters of `str` straight into `sb` as UCS4,
+/// widening the buffer if it is narrower.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_append_ucs4(NT_StringBuffer *sb, PyObject *str,
+                                    Py_ssize_t length)
+{
+    if (StringBuffer_reserve(sb, length, NT_KIND_UCS4) < 0)
+    {
+        return -1;
+    }
+
+    Py_UCS4 *dest = (Py_UCS4 *)sb->data + sb->length;
+    if (!PyUnicode_AsUCS4(str, dest, sb->capacity - sb->length, 0))
+    {
+        return -1;
+    }
+
+    StringBuffer_note_maxchar(sb, ucs4_maxchar(dest, length));
+    sb->length += length;
+    return 0;
+}
+
+/// @brief Append `str` to Latin-1 buffer `sb`, encoded to Latin-1 by
+/// Python, widening the buffer if `str` can't be encoded.
+/// @return 0 on success, -1 on failure with an exception set.
+static int StringBuffer_append_latin1(NT_StringBuffer *sb, PyObject *str,
+                                      Py_ssize_t length)
+{
+    PyObject *bytes = PyUnicode_AsLatin1String(str);
+    if (!bytes)
+    {
+        if (!PyErr_ExceptionMatches(PyExc_UnicodeEncodeError))
+        {
+            return -1;
+        }
+
+        PyErr_Clear();
+        return StringBuffer_append_ucs4(sb, str, length);
+    }
+
+    const Py_UCS1 *src = (const Py_UCS1 *)PyBytes_AsString(bytes);
+    if (!src || StringBuffer_reserve(sb, length, NT_KIND_LATIN1) < 0)
+    {
+        Py_DECREF(bytes);
+        return -1;
+    }
+
+    Py_UCS1 *dest = (Py_UCS1 *)sb->data + sb->length;
+    Py_UCS1 bits = 0;
+
+    // A bound on the largest character, like ucs4_maxchar's.
+    for (Py_ssize_t i = 0; i < length; i++)
+    {
+        dest[i] = src[i];
+        bits |= src[i];
+    }
+
+    Py_DECREF(bytes);
+    StringBuffer_note_maxchar(sb, bits);
+    sb->length += length;
+    return 0;
+}
+
+static int StringBuffer_append_chars(NT_StringBuffer *sb,
+                                     PyObject *str)
+{
+    Py_ssize_t length = PyUnicode_GetLength(str);
+    if (length <= 0)
+    {
+        return (int)length;
+    }
+
+    if (sb->kind == NT_KIND_UCS4)
+    {
+        return StringBuffer_append_ucs4(sb, str, length);
+    }
+
+    if (length > NT_ENCODE_MAX_CHARS)
+    {
+        return StringBuffer_append_latin1(sb, str, length);
+    }
+
+    // Short strings, like most serialized values, are copied out and
+    // narrowed here, without allocating.
+    Py_UCS4 chars[NT_ENCODE_MAX_CHARS];
+    if (!PyUnicode_AsUCS4(str, chars, NT_ENCODE_MAX_CHARS, 0))
+    {
+        return -1;
+    }
+
+    Py_UCS4 maxchar = ucs4_maxchar(chars, length);
+    int kind = maxchar > 0xff ? NT_KIND_UCS4 : NT_KIND_LATIN1;
+
+    if (StringBuffer_reserve(sb, length, kind) < 0)
+    {
+        return -1;
+    }
+
+    if (kind == NT_KIND_UCS4)
+    {
+        memcpy((Py_UCS4 *)sb->data + sb->length, chars,
+               sizeof(Py_UCS4) * (size_t)length);
+    }
+    else
+    {
+        Py_UCS1 *dest = (Py_UCS1 *)sb->data + sb->length;
+        for (Py_ssize_t i = 0; i < length; i++)
+        {
+            dest[i] = (Py_UCS1)chars[i];
+        }
+    }
+
+    StringBuffer_note_maxchar(sb, maxchar);
+    sb->length += length;
+    return 0;
+}
+
+static int StringBuffer_presize_chars(NT_StringBuffer *sb,
+                                      Py_ssize_t capacity, Py_UCS4 maxchar)
+{
+    int kind = maxchar > 0xff ? NT_KIND_UCS4 : NT_KIND_LATIN1;
+
+    if (kind < sb->kind)
+    {
+        // Nothing is stored, so narrower characters can reuse the memory.
+        sb->capacity = sb->capacity * sb->kind / kind;
+        sb->kind = kind;
+    }
+
+    return StringBuffer_reserve(sb, capacity, kind);
+}
+
+static void StringBuffer_clear_chars(NT_StringBuffer *sb)
+{
+    sb->length = 0;
+    sb->maxchar = 0;
+
+    // Start again from Latin-1, reusing the same memory.
+    sb->capacity = sb->capacity * sb->kind;
+    sb->kind = NT_KIND_LATIN1;
+}
+
+static size_t StringBuffer_storage_chars(const NT_StringBuffer *sb)
+{
+    return (size_t)(sb->capacity * sb->kind);
+}
+
+static void StringBuffer_release_storage_chars(NT_StringBuffer *sb)
+{
+    PyMem_Free(sb->data);
+    sb->data = NULL;
+    sb->kind = NT_KIND_LATIN1;
+    sb->capacity = 0;
+}
+
+Py_UCS4 StringBuffer_maxchar(const NT_StringBuffer *sb)
+{
+    return sb->maxchar;
+}
+
+static PyObject *StringBuffer_build_chars(NT_StringBuffer *sb)
+{
+    PyObject *result = NULL;
+
+    if (sb->kind == NT_KIND_LATIN1)
+    {
+        result =
+            PyUnicode_DecodeLatin1((const char *)sb->data, sb->length, NULL);
+    }
+    else
+    {
+#if PY_LITTLE_ENDIAN
+        int byteorder = -1;
+#else
+        int byteorder = 1;
+#endif
+
+        // Strings can hold lone surrogates, which aren't valid UTF-32.
+        result = PyUnicode_DecodeUTF32(
+            (const char *)sb->data,
+            sb->length * (Py_ssize_t)sizeof(Py_UCS4), "surrogatepass",
+            &byteorder);
+    }
+
+    StringBuffer_clear_chars(sb);
+    return result;
+}
+
+#endif
@@ -32,7 +32,7 @@ static PyObject *decode_escape(PyObject *str, Py_ssize_t *pos,
 PyObject *unescape(const NT_Token *token, PyObject *source)
 {
     PyObject *result = NULL;
-    PyObject *buf = NULL;
+    NT_StringBuffer *buf = NULL;
     PyObject *str = NULL;
     PyObject *substring = NULL;
 
@@ -118,7 +118,7 @@ PyObject *unescape(const NT_Token *token, PyObject *source)
 cleanup:
     Py_XDECREF(str);
     Py_XDECREF(substring);
-    Py_XDECREF(buf);
+    StringBuffer_free(buf);
     return result;
 }
 
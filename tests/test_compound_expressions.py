@@ -6,6 +6,11 @@ import pytest
 from nano_template import render
 
 
+class Falsy:
+    def __bool__(self) -> bool:
+        return False
+
+
 class Case(TypedDict):
     name: str
     template: str
@@ -88,6 +93,54 @@ TEST_CASES: list[Case] = [
         "data": {"true": True, "false": False},
         "result": "b",
     },
+    {
+        "name": "logical not, falsy operand",
+        "template": "{{ not x }}",
+        "data": {"x": False},
+        "result": "True",
+    },
+    {
+        "name": "logical not, truthy operand",
+        "template": "{{ not x }}",
+        "data": {"x": "foo"},
+        "result": "False",
+    },
+    {
+        "name": "logical not, undefined operand",
+        "template": "{{ not nosuchthing }}",
+        "data": {},
+        "result": "True",
+    },
+    {
+        "name": "empty string is falsy",
+        "template": "{% if x %}a{% else %}b{% endif %}",
+        "data": {"x": ""},
+        "result": "b",
+    },
+    {
+        "name": "empty containers are falsy",
+        "template": "{% if x or y or z %}a{% else %}b{% endif %}",
+        "data": {"x": {}, "y": [], "z": ()},
+        "result": "b",
+    },
+    {
+        "name": "none and zero are falsy",
+        "template": "{{ x or y or 'c' }}",
+        "data": {"x": None, "y": 0},
+        "result": "c",
+    },
+    {
+        "name": "custom truthiness",
+        "template": "{{ x and 'a' or 'b' }}",
+        "data": {"x": Falsy()},
+        "result": "b",
+    },
+    {
+        "name": "logical or, last value is a nested variable",
+        "template": "{{ x.y or a.b.c }}",
+        "data": {"x": {"y": ""}, "a": {"b": {"c": [1, 2]}}},
+        "result": "[1, 2]",
+    },
     {
         "name": "loop target",
         "template": "{% for x in y or a %}{{ x }}, {% endfor %}",
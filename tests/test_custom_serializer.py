@@ -6,6 +6,7 @@ from dataclasses import is_dataclass
 import pytest
 
 from nano_template import render
+from nano_template import serialize
 
 
 @dataclass
@@ -43,3 +44,37 @@ def test_custom_serializer() -> None:
         render(source, data, serializer=my_serializer)
         == '[{"foo": "hello", "bar": 42}]'
     )
+
+
+def test_custom_serializer_in_simple_loop() -> None:
+    source = "{% for x in y %}<{{ x }}>{% endfor %}"
+    data = {"y": ["a", MockData("b", 1)]}
+    assert render(source, data, serializer=lambda obj: repr(obj)) == (
+        "<'a'><MockData(foo='b', bar=1)>"
+    )
+
+
+class MyStr(str):
+    def __str__(self) -> str:
+        return "mine"
+
+
+@pytest.mark.parametrize(
+    "obj",
+    [
+        "foo",
+        MyStr("foo"),
+        1,
+        1.5,
+        None,
+        True,
+        [1, "a"],
+        ("b", 2),
+        {"c": [3]},
+        MockData("hello", 42),
+    ],
+)
+def test_default_serializer(obj: object) -> None:
+    want = json.dumps(obj) if isinstance(obj, (list, dict, tuple)) else str(obj)
+    assert serialize(obj) == want
+    assert render("{{ x }}", {"x": obj}) == want
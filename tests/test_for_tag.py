@@ -1,5 +1,12 @@
+import array
+import gc
+import math
+from types import MappingProxyType
+
 import pytest
 
+from nano_template import lazy
+from nano_template import parse
 from nano_template import render
 from nano_template import TemplateSyntaxError
 
@@ -22,6 +29,56 @@ def test_loop_over_a_dict() -> None:
     assert render(source, data) == "(a, 1), (b, 2), (c, 3), "
 
 
+def test_loop_over_a_tuple() -> None:
+    source = "{% for x in y %}{{ x }}, {% endfor %}"
+    data = {"y": (1, 2, 3)}
+    assert render(source, data) == "1, 2, 3, "
+
+
+def test_loop_over_dict_items_outlives_the_loop() -> None:
+    source = "{% for x in y %}{{ x }}, {% endfor %}"
+    data = {"y": {"a": [1], "b": [2]}}
+    assert render(source, data) == '["a", [1]], ["b", [2]], '
+
+
+def test_loop_over_a_dict_subclass() -> None:
+    class MyDict(dict[str, int]):
+        pass
+
+    source = "{% for x in y %}{{ x.0 }}={{ x.1 }}, {% endfor %}"
+    data = {"y": MyDict(a=1, b=2)}
+    assert render(source, data) == "a=1, b=2, "
+
+
+def test_dict_changed_size_during_iteration() -> None:
+    d: dict[str, object] = {"a": 1, "b": 2}
+
+    class Grow:
+        def __str__(self) -> str:
+            d["c"] = 3
+            return "grow"
+
+    d["b"] = Grow()
+    source = "{% for x in y %}{{ x.1 }}, {% endfor %}"
+
+    with pytest.raises(RuntimeError, match="changed size"):
+        render(source, {"y": d})
+
+
+def test_list_changed_size_during_iteration() -> None:
+    items: list[object] = []
+
+    class Append:
+        def __str__(self) -> str:
+            if len(items) < 4:
+                items.append(len(items))
+            return "x"
+
+    items.extend([Append(), Append()])
+    source = "{% for x in y %}{{ x }}, {% endfor %}"
+    assert render(source, {"y": items}) == "x, x, 2, 3, "
+
+
 def test_loop_target_is_not_iterable() -> None:
     source = "{% for x in y %}({{ x.0 }}, {{ x.1 }}), {% endfor %}"
     data = {"y": 42}
@@ -83,3 +140,215 @@ def test_nested_loop() -> None:
     )
     data: dict[str, object] = {"y": [1, 2, 3], "b": ["c", "d"]}
     assert render(source, data) == "(c, 1), (c, 2), (c, 3), (d, 1), (d, 2), (d, 3), "
+
+
+def test_loop_var_shadows_global() -> None:
+    source = "{{ x.a }} {% for x in y %}{{ x.a }} {% endfor %}{{ x.a }}"
+    data: dict[str, object] = {"x": {"a": "g"}, "y": [{"a": 1}, {"a": 2}]}
+    assert render(source, data) == "g 1 2 g"
+
+
+def test_repeated_global_path_in_loop() -> None:
+    source = "{% for x in y %}{{ a.b }}{{ x }}{% if a.b %}!{% endif %}{% endfor %}"
+    data: dict[str, object] = {"y": [1, 2], "a": {"b": "c"}}
+    assert render(source, data) == "c1!c2!"
+
+
+def test_loop_invariant_path_in_nested_loop() -> None:
+    source = (
+        "{% for a in b %}{% for x in a %}{{ c.d }}{{ x }}{% endfor %}"
+        "{% else %}{{ a }}{% endfor %}{{ c.d }}"
+    )
+    data: dict[str, object] = {"b": [[1, 2], [3]], "c": {"d": "-"}, "a": "z"}
+    assert render(source, data) == "-1-2-3-"
+
+
+def test_loop_variable_in_else_block_is_not_bound() -> None:
+    source = "{% for a in b %}{{ a }}{% else %}{{ a }}{% endfor %}"
+    data: dict[str, object] = {"b": [], "a": "z"}
+    assert render(source, data) == "z"
+
+
+def test_key_value_over_a_dict() -> None:
+    source = "{% for k, v in y %}{{ k }}={{ v }}, {% endfor %}"
+    data: dict[str, object] = {"y": {"a": 1, "b": 2}}
+    assert render(source, data) == "a=1, b=2, "
+
+
+def test_key_value_over_a_list_of_pairs() -> None:
+    source = "{% for k, v in y %}{{ k }}={{ v }}, {% endfor %}"
+    data: dict[str, object] = {"y": [("a", 1), ["b", 2], "cd"]}
+    assert render(source, data) == "a=1, b=2, c=d, "
+
+
+def test_key_value_over_a_mapping() -> None:
+    source = "{% for k, v in y %}{{ k }}={{ v }}, {% endfor %}"
+    data: dict[str, object] = {"y": MappingProxyType({"a": 1, "b": 2})}
+    assert render(source, data) == "a=1, b=2, "
+
+
+def test_key_value_else_block() -> None:
+    source = "{% for k, v in y %}{{ k }}{% else %}empty {{ v }}{% endfor %}"
+    assert render(source, {"y": {}, "v": "z"}) == "empty z"
+    assert render(source, {"y": 1, "v": "z"}) == "empty z"
+
+
+def test_key_value_go_out_of_scope() -> None:
+    source = "{% for k, v in y %}{{ k }}{{ v }} {% endfor %}{{ k }}{{ v }}"
+    data: dict[str, object] = {"y": {"a": 1}, "k": "x", "v": "y"}
+    assert render(source, data) == "a1 xy"
+
+
+def test_key_value_nested_loop_shadows_value() -> None:
+    source = (
+        "{% for k, v in y %}{% for v in v %}{{ k }}{{ v }} {% endfor %}"
+        "{{ v }} {% endfor %}"
+    )
+    data: dict[str, object] = {"y": {"a": [1, 2]}}
+    assert render(source, data) == "a1 a2 [1, 2] "
+
+
+def test_key_value_wrong_number_of_values() -> None:
+    source = "{% for k, v in y %}{{ k }}{% endfor %}"
+    with pytest.raises(ValueError, match="expected 2 values to unpack"):
+        render(source, {"y": [(1, 2, 3)]})
+
+
+def test_key_value_item_not_iterable() -> None:
+    source = "{% for k, v in y %}{{ k }}{% endfor %}"
+    with pytest.raises(TypeError):
+        render(source, {"y": [1]})
+
+
+@pytest.mark.parametrize(
+    "source",
+    [
+        "{% for k, in y %}{% endfor %}",
+        "{% for k, v, w in y %}{% endfor %}",
+        "{% for k, v.a in y %}{% endfor %}",
+        "{% for 1 in y %}{% endfor %}",
+    ],
+)
+def test_invalid_key_value_loop_target(source: str) -> None:
+    with pytest.raises(TemplateSyntaxError):
+        render(source, {"y": {}})
+
+
+def test_nested_loop_var_shadows_outer_loop_var() -> None:
+    source = (
+        "{% for x in y %}{% for x in x %}{{ x }}{% endfor %}"
+        "({{ x }}){% endfor %}{{ x }}"
+    )
+    data: dict[str, object] = {"y": ["ab", "c"], "x": "g"}
+    assert render(source, data) == "ab(ab)c(c)g"
+
+
+def test_sibling_loops() -> None:
+    source = (
+        "{% for x in y %}{{ x }}{% endfor %}{{ x }}"
+        "{% for z in y %}{{ x }}{{ z }}{% endfor %}"
+    )
+    data: dict[str, object] = {"y": [1, 2], "x": "g"}
+    assert render(source, data) == "12gg1g2"
+
+
+
+def test_simple_loop_with_text_and_outputs() -> None:
+    source = "<ul>{% for x in y %}<li>{{ x }}</li>{{x}}{% endfor %}</ul>"
+    data: dict[str, object] = {"y": ["a", 1, [2, 3], {"b": 4}]}
+    assert render(source, data) == (
+        '<ul><li>a</li>a<li>1</li>1<li>[2, 3]</li>[2, 3]<li>{"b": 4}</li>{"b": 4}</ul>'
+    )
+
+
+def test_simple_loop_else_block() -> None:
+    source = "{% for x in y %}<{{ x }}>{% else %}empty{% endfor %}"
+    assert render(source, {"y": []}) == "empty"
+    assert render(source, {"y": 1}) == "empty"
+
+
+def test_simple_loop_over_lazy_items() -> None:
+    source = "{% for x in y %}<{{ x }}>{% endfor %}"
+    data: dict[str, object] = {"y": [lazy(lambda: "a"), lazy(lambda: [1])]}
+    assert render(source, data) == "<a><[1]>"
+
+
+def test_simple_loop_over_json() -> None:
+    source = "{% for x in y %}<{{ x }}>{% endfor %}"
+    doc = b'{"y": [1, "a", [2], {"b": null}]}'
+    assert parse(source).render_json(doc) == '<1><a><[2]><{"b": null}>'
+
+
+@pytest.mark.parametrize(
+    "obj",
+    [
+        array.array("q", [-(2**63), 0, 2**63 - 1]),
+        array.array("B", [0, 255]),
+        array.array("L", [2**32 - 1]),
+        array.array("d", [0.1, -0.0, 1e16, 1e22, 5e-324, math.inf, math.nan]),
+        array.array("f", [0.1, 2.5]),
+        memoryview(array.array("d", [1.0, 2.0, 3.0]))[::-1],
+        memoryview(b"\x00\x01").cast("?"),
+        b"ab",
+        bytearray(b"xy"),
+    ],
+)
+def test_simple_loop_over_numeric_buffer(obj: object) -> None:
+    source = "{% for x in y %}<{{ x }}>{{ x }}{% endfor %}"
+    want = "".join(f"<{x}>{x}" for x in obj)  # type: ignore
+    assert render(source, {"y": obj}) == want
+    assert render(source, {"y": obj}, serializer=str) == want
+
+
+def test_empty_numeric_buffer() -> None:
+    source = "{% for x in y %}{{ x }}{% else %}empty{% endfor %}"
+    assert render(source, {"y": array.array("d")}) == "empty"
+
+
+def test_numeric_buffer_in_general_loop() -> None:
+    source = "{% for x in y %}{% if x %}{{ x }}{% endif %},{% endfor %}"
+    assert render(source, {"y": array.array("i", [0, 1, 2])}) == ",1,2,"
+
+
+def test_big_numeric_buffer() -> None:
+    template = parse("{% for x in y %}<é{{ x }}>{% endfor %}")
+    data = {"y": array.array("q", range(10_000))}
+    want = "".join(f"<é{x}>" for x in range(10_000))
+    assert template.render(data) == want
+    assert template.render_bytes(data) == want.encode()
+
+    chunks: list[str] = []
+    template.render_to(chunks.append, data, chunk_size=1000)
+    assert "".join(chunks) == want
+    assert all(len(chunk) >= 1000 for chunk in chunks[:-1])
+
+
+@pytest.mark.parametrize(
+    "obj",
+    [
+        range(3),
+        iter([0, 1, 2]),
+        (x for x in range(3)),
+        {0, 1, 2},
+        frozenset([0, 1, 2]),
+        {0: "a", 1: "b", 2: "c"}.keys(),
+    ],
+)
+def test_simple_loop_over_other_iterables(obj: object) -> None:
+    assert render("{% for x in y %}<{{ x }}>{% endfor %}", {"y": obj}) == (
+        "<0><1><2>"
+    )
+
+
+def test_reused_dict_item_pairs_are_gc_tracked() -> None:
+    tracked: list[bool] = []
+
+    def serializer(obj: object) -> str:
+        # A collection untracks a pair that only holds atomic values.
+        gc.collect()
+        tracked.append(gc.is_tracked(obj))
+        return ""
+
+    template = parse("{% for p in d %}{{ p }}{% endfor %}", serializer=serializer)
+    template.render({"d": {"a": 1, "b": {}, "c": 2, "d": []}})
+    assert tracked[1] and tracked[3]
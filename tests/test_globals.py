@@ -0,0 +1,47 @@
+import gc
+import weakref
+
+from nano_template import parse
+from nano_template import prepare
+from nano_template import render
+
+
+def test_template_globals() -> None:
+    template = parse("{{ a }} {{ b }}", globals={"a": 1, "b": 2})
+    assert template.render({"b": 3}) == "1 3"
+    assert template.render({}) == "1 2"
+
+
+def test_prepared_template_globals() -> None:
+    template = parse("{{ a.b }} {{ c }}", globals=prepare({"a": {"b": 1}, "c": 2}))
+    assert template.render({"c": 3}) == "1 3"
+
+
+def test_template_globals_and_overrides() -> None:
+    template = parse("{{ a }} {{ b }} {{ c }}", globals={"a": 1, "b": 1, "c": 1})
+    assert template.render({"b": 2, "c": 2}, {"c": 3}) == "1 2 3"
+
+
+def test_render_with_globals() -> None:
+    assert render("{{ a }}{{ b }}", {"b": 2}, globals={"a": 1}) == "12"
+
+
+def test_globals_are_not_copied() -> None:
+    globals_ = {"a": 1}
+    template = parse("{{ a }}", globals=globals_)
+    globals_["a"] = 2
+    assert template.render({}) == "2"
+
+
+def test_template_referenced_from_its_globals_is_collected() -> None:
+    class Marker:
+        pass
+
+    marker = Marker()
+    ref = weakref.ref(marker)
+    globals_: dict[str, object] = {"marker": marker}
+    globals_["template"] = parse("{{ marker }}", globals=globals_)
+    del marker, globals_
+
+    gc.collect()
+    assert ref() is None
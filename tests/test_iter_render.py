@@ -0,0 +1,175 @@
+import gc
+import weakref
+from array import array
+from typing import Iterator
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+SOURCES = [
+    "",
+    "hello",
+    "a{{ x }}b{{ y }}c",
+    "{% if x %}{{ x }}{% elif y %}y{% else %}e{% endif %}",
+    "{% for x in xs %}<{{ x }}>{% else %}empty{% endfor %}",
+    "{% for x in xs %}{% if x %}{{ x }}{% endif %}{% for y in ys %}{{ y }}"
+    "{% endfor %};{% endfor %}",
+    "{% for k, v in d %}{{ k }}={{ v }} {% endfor %}",
+    "{% for x in nums %}{{ x }},{% endfor %}",
+    "{% for x in x %}{{ x }}{% else %}not iterable{% endfor %}",
+    "{% for x in xs %}{% for x in ys %}{{ x }}{% endfor %}{{ x }}{% endfor %}",
+]
+
+DATA: list[dict[str, object]] = [
+    {},
+    {"x": 0, "y": "", "xs": [], "ys": [], "d": {}, "nums": array("i")},
+    {
+        "x": 1,
+        "y": "b",
+        "xs": ["p", "", "q"],
+        "ys": range(3),
+        "d": {"a": 1, "b": [2]},
+        "nums": array("d", [1.5, 2.0]),
+    },
+]
+
+
+@pytest.mark.parametrize("source", SOURCES)
+@pytest.mark.parametrize("chunk_size", [0, 1, 5, 65536])
+def test_iter_render_matches_render(source: str, chunk_size: int) -> None:
+    template = parse(source)
+    for data in DATA:
+        chunks = list(template.iter_render(data, chunk_size=chunk_size))
+        assert "".join(chunks) == template.render(data)
+        assert "" not in chunks
+
+
+def test_default_chunk_size() -> None:
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    chunks = list(template.iter_render({"xs": ["x" * 1000] * 200}))
+    assert [len(chunk) for chunk in chunks] == [66000, 66000, 66000, 2000]
+
+
+def test_chunks_reach_chunk_size() -> None:
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    chunks = list(template.iter_render({"xs": range(1000)}, chunk_size=100))
+    assert all(100 <= len(chunk) < 105 for chunk in chunks[:-1])
+
+
+def test_numeric_buffer_chunks_reach_chunk_size() -> None:
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    data = {"xs": array("i", range(200_000))}
+    chunks = list(template.iter_render(data, chunk_size=100))
+    assert all(100 <= len(chunk) < 110 for chunk in chunks[:-1])
+    assert "".join(chunks) == template.render(data)
+
+
+def test_overrides() -> None:
+    template = parse("{{ a }} {{ b }}")
+    assert list(template.iter_render({"a": 1, "b": 2}, {"b": 3})) == ["1 3"]
+
+
+def test_rendering_is_paused_between_chunks() -> None:
+    pulled: list[int] = []
+
+    def rows() -> Iterator[int]:
+        for i in range(10):
+            pulled.append(i)
+            yield i
+
+    template = parse("{% for row in rows %}{{ row }}{% endfor %}")
+    it = template.iter_render({"rows": rows()}, chunk_size=1)
+
+    assert next(it) == "0"
+    assert pulled == [0]
+    assert next(it) == "1"
+    assert pulled == [0, 1]
+    assert "".join(it) == "23456789"
+
+
+def test_iterator_dropped_early() -> None:
+    class Data(dict):  # type: ignore
+        pass
+
+    data = Data(xs=range(10**9))
+    ref = weakref.ref(data)
+    template = parse("{% for x in xs %}{% for y in xs %}{{ y }}{% endfor %}{% endfor %}")
+    it = template.iter_render(data, chunk_size=10)
+    next(it)
+    del it, data
+    gc.collect()
+    assert ref() is None
+
+
+def test_reference_cycle_through_data_is_collected() -> None:
+    class Data(dict):  # type: ignore
+        pass
+
+    data = Data(xs=range(10**9))
+    ref = weakref.ref(data)
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    it = template.iter_render(data, chunk_size=10)
+    next(it)
+    data["it"] = it
+    del it, data
+    gc.collect()
+    assert ref() is None
+
+
+def test_reference_cycle_through_loop_is_collected() -> None:
+    class Items:
+        def __iter__(self) -> Iterator[int]:
+            yield from range(10**9)
+
+    items = Items()
+    ref = weakref.ref(items)
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    it = template.iter_render({"xs": items}, chunk_size=10)
+    next(it)
+    items.it = it  # type: ignore
+    del it, items
+    gc.collect()
+    assert ref() is None
+
+
+def test_errors_are_raised_when_reached() -> None:
+    template = parse(
+        "{% for x in xs %}{{ x }}{% endfor %}{{ nosuchthing }}",
+        undefined=StrictUndefined,
+    )
+    it = template.iter_render({"xs": "abc"}, chunk_size=1)
+    assert [next(it), next(it), next(it)] == ["a", "b", "c"]
+
+    with pytest.raises(UndefinedVariableError):
+        next(it)
+
+    with pytest.raises(StopIteration):
+        next(it)
+
+
+def test_reentrant_iteration() -> None:
+    it: Iterator[str]
+
+    def serializer(obj: object) -> str:
+        return next(it)
+
+    template = parse("{{ x }}", serializer=serializer)
+    it = template.iter_render({"x": 1})
+
+    with pytest.raises(ValueError, match="already executing"):
+        next(it)
+
+
+def test_invalid_chunk_size() -> None:
+    with pytest.raises(ValueError):
+        parse("hello").iter_render({}, chunk_size=-1)
+
+
+def test_render_iterator_cant_be_created_directly() -> None:
+    from nano_template._nano_template import RenderIterator
+
+    with pytest.raises(TypeError):
+        RenderIterator()
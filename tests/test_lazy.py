@@ -0,0 +1,83 @@
+from typing import Callable
+
+import pytest
+
+from nano_template import Lazy
+from nano_template import lazy
+from nano_template import parse
+from nano_template import render
+
+
+def counter(value: object) -> tuple[Callable[[], object], list[int]]:
+    calls = [0]
+
+    def fn() -> object:
+        calls[0] += 1
+        return value
+
+    return fn, calls
+
+
+def test_output_lazy_value() -> None:
+    fn, calls = counter("Hello")
+    assert render("{{ a }}, {{ a }}!", {"a": lazy(fn)}) == "Hello, Hello!"
+    assert calls[0] == 1
+
+
+def test_lazy_value_is_not_called_if_not_reached() -> None:
+    fn, calls = counter("Hello")
+    source = "{% if b %}{{ a }}{% endif %}"
+    assert render(source, {"a": lazy(fn), "b": False}) == ""
+    assert calls[0] == 0
+
+
+def test_lazy_property() -> None:
+    fn, calls = counter({"c": "d"})
+    source = "{{ a.b.c }} {% if a.b %}{{ a.b['c'] }}{% endif %}"
+    assert render(source, {"a": {"b": lazy(fn)}}) == "d d"
+    assert calls[0] == 1
+
+
+def test_loop_over_lazy_value() -> None:
+    fn, calls = counter([1, 2, 3])
+    source = "{% for x in a %}{{ x }}{% endfor %}{% for x in a %}{{ x }}{% endfor %}"
+    assert render(source, {"a": lazy(fn)}) == "123123"
+    assert calls[0] == 1
+
+
+def test_lazy_loop_items() -> None:
+    fn, calls = counter("b")
+    source = "{% for x in a %}{{ x }}{{ x }}{% endfor %}"
+    assert render(source, {"a": [lazy(fn), lazy(fn)]}) == "bbbb"
+    assert calls[0] == 2
+
+
+def test_lazy_values_are_called_once_per_render() -> None:
+    fn, calls = counter("b")
+    template = parse("{{ a }}{{ a }}")
+    data = {"a": lazy(fn)}
+    assert template.render(data) == "bb"
+    assert template.render(data) == "bb"
+    assert calls[0] == 2
+
+
+def test_lazy_errors_propagate() -> None:
+    def fn() -> object:
+        raise ValueError("oops")
+
+    with pytest.raises(ValueError, match="oops"):
+        render("{{ a }}", {"a": lazy(fn)})
+
+
+def test_lazy_argument_must_be_callable() -> None:
+    with pytest.raises(TypeError):
+        lazy(42)  # type: ignore
+
+    with pytest.raises(TypeError):
+        Lazy(42)  # type: ignore
+
+
+def test_lazy_type() -> None:
+    value = Lazy(lambda: 42)
+    assert isinstance(lazy(lambda: 42), Lazy)
+    assert value() == 42
@@ -1,4 +1,5 @@
 import operator
+from collections import UserDict
 from typing import TypedDict
 
 import pytest
@@ -86,6 +87,24 @@ TEST_CASES: list[Case] = [
         "data": {"product": {"tags": ["sports", "garden"]}},
         "result": "sports",
     },
+    {
+        "name": "long variable path",
+        "template": "{{ a.b.c.d.e.f }}",
+        "data": {"a": {"b": {"c": {"d": {"e": {"f": "g"}}}}}},
+        "result": "g",
+    },
+    {
+        "name": "index into a tuple",
+        "template": "{{ a.1 }}",
+        "data": {"a": ("b", "c")},
+        "result": "c",
+    },
+    {
+        "name": "custom mapping",
+        "template": "{{ a.b.c }}",
+        "data": {"a": UserDict({"b": UserDict({"c": "d"})})},
+        "result": "d",
+    },
     {
         "name": "dump an array from context",
         "template": "{{ a }}",
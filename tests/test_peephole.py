@@ -0,0 +1,92 @@
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import Undefined
+from nano_template import UndefinedVariableError
+from nano_template import serialize
+from nano_template._nano_template import parse
+
+SOURCES = [
+    "a{{ x }}b{{ y }}c{{ z }}",
+    "{{ x }}{{ y }}",
+    "t{{ x }}",
+    "{{ x }}t",
+    "{{ x or 'd' }}",
+    "a{{ x or 'd' }}b",
+    "{{ x or \"\" }}{{ y.a or 'lit' }}",
+    "{% if x %}{{ x }}{% endif %}",
+    "{% if x %}{{ y }}{% endif %}",
+    "{% if x %}{{ x }}{% else %}e{% endif %}",
+    "{% if x.a %}{{ x.a }}{% endif %}",
+    "{% if y %}a{{ y }}b{% elif x %}{{ x or 'z' }}{% endif %}",
+    "{% for x in xs %}{% if x %}{{ x }}{% endif %}{% endfor %}{% if x %}{{ x }}{% endif %}",
+    "{% for x in xs %}a{{ x }}b{{ y or 'q' }}{% else %}e{{ y }}f{% endfor %}",
+    "{% for x in xs %}<{{ x }}>{% else %}a{{ y }}b{% endfor %}",
+    "{% for x in xs %}{% for x in x %}[{{ x }}]{% endfor %}{{ x.0 }}{% endfor %}",
+]
+
+DATA: list[dict[str, object]] = [
+    {},
+    {"x": 0, "y": "", "z": None, "xs": []},
+    {"x": [1, 2], "y": {"a": 3}, "z": "s", "xs": [[1], [0, 2]]},
+    {"x": "s", "y": 1.5, "xs": ["ab", ""]},
+]
+
+
+@pytest.mark.parametrize("source", SOURCES)
+@pytest.mark.parametrize("serializer", [serialize, repr])
+def test_fused_nodes_render_the_same(source: str, serializer: object) -> None:
+    optimized = parse(source, serializer, Undefined)  # type: ignore
+    unoptimized = parse(source, serializer, Undefined, None, False)  # type: ignore
+
+    for data in DATA:
+        assert optimized.render(data) == unoptimized.render(data)
+
+
+@pytest.mark.parametrize(
+    "source",
+    ["{% if x.y %}{{ x.y }}{% endif %}", "{{ x.y or 'z' }}"],
+)
+def test_fused_nodes_with_strict_undefined(source: str) -> None:
+    optimized = parse(source, serialize, StrictUndefined)
+    unoptimized = parse(source, serialize, StrictUndefined, None, False)
+    assert optimized.render({"x": {}}) == unoptimized.render({"x": {}})
+
+
+def test_fused_output_with_strict_undefined() -> None:
+    template = parse("a{{ x.y }}b", serialize, StrictUndefined)
+    with pytest.raises(UndefinedVariableError):
+        template.render({"x": {}})
+
+
+class DropsItself:
+    """A value that removes itself from its parent when tested for truth."""
+
+    def __init__(self, parent: dict[str, object]) -> None:
+        self.parent = parent
+
+    def __bool__(self) -> bool:
+        self.parent.clear()
+        return True
+
+    def __str__(self) -> str:
+        return "kept"
+
+
+@pytest.mark.parametrize(
+    "source",
+    [
+        "{% for x in xs %}{% if x.y %}{{ x.y }}{% endif %}{% endfor %}",
+        "{% for x in xs %}{{ x.y or 'z' }}{% endfor %}",
+        "{% if x.y %}{{ x.y }}{% endif %}",
+        "{{ x.y or 'z' }}",
+    ],
+)
+def test_fused_output_keeps_value_alive(source: str) -> None:
+    def render(optimize: bool) -> str:
+        parent: dict[str, object] = {}
+        parent["y"] = DropsItself(parent)
+        template = parse(source, str, Undefined, None, optimize)
+        return template.render({"x": parent, "xs": [parent]})
+
+    assert render(True) == render(False)
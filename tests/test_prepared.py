@@ -0,0 +1,121 @@
+from collections import UserDict
+
+import pytest
+
+from nano_template import Prepared
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import lazy
+from nano_template import parse
+from nano_template import prepare
+from nano_template import render
+
+DATA = {
+    "site": {"name": "Example", "nav": {"home": "/", "about": "/about"}},
+    "products": [{"title": "foo"}, {"title": "bar"}],
+    "custom": UserDict({"a": {"b": "c"}}),
+    1: "one",
+}
+
+
+def test_render_prepared_data() -> None:
+    source = "{{ site.name }} {{ site.nav.about }} {{ site['nav']['home'] }}"
+    assert render(source, prepare(DATA)) == "Example /about /"
+
+
+def test_path_through_a_list() -> None:
+    source = "{% for p in products %}{{ p.title }}{% endfor %} {{ products.1.title }}"
+    assert render(source, prepare(DATA)) == "foobar bar"
+
+
+def test_path_through_a_custom_mapping() -> None:
+    assert render("{{ custom.a.b }}", prepare(DATA)) == "c"
+
+
+def test_undefined_path() -> None:
+    assert render("{{ site.nosuchthing.name }}", prepare(DATA)) == ""
+
+    with pytest.raises(UndefinedVariableError, match="'site.nav.nosuchthing'"):
+        parse("{{ site.nav.nosuchthing }}", undefined=StrictUndefined).render(
+            prepare(DATA)
+        )
+
+
+def test_output_nested_dict() -> None:
+    assert render("{{ site.nav }}", prepare(DATA)) == '{"home": "/", "about": "/about"}'
+
+
+def test_overrides() -> None:
+    template = parse("{{ site.name }} {{ page.title }}")
+    data = prepare(DATA)
+    overrides = {"page": {"title": "Home"}}
+    assert template.render(data, overrides) == "Example Home"
+    assert template.render(data, {"site": {"name": "Other"}}) == "Other "
+    assert template.render(data) == "Example "
+
+
+def test_overrides_with_dict_data() -> None:
+    template = parse("{{ a }} {{ b }}")
+    assert template.render({"a": 1, "b": 2}, overrides={"b": 3}) == "1 3"
+
+
+def test_loop_var_shadows_prepared_data() -> None:
+    source = "{% for site in sites %}{{ site.name }} {% endfor %}{{ site.name }}"
+    data = prepare({**DATA, "sites": [{"name": "a"}, {"name": "b"}]})
+    assert render(source, data) == "a b Example"
+
+
+def test_lazy_prepared_values() -> None:
+    data = prepare({"a": {"b": lazy(lambda: "c")}})
+    assert render("{{ a.b }}", data) == "c"
+
+
+def test_prepared_is_a_mapping() -> None:
+    data = Prepared({"a": 1, "b": 2})
+    assert data["a"] == 1
+    assert len(data) == 2
+    assert list(data) == ["a", "b"]
+
+
+def test_prepare_cyclic_data() -> None:
+    a: dict[str, object] = {"name": "a"}
+    a["self"] = a
+    assert render("{{ a.self.self.name }}", prepare({"a": a})) == "a"
+
+
+def test_prepare_argument_must_be_a_mapping() -> None:
+    with pytest.raises(TypeError):
+        prepare(42)  # type: ignore
+
+
+def test_changes_to_nested_data_after_preparing() -> None:
+    a = {"b": 1, "c": {"d": [1, 2]}}
+    data = prepare({"a": a})
+    a["b"] = 2
+    a["c"]["d"].append(3)  # type: ignore
+    a["c"] = {"d": []}
+
+    assert render("{{ a.b }}", data) == "1"
+    assert render("{% for k, v in a %}{{ v }},{% endfor %}", data) == (
+        '1,{"d": [1, 2]},'
+    )
+    assert render("{% for x in a.c.d %}{{ x }}{% endfor %}", data) == "12"
+
+
+def test_prepare_keeps_shared_and_cyclic_lists() -> None:
+    shared = {"name": "s"}
+    xs: list[object] = [shared, shared]
+    xs.append(xs)
+    data = prepare({"xs": xs, "s": shared})
+    assert data["xs"][0] is data["xs"][1] is data["s"]  # type: ignore
+    assert data["xs"][2] is data["xs"]  # type: ignore
+    assert render("{{ xs.2.2.0.name }}", data) == "s"
+
+
+def test_prepare_deeply_nested_data() -> None:
+    deep: list[object] = []
+    for _ in range(100_000):
+        deep = [deep]
+
+    with pytest.raises(RecursionError):
+        prepare({"deep": deep})
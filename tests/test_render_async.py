@@ -0,0 +1,277 @@
+import asyncio
+import time
+from collections import namedtuple
+from typing import AsyncIterator
+from typing import TypeVar
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import lazy
+from nano_template import parse
+
+T = TypeVar("T")
+
+
+async def fetch(value: T, delay: float = 0.05) -> T:
+    await asyncio.sleep(delay)
+    return value
+
+
+def test_template_paths() -> None:
+    template = parse(
+        "{{ user.name }}{% for o in orders %}{{ o.id }}{{ site.name }}{% endfor %}"
+        "{{ user.name }}{{ a['b c'].0 }}"
+    )
+
+    assert template.paths == (
+        ("user", "name"),
+        ("orders",),
+        ("site", "name"),
+        ("a", "b c", 0),
+    )
+
+
+def test_awaitables_are_awaited_concurrently() -> None:
+    template = parse("{{ a }} {{ b.name }} {% for c in cs %}{{ c }}{% endfor %}")
+
+    async def main() -> tuple[str, float]:
+        data = {
+            "a": fetch("foo", 0.1),
+            "b": fetch({"name": "bar"}, 0.1),
+            "cs": fetch([1, 2, 3], 0.1),
+        }
+        start = time.perf_counter()
+        result = await template.render_async(data)
+        return result, time.perf_counter() - start
+
+    result, elapsed = asyncio.run(main())
+    assert result == "foo bar 123"
+    assert elapsed < 0.25
+
+
+def test_nested_awaitables() -> None:
+    template = parse("{{ a.b.c }} {{ a.d }} {{ e.0.f }}")
+
+    async def main() -> tuple[str, dict[str, object]]:
+        data: dict[str, object] = {
+            "a": {"b": fetch({"c": fetch("deep")}), "d": "shallow"},
+            "e": [{"f": fetch("item")}],
+        }
+        return await template.render_async(data), data
+
+    result, data = asyncio.run(main())
+    assert result == "deep shallow item"
+
+    # Render data is not modified.
+    assert asyncio.iscoroutine(data["a"]["b"])  # type: ignore
+    assert asyncio.iscoroutine(data["e"][0]["f"])  # type: ignore
+
+
+def test_tuples_on_the_way_to_awaitables_stay_tuples() -> None:
+    Point = namedtuple("Point", ["x", "y"])
+    template = parse("{{ t.0.x }} {{ p.1.z }} {{ t }} {{ p }}", serializer=repr)
+
+    async def main() -> str:
+        data = {
+            "t": ({"x": fetch(1)}, 2),
+            "p": Point(0, {"z": fetch(3)}),
+        }
+        return await template.render_async(data)
+
+    assert asyncio.run(main()) == (
+        "1 3 ({'x': 1}, 2) Point(x=0, y={'z': 3})"
+    )
+
+
+def test_same_awaitable_reached_twice() -> None:
+    template = parse("{{ a.x }} {{ b.x }}")
+
+    async def main() -> str:
+        shared = asyncio.ensure_future(fetch({"x": 1}))
+        return await template.render_async({"a": shared, "b": shared})
+
+    assert asyncio.run(main()) == "1 1"
+
+
+def test_render_async_with_overrides() -> None:
+    template = parse("{{ a }} {{ b }}")
+
+    async def main() -> str:
+        return await template.render_async({"a": fetch(1), "b": 2}, {"b": fetch(3)})
+
+    assert asyncio.run(main()) == "1 3"
+
+
+def test_awaitables_in_globals_are_prefetched() -> None:
+    async def main() -> tuple[str, float]:
+        template = parse(
+            "{{ site.name }} {{ a }} {{ b }}",
+            globals={"site": {"name": fetch("x", 0.1)}, "a": fetch(1, 0.1)},
+        )
+        start = time.perf_counter()
+        result = await template.render_async({"b": fetch(2, 0.1)})
+        return result, time.perf_counter() - start
+
+    result, elapsed = asyncio.run(main())
+    assert result == "x 1 2"
+    assert elapsed < 0.25
+
+
+def test_data_shadows_awaitables_in_globals() -> None:
+    async def main() -> str:
+        template = parse("{{ a }}", globals={"a": fetch(1)})
+        result = await template.render_async({"a": 2})
+        await template.globals["a"]  # type: ignore
+        return result
+
+    assert asyncio.run(main()) == "2"
+
+
+def test_render_async_without_awaitables() -> None:
+    template = parse("{{ a }} {{ b.c }}")
+
+    async def main() -> str:
+        return await template.render_async({"a": 1})
+
+    assert asyncio.run(main()) == "1 "
+
+
+def test_exceptions_propagate() -> None:
+    template = parse("{{ a }}")
+
+    async def fail() -> None:
+        raise ValueError("oops")
+
+    async def main() -> str:
+        return await template.render_async({"a": fail()})
+
+    with pytest.raises(ValueError, match="oops"):
+        asyncio.run(main())
+
+
+def test_undefined_after_await() -> None:
+    template = parse("{{ a.nosuchthing }}", undefined=StrictUndefined)
+
+    async def main() -> str:
+        return await template.render_async({"a": fetch({})})
+
+    with pytest.raises(UndefinedVariableError):
+        asyncio.run(main())
+
+
+async def rows(n: int, delay: float = 0.0) -> AsyncIterator[dict[str, int]]:
+    for i in range(n):
+        await asyncio.sleep(delay)
+        yield {"id": i}
+
+
+def test_for_tag_over_async_iterable() -> None:
+    template = parse("{% for row in rows %}{{ row.id }},{% endfor %} {{ a }}")
+
+    async def main() -> str:
+        return await template.render_async({"rows": rows(5), "a": fetch("b")})
+
+    assert asyncio.run(main()) == "0,1,2,3,4, b"
+
+
+def test_for_tag_over_async_iterable_else_block() -> None:
+    template = parse("{% for row in rows %}{{ row.id }}{% else %}empty{% endfor %}")
+
+    async def main() -> str:
+        return await template.render_async({"rows": rows(0)})
+
+    assert asyncio.run(main()) == "empty"
+
+
+def test_nested_async_iterables() -> None:
+    template = parse(
+        "{% for group in groups %}{% for row in group %}{{ row.id }}{% endfor %};"
+        "{% endfor %}"
+    )
+
+    async def main() -> str:
+        return await template.render_async({"groups": [rows(2), rows(3)]})
+
+    assert asyncio.run(main()) == "01;012;"
+
+
+def test_async_iterable_without_async_api() -> None:
+    template = parse("{% for row in rows %}{{ row }}{% else %}not iterable{% endfor %}")
+    assert template.render({"rows": rows(1)}) == "not iterable"
+
+
+def test_output_before_an_async_loop_is_rendered_once() -> None:
+    template = parse(
+        "{% for c in gen %}{{ c }}{% endfor %}|{{ lazy }}|"
+        "{% for n in agen %}{{ n.id }}{% endfor %}"
+    )
+    calls: list[int] = []
+
+    def expensive() -> str:
+        calls.append(1)
+        return "L"
+
+    async def main() -> str:
+        data = {"gen": iter("ab"), "lazy": lazy(expensive), "agen": rows(2)}
+        return await template.render_async(data)
+
+    assert asyncio.run(main()) == "ab|L|01"
+    assert calls == [1]
+
+
+def test_nested_async_loop_resumes_in_place() -> None:
+    template = parse(
+        "{% for g in groups %}<{% for x in g %}{{ x }}{% endfor %}>"
+        "{% for row in rows %}{{ row.id }}{% endfor %}{% endfor %}"
+    )
+
+    async def chars(s: str) -> AsyncIterator[str]:
+        for c in s:
+            yield c
+
+    async def main() -> str:
+        groups = iter([iter("ab"), chars("cd"), iter("e")])
+        return await template.render_async({"groups": groups, "rows": rows(1)})
+
+    assert asyncio.run(main()) == "<ab>0<cd><e>"
+
+
+def test_render_async_iter_yields_chunks_as_rows_arrive() -> None:
+    template = parse("head {% for row in rows %}[{{ row.id }}]{% endfor %} tail")
+
+    async def main() -> list[str]:
+        return [
+            chunk
+            async for chunk in template.render_async_iter({"rows": rows(3, 0.01)})
+        ]
+
+    assert asyncio.run(main()) == ["head [0]", "[1]", "[2]", " tail"]
+
+
+def test_render_async_iter_closed_early() -> None:
+    template = parse("{% for row in rows %}{{ row.id }}{% endfor %}")
+
+    async def main() -> str:
+        it = template.render_async_iter({"rows": rows(10_000)})
+        async for chunk in it:
+            await it.aclose()  # type: ignore
+            return chunk
+        return ""
+
+    assert asyncio.run(main()) == "0"
+
+
+def test_render_async_iter_exceptions_propagate() -> None:
+    template = parse("{% for row in rows %}{{ row.id }}{% endfor %}")
+
+    async def broken() -> AsyncIterator[dict[str, int]]:
+        yield {"id": 1}
+        raise ValueError("oops")
+
+    async def main() -> list[str]:
+        return [c async for c in template.render_async_iter({"rows": broken()})]
+
+    with pytest.raises(ValueError, match="oops"):
+        asyncio.run(main())
@@ -0,0 +1,120 @@
+from array import array
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+SOURCES = [
+    "",
+    "hello",
+    "Hello, {{ you }}!",
+    "café {{ you }} ☃ {{ x }} \U0001f600",
+    "{% for x in xs %}<li>{{ x }}</li>{% endfor %}",
+    "{% for x in xs %}{% if x %}{{ x }}{% endif %}é{% endfor %}",
+    "{{ you or 'naïve' }} {{ nosuchthing or 'naïve' }}",
+    "{% for n in nums %}{{ n }}—{% endfor %}",
+    "{% for k, v in d %}{{ k }}={{ v }};{% endfor %}",
+]
+
+DATA: list[dict[str, object]] = [
+    {},
+    {"you": "World", "x": 1, "xs": [1, 0, "b"], "nums": array("i", [1, 2])},
+    {
+        "you": "wörld",
+        "x": "☃" * 300,
+        "xs": ["é", "\U0001f600", "日本"],
+        "nums": array("d", [0.5]),
+        "d": {"ключ": "значение"},
+    },
+]
+
+
+@pytest.mark.parametrize("source", SOURCES)
+@pytest.mark.parametrize("data", DATA)
+def test_render_bytes_matches_render(
+    source: str, data: dict[str, object]
+) -> None:
+    template = parse(source)
+    result = template.render_bytes(data)
+    assert isinstance(result, bytes)
+    assert result == template.render(data).encode()
+
+
+def test_render_bytes_with_overrides() -> None:
+    template = parse("{{ a }} {{ b }}")
+    assert template.render_bytes({"a": 1, "b": 2}, {"b": "é"}) == "1 é".encode()
+
+
+@pytest.mark.parametrize("n", [1, 255, 256, 257, 10_000])
+def test_long_values(n: int) -> None:
+    template = parse("<{{ a }}>")
+    for value in ("a" * n, "é" * n, "\U0001f600" * n):
+        assert template.render_bytes({"a": value}) == f"<{value}>".encode()
+
+
+def test_lone_surrogates_are_an_error() -> None:
+    template = parse("{{ a }}")
+    with pytest.raises(UnicodeEncodeError):
+        template.render_bytes({"a": "ab\ud800c"})
+
+
+@pytest.mark.parametrize(
+    "source,want",
+    [
+        ("a\ud800{{ x }}", "a\ud8001"),
+        ("{{ x }}a\ud800", "1a\ud800"),
+        ("{% for x in xs %}\ud800{{ x }}{% endfor %}", "\ud8001\ud8002"),
+        ("{% for x in ys %}{{ x }}{% else %}\ud800{% endfor %}", "\ud800"),
+        ("{{ nosuchthing or 'a' }}\ud800", "a\ud800"),
+    ],
+)
+def test_lone_surrogates_in_template_text(source: str, want: str) -> None:
+    template = parse(source)
+    data = {"x": 1, "xs": array("i", [1, 2]), "ys": []}
+    assert template.render(data) == want
+
+    chunks: list[str] = []
+    template.render_to(chunks.append, data, chunk_size=0)
+    assert "".join(chunks) == want
+    assert "".join(template.iter_render(data)) == want
+
+    with pytest.raises(UnicodeEncodeError):
+        template.render_bytes(data)
+
+    with pytest.raises(UnicodeEncodeError):
+        template.render_into(bytearray(), data)
+
+    with pytest.raises(UnicodeEncodeError):
+        template.render_compressed(data)
+
+
+def test_custom_serializer() -> None:
+    template = parse("{{ a }}", serializer=lambda obj: f"«{obj}»")
+    assert template.render_bytes({"a": 1}) == "«1»".encode()
+
+
+def test_render_bytes_errors() -> None:
+    template = parse("a{{ a.b }}", undefined=StrictUndefined)
+    with pytest.raises(UndefinedVariableError):
+        template.render_bytes({"a": {}})
+
+
+def test_render_bytes_size_hint() -> None:
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    data = {"xs": range(1000)}
+    expect = "".join(f"{x}," for x in range(1000)).encode()
+    assert template.render_bytes(data, size_hint=0) == expect
+    assert template.render_bytes(data, size_hint=100_000) == expect
+
+    with pytest.raises(ValueError):
+        template.render_bytes(data, size_hint=-1)
+
+
+def test_interleaved_with_render() -> None:
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    for n in (10_000, 0, 5, 100_000, 3):
+        data = {"xs": ["é"] * n}
+        assert template.render_bytes(data) == ("é" * n).encode()
+        assert template.render(data) == "é" * n
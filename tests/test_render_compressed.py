@@ -0,0 +1,131 @@
+import gzip
+import io
+import zlib
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+SOURCES = [
+    "",
+    "hello",
+    "Hello, {{ you }}!",
+    "<ul>{% for x in xs %}<li>{{ x }} {{ you }}</li>{% endfor %}</ul>",
+    "<p>" + "é" * 1000 + "</p>{% for x in xs %}{{ x }}{% endfor %}",
+]
+
+DATA = {"you": "wörld", "xs": range(2000)}
+
+
+@pytest.mark.parametrize("source", SOURCES)
+@pytest.mark.parametrize("chunk_size", [0, 100, 65536])
+def test_render_gzip(source: str, chunk_size: int) -> None:
+    template = parse(source)
+    out = template.render_compressed(DATA, chunk_size=chunk_size)
+    assert gzip.decompress(out) == template.render(DATA).encode()
+
+
+@pytest.mark.parametrize("source", SOURCES)
+def test_render_deflate(source: str) -> None:
+    template = parse(source)
+    out = template.render_compressed(DATA, encoding="deflate")
+    assert zlib.decompress(out) == template.render(DATA).encode()
+
+
+def test_compression_level() -> None:
+    template = parse("{% for x in xs %}<li>{{ x }}</li>{% endfor %}")
+    fast = template.render_compressed(DATA, level=0)
+    best = template.render_compressed(DATA, level=9)
+    assert len(best) < len(fast)
+    assert gzip.decompress(fast) == gzip.decompress(best)
+
+
+def test_render_compressed_with_overrides() -> None:
+    out = parse("{{ a }} {{ b }}").render_compressed({"a": 1, "b": 2}, {"b": 3})
+    assert gzip.decompress(out) == b"1 3"
+
+
+def test_render_compressed_to_file() -> None:
+    template = parse("{% for x in xs %}<li>{{ x }}</li>{% endfor %}")
+    buf = io.BytesIO()
+    assert template.render_compressed(DATA, sink=buf, chunk_size=1000) is None
+    assert gzip.decompress(buf.getvalue()) == template.render(DATA).encode()
+
+
+def test_chunks_can_be_decompressed_as_they_arrive() -> None:
+    template = parse("<head></head>{% for x in xs %}<li>{{ x }}</li>{% endfor %}")
+    decompressor = zlib.decompressobj(wbits=31)
+    seen: list[bytes] = []
+
+    def write(chunk: bytes) -> None:
+        seen.append(decompressor.decompress(chunk))
+
+    template.render_compressed(DATA, sink=write, chunk_size=1000)
+
+    assert len(seen) > 2
+    assert all(len(chunk) >= 1000 for chunk in seen[:-2])
+    assert b"".join(seen) == template.render(DATA).encode()
+
+
+def test_flush_prefix() -> None:
+    template = parse("<head></head>{% for x in xs %}<li>{{ x }}</li>{% endfor %}")
+    decompressor = zlib.decompressobj(wbits=31)
+    seen: list[bytes] = []
+
+    def write(chunk: bytes) -> None:
+        seen.append(decompressor.decompress(chunk))
+
+    template.render_compressed(
+        DATA, sink=write, chunk_size=1000, flush_prefix=True
+    )
+
+    # The static prefix comes first, on its own.
+    assert seen[0] == b"<head></head>"
+    assert b"".join(seen) == template.render(DATA).encode()
+
+
+def test_output_before_an_error_is_passed_to_sink() -> None:
+    template = parse(
+        "<p>{% for x in xs %}{{ x }}{% endfor %}{{ nosuchthing }}",
+        undefined=StrictUndefined,
+    )
+    decompressor = zlib.decompressobj(wbits=31)
+    seen: list[bytes] = []
+
+    def write(chunk: bytes) -> None:
+        seen.append(decompressor.decompress(chunk))
+
+    with pytest.raises(UndefinedVariableError):
+        template.render_compressed({"xs": range(3)}, sink=write, chunk_size=0)
+
+    assert b"".join(seen) == b"<p>012"
+
+
+def test_unknown_encoding() -> None:
+    with pytest.raises(ValueError, match="encoding"):
+        parse("hello").render_compressed({}, encoding="br")
+
+
+def test_invalid_level() -> None:
+    with pytest.raises(ValueError):
+        parse("hello").render_compressed({}, level=42)
+
+
+def test_negative_chunk_size() -> None:
+    with pytest.raises(ValueError):
+        parse("hello").render_compressed({}, chunk_size=-1)
+
+
+def test_sink_errors_propagate() -> None:
+    def write(_: bytes) -> None:
+        raise OSError("disk full")
+
+    with pytest.raises(OSError, match="disk full"):
+        parse("hello").render_compressed({}, sink=write)
+
+
+def test_not_a_sink() -> None:
+    with pytest.raises(TypeError):
+        parse("hello").render_compressed({}, sink=1)  # type: ignore
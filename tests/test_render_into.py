@@ -0,0 +1,96 @@
+import array
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+
+def test_render_into_bytearray() -> None:
+    template = parse("héllo {{ you }}!")
+    buf = bytearray()
+    assert template.render_into(buf, {"you": "wörld"}) == (14, 14)
+    assert buf == "héllo wörld!".encode()
+
+
+def test_render_into_offset() -> None:
+    template = parse("{{ a }},")
+    buf = bytearray()
+    offset = 0
+
+    for i in range(3):
+        written, offset = template.render_into(buf, {"a": i}, offset=offset)
+        assert written == 2
+
+    assert offset == 6
+    assert buf == b"0,1,2,"
+
+
+def test_larger_bytearray_is_not_truncated() -> None:
+    template = parse("{{ a }}")
+    buf = bytearray(b"..........")
+    assert template.render_into(buf, {"a": "abc"}, offset=2) == (3, 5)
+    assert buf == b"..abc....."
+
+
+def test_render_into_with_overrides() -> None:
+    buf = bytearray()
+    parse("{{ a }} {{ b }}").render_into(buf, {"a": 1, "b": 2}, {"b": 3})
+    assert buf == b"1 3"
+
+
+def test_offset_past_end_of_bytearray() -> None:
+    with pytest.raises(ValueError, match="past the end"):
+        parse("{{ a }}").render_into(bytearray(2), {"a": 1}, offset=3)
+
+
+def test_negative_offset() -> None:
+    with pytest.raises(ValueError):
+        parse("{{ a }}").render_into(bytearray(), {"a": 1}, offset=-1)
+
+
+def test_render_into_memoryview() -> None:
+    template = parse("<{{ a }}>")
+    buf = bytearray(8)
+    assert template.render_into(memoryview(buf), {"a": "é"}, offset=1) == (4, 5)
+    assert buf == b"\x00<\xc3\xa9>\x00\x00\x00"
+
+
+def test_render_into_array() -> None:
+    buf = array.array("i", [0, 0])
+    assert parse("{{ a }}").render_into(buf, {"a": "abcdefgh"}) == (8, 8)
+    assert buf.tobytes() == b"abcdefgh"
+
+
+def test_fixed_buffer_too_small() -> None:
+    buf = bytearray(b"......")
+    with pytest.raises(ValueError, match="buffer too small"):
+        parse("{{ a }}").render_into(memoryview(buf), {"a": "abcde"}, offset=2)
+    assert buf == b"......"
+
+
+def test_read_only_buffer() -> None:
+    with pytest.raises(TypeError, match="read-only"):
+        parse("{{ a }}").render_into(b"......", {"a": 1})  # type: ignore
+
+
+def test_not_a_buffer() -> None:
+    with pytest.raises(TypeError):
+        parse("{{ a }}").render_into([], {"a": 1})  # type: ignore
+
+
+def test_nothing_is_written_on_error() -> None:
+    template = parse("abc{{ a.b }}", undefined=StrictUndefined)
+    buf = bytearray(b"...")
+
+    with pytest.raises(UndefinedVariableError):
+        template.render_into(buf, {"a": {}})
+
+    assert buf == b"..."
+
+
+def test_empty_output() -> None:
+    buf = bytearray()
+    assert parse("{{ a }}").render_into(buf, {}) == (0, 0)
+    assert buf == b""
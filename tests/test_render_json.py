@@ -0,0 +1,108 @@
+import json
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+DOC = {
+    "site": {"name": "Example", "nav": {"home": "/", "about": "/about"}},
+    "products": [
+        {"title": "foo", "price": 1.5, "stock": 10, "tags": ["a", "b"]},
+        {"title": "bar", "price": 2, "stock": 0, "tags": []},
+    ],
+    "escaped": "tab\there \"quoted\" é \U0001f600 \\",
+    "unicode": "café",
+    "big": 12345678901234567890123,
+    "negative": -42,
+    "exponent": 1e-3,
+    "flags": {"yes": True, "no": False, "nothing": None},
+    "empty": {},
+}
+
+
+def render_json(source: str, doc: object = DOC, **kwargs: object) -> str:
+    template = parse(source)
+    buf = json.dumps(doc, **kwargs)  # type: ignore
+    result = template.render_json(buf.encode())
+    assert template.render(json.loads(buf)) == result
+    return result
+
+
+@pytest.mark.parametrize(
+    "source",
+    [
+        "{{ site.name }} {{ site.nav.about }} {{ site['nav']['home'] }}",
+        "{% for p in products %}{{ p.title }}:{{ p.price }}:{{ p.stock }} {% endfor %}",
+        "{{ products.1.title }} {{ products[0].tags }}",
+        "{{ escaped }}",
+        "{{ unicode }}",
+        "{{ big }} {{ negative }} {{ exponent }}",
+        "{{ flags.yes }} {{ flags.no }} {{ flags.nothing }}",
+        "{{ site }}",
+        "{{ products }}",
+        "{{ empty }}",
+        "{% for k in site.nav %}{{ k }} {% endfor %}",
+        "{% for item in flags %}{{ item }} {% endfor %}",
+        "{% if products.1.tags %}yes{% else %}no{% endif %}",
+        "{% if empty %}yes{% else %}no{% endif %}",
+        "{% if flags.no or flags.nothing %}yes{% else %}no{% endif %}",
+        "{{ nosuchthing }}{{ site.nosuchthing.name }}{{ products.5 }}",
+    ],
+)
+def test_render_json_matches_render(source: str) -> None:
+    render_json(source)
+    render_json(source, indent=2, ensure_ascii=False)
+
+
+def test_render_json_accepts_str_and_bytearray() -> None:
+    template = parse("{{ a.b }}")
+    assert template.render_json('{"a": {"b": "c"}}') == "c"
+    assert template.render_json(bytearray(b'{"a": {"b": "c"}}')) == "c"
+
+
+def test_render_json_overrides() -> None:
+    template = parse("{{ a }} {{ b }}")
+    assert template.render_json(b'{"a": 1, "b": 2}', {"b": 3}) == "1 3"
+
+
+def test_duplicate_keys() -> None:
+    assert parse("{{ a }}").render_json(b'{"a": 1, "a": 2}') == "2"
+
+
+def test_escaped_keys() -> None:
+    assert parse("{{ a.b }}").render_json(b'{"\\u0061": {"b": 1}}') == "1"
+
+
+def test_strict_undefined() -> None:
+    template = parse("{{ site.nosuchthing }}", undefined=StrictUndefined)
+    with pytest.raises(UndefinedVariableError, match="'site.nosuchthing'"):
+        template.render_json(b'{"site": {}}')
+
+
+@pytest.mark.parametrize(
+    "buf",
+    [
+        b"",
+        b"[]",
+        b"1",
+        b"{",
+        b'{"a": }',
+        b'{"a": 1,}',
+        b'{"a": 1} x',
+        b'{"a": 01}',
+        b'{"a": "\\x"}',
+        b'{"a": "\x01"}',
+        b'{"a": tru}',
+        b"[" * 1000 + b"]" * 1000,
+    ],
+)
+def test_invalid_json(buf: bytes) -> None:
+    with pytest.raises(ValueError):
+        parse("{{ a }}").render_json(buf)
+
+
+def test_render_json_type_error() -> None:
+    with pytest.raises(TypeError):
+        parse("{{ a }}").render_json(1)  # type: ignore
@@ -0,0 +1,120 @@
+import io
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+
+def test_render_to_file_like() -> None:
+    template = parse("Hello, {{ you }}!")
+    sink = io.StringIO()
+    assert template.render_to(sink, {"you": "World"}) is None  # type: ignore
+    assert sink.getvalue() == "Hello, World!"
+
+
+def test_render_to_callable() -> None:
+    template = parse("Hello, {{ you }}!")
+    chunks: list[str] = []
+    template.render_to(chunks.append, {"you": "World"})
+    assert chunks == ["Hello, World!"]
+
+
+def test_render_to_with_overrides() -> None:
+    template = parse("{{ a }} {{ b }}")
+    chunks: list[str] = []
+    template.render_to(chunks.append, {"a": 1, "b": 2}, {"b": 3})
+    assert "".join(chunks) == "1 3"
+
+
+def test_empty_output_is_not_written() -> None:
+    chunks: list[str] = []
+    parse("{{ nosuchthing }}").render_to(chunks.append, {})
+    assert chunks == []
+
+
+def test_output_is_written_in_chunks() -> None:
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    data = {"xs": range(10_000)}
+    chunks: list[str] = []
+    template.render_to(chunks.append, data, chunk_size=1000)
+
+    assert "".join(chunks) == template.render(data)
+    assert len(chunks) > 1
+    # Every chunk but the last reaches the chunk size, overshooting by no
+    # more than one loop iteration.
+    assert all(1000 <= len(chunk) < 1010 for chunk in chunks[:-1])
+    assert len(chunks[-1]) < 1010
+
+
+def test_zero_chunk_size_writes_each_iteration() -> None:
+    template = parse("<{% for x in xs %}{{ x }}{% endfor %}>")
+    chunks: list[str] = []
+    template.render_to(chunks.append, {"xs": "abc"}, chunk_size=0)
+    assert chunks == ["<a", "b", "c", ">"]
+
+
+def test_nested_loops_and_numeric_buffers() -> None:
+    from array import array
+
+    template = parse(
+        "{% for row in rows %}{% for x in row %}{{ x }} {% endfor %}|{% endfor %}"
+    )
+    data = {"rows": [array("i", range(100)) for _ in range(100)]}
+    chunks: list[str] = []
+    template.render_to(chunks.append, data, chunk_size=500)
+    assert "".join(chunks) == template.render(data)
+    assert len(chunks) > 1
+
+
+def test_sink_errors_propagate() -> None:
+    def write(chunk: str) -> None:
+        raise OSError("disk full")
+
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    with pytest.raises(OSError, match="disk full"):
+        template.render_to(write, {"xs": range(100)}, chunk_size=10)
+
+
+def test_render_errors_propagate() -> None:
+    template = parse(
+        "{% for x in xs %}{{ x }}{% endfor %}{{ nosuchthing }}",
+        undefined=StrictUndefined,
+    )
+    chunks: list[str] = []
+    with pytest.raises(UndefinedVariableError):
+        template.render_to(chunks.append, {"xs": range(100)}, chunk_size=10)
+    assert chunks
+
+
+@pytest.mark.parametrize("sink", [None, 1, object()])
+def test_invalid_sink(sink: object) -> None:
+    with pytest.raises(TypeError):
+        parse("hello").render_to(sink, {})  # type: ignore
+
+
+def test_invalid_chunk_size() -> None:
+    with pytest.raises(ValueError):
+        parse("hello").render_to(print, {}, chunk_size=-1)
+
+
+def test_numeric_buffer_loop_is_written_in_chunks() -> None:
+    from array import array
+
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    data = {"xs": array("q", range(10_000))}
+    chunks: list[str] = []
+    template.render_to(chunks.append, data, chunk_size=1000)
+    assert "".join(chunks) == template.render(data)
+    assert all(1000 <= len(chunk) < 1010 for chunk in chunks[:-1])
+
+
+@pytest.mark.parametrize("wide", ["é", "€", "😀"])
+def test_narrow_chunk_after_a_wide_chunk(wide: str) -> None:
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    data = {"xs": [wide * 3, "ab", wide, "c"]}
+    chunks: list[str] = []
+    template.render_to(chunks.append, data, chunk_size=0)
+    assert chunks == [wide * 3, "ab", wide, "c"]
+    assert list(template.iter_render(data, chunk_size=0)) == chunks
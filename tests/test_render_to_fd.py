@@ -0,0 +1,203 @@
+import os
+import tempfile
+import threading
+from typing import BinaryIO
+from typing import Iterator
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+LONG = "<div class='row'>" + "é" * 600 + "</div>\n"
+
+
+@pytest.fixture
+def tmp() -> Iterator[BinaryIO]:
+    with tempfile.TemporaryFile() as f:
+        yield f
+
+
+def read_all(f: BinaryIO) -> bytes:
+    f.seek(0)
+    return f.read()
+
+
+@pytest.mark.parametrize(
+    "source",
+    [
+        "",
+        "hello",
+        "Hello, {{ you }}!",
+        "{% for x in xs %}" + LONG + "{{ x }}{% endfor %}",
+        LONG + "{{ you }}" + LONG,
+        "{% for x in xs %}{% for y in xs %}{{ x }}{{ y }}{% endfor %}"
+        + LONG
+        + "{% endfor %}",
+    ],
+)
+@pytest.mark.parametrize("chunk_size", [0, 1, 100, 4096, 65536])
+def test_render_to_fd_matches_render(
+    tmp: BinaryIO, source: str, chunk_size: int
+) -> None:
+    template = parse(source)
+    data = {"you": "wörld", "xs": range(100)}
+    want = template.render(data).encode()
+    written = template.render_to_fd(tmp.fileno(), data, chunk_size=chunk_size)
+    assert written == len(want)
+    assert read_all(tmp) == want
+
+
+def test_render_to_fd_accepts_objects_with_fileno(
+    tmp: BinaryIO,
+) -> None:
+    assert parse("{{ a }}").render_to_fd(tmp, {"a": "b"}) == 1
+    assert read_all(tmp) == b"b"
+
+
+def test_render_to_fd_with_overrides(
+    tmp: BinaryIO,
+) -> None:
+    parse("{{ a }} {{ b }}").render_to_fd(tmp, {"a": 1, "b": 2}, {"b": 3})
+    assert read_all(tmp) == b"1 3"
+
+
+def test_render_to_fd_pipe() -> None:
+    template = parse("{% for x in xs %}" + LONG + "{{ x }}{% endfor %}")
+    data = {"xs": range(20)}
+    want = template.render(data).encode()
+    r, w = os.pipe()
+
+    try:
+        # Small enough to fit in the pipe, so we can read it afterwards.
+        assert len(want) < 65536
+        assert template.render_to_fd(w, data, chunk_size=0) == len(want)
+        os.close(w)
+        w = -1
+
+        with os.fdopen(r, "rb") as f:
+            r = -1
+            assert f.read() == want
+    finally:
+        for fd in (r, w):
+            if fd >= 0:
+                os.close(fd)
+
+
+def test_render_to_fd_partial_writes() -> None:
+    # More output than a pipe holds, so writes are cut short while the
+    # reader catches up.
+    template = parse("{% for x in xs %}" + LONG + "{{ x }}{% endfor %}")
+    data = {"xs": range(500)}
+    want = template.render(data).encode()
+    got: list[bytes] = []
+    r, w = os.pipe()
+
+    def read() -> None:
+        with os.fdopen(r, "rb") as f:
+            got.append(f.read())
+
+    reader = threading.Thread(target=read)
+    reader.start()
+
+    try:
+        written = template.render_to_fd(w, data, chunk_size=1 << 20)
+    finally:
+        os.close(w)
+        reader.join()
+
+    assert written == len(want)
+    assert got == [want]
+
+
+def test_output_before_an_error_stays_written(
+    tmp: BinaryIO,
+) -> None:
+    template = parse(
+        "{% for x in xs %}{{ x }}{% endfor %}{{ nosuchthing }}",
+        undefined=StrictUndefined,
+    )
+
+    with pytest.raises(UndefinedVariableError):
+        template.render_to_fd(tmp, {"xs": range(10)}, chunk_size=0)
+
+    assert read_all(tmp) == b"0123456789"
+
+
+def test_bad_file_descriptor() -> None:
+    r, w = os.pipe()
+    os.close(r)
+    os.close(w)
+
+    with pytest.raises(OSError):
+        parse("hello").render_to_fd(w, {})
+
+
+def test_read_only_file_descriptor() -> None:
+    r, w = os.pipe()
+
+    try:
+        with pytest.raises(OSError):
+            parse("hello").render_to_fd(r, {})
+    finally:
+        os.close(r)
+        os.close(w)
+
+
+@pytest.mark.skipif(os.name == "nt", reason="needs EPIPE")
+def test_write_errors_report_bytes_written() -> None:
+    template = parse("{% for x in xs %}{{ x }}" + LONG + "{% endfor %}")
+    r, w = os.pipe()
+
+    def xs() -> Iterator[int]:
+        yield 0
+        yield 1
+        os.close(r)
+        yield 2
+
+    try:
+        with pytest.raises(BrokenPipeError) as exc_info:
+            template.render_to_fd(w, {"xs": xs()}, chunk_size=0)
+    finally:
+        os.close(w)
+
+    want = template.render({"xs": range(2)}).encode()
+    assert exc_info.value.characters_written == len(want)
+
+
+@pytest.mark.skipif(os.name == "nt", reason="needs a non-blocking pipe")
+def test_partial_write_errors_report_bytes_written() -> None:
+    template = parse("{% for x in xs %}{{ x }}" + LONG + "{% endfor %}")
+    r, w = os.pipe()
+    os.set_blocking(w, False)
+    os.set_blocking(r, False)
+
+    try:
+        # The pipe fills up part way through a chunk.
+        with pytest.raises(BlockingIOError) as exc_info:
+            template.render_to_fd(w, {"xs": range(10_000)}, chunk_size=1 << 20)
+
+        got = b""
+        while True:
+            try:
+                data = os.read(r, 1 << 16)
+            except BlockingIOError:
+                break
+            got += data
+    finally:
+        os.close(r)
+        os.close(w)
+
+    assert got
+    assert exc_info.value.characters_written == len(got)
+
+
+def test_negative_chunk_size() -> None:
+    with pytest.raises(ValueError):
+        parse("hello").render_to_fd(1, {}, chunk_size=-1)
+
+
+def test_not_a_file_descriptor() -> None:
+    with pytest.raises(TypeError):
+        parse("hello").render_to_fd("foo", {})  # type: ignore
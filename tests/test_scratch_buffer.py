@@ -0,0 +1,76 @@
+import threading
+
+from nano_template import parse
+
+
+def test_nested_renders() -> None:
+    inner = parse("<{{ x }}>")
+
+    def serializer(obj: object) -> str:
+        return inner.render({"x": obj})
+
+    outer = parse("{% for x in xs %}{{ x }}{% endfor %}", serializer=serializer)
+    assert outer.render({"xs": [1, 2, 3]}) == "<1><2><3>"
+    assert inner.render({"x": "a"}) == "<a>"
+
+
+def test_error_during_render() -> None:
+    def serializer(obj: object) -> str:
+        raise ValueError("oops")
+
+    broken = parse("abc {{ x }}", serializer=serializer)
+    template = parse("{{ x }}{{ y }}")
+
+    for _ in range(3):
+        try:
+            broken.render({"x": 1})
+        except ValueError:
+            pass
+        assert template.render({"x": "é", "y": 2}) == "é2"
+
+
+def test_templates_with_different_widths() -> None:
+    wide = parse("\U0001f600{{ x }}")
+    narrow = parse("a{{ x }}")
+    for _ in range(3):
+        assert wide.render({"x": "b" * 1000}) == "\U0001f600" + "b" * 1000
+        assert narrow.render({"x": "b" * 5000}) == "a" + "b" * 5000
+        assert narrow.render({"x": "€"}) == "a€"
+
+
+def test_long_strings_of_mixed_widths() -> None:
+    template = parse("{{ a }}{{ b }}{{ c }}")
+    for a, b, c in (
+        ("é" * 300, "x" * 300, "€" * 300),
+        ("x" * 300, "\U0001f600" * 300, "é"),
+        ("a", "\ud83d" * 300, "\ude00" * 300),
+    ):
+        result = template.render({"a": a, "b": b, "c": c})
+        assert result == a + b + c
+        assert len(result) == len(a) + len(b) + len(c)
+
+
+def test_many_small_renders_after_a_large_one() -> None:
+    template = parse("{{ x }}")
+    assert template.render({"x": "x" * 1_000_000}) == "x" * 1_000_000
+    for i in range(100):
+        assert template.render({"x": i}) == str(i)
+
+
+def test_renders_on_many_threads() -> None:
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    errors: list[str] = []
+
+    def run(n: int) -> None:
+        expect = "".join(f"{x}," for x in range(n))
+        for _ in range(50):
+            if template.render({"xs": range(n)}) != expect:
+                errors.append(f"bad output for {n}")
+
+    threads = [threading.Thread(target=run, args=(n,)) for n in range(0, 800, 100)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert not errors
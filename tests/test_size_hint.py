@@ -0,0 +1,37 @@
+import pytest
+
+from nano_template import parse
+
+
+def test_size_hint() -> None:
+    template = parse("{% for x in xs %}{{ x }},{% endfor %}")
+    data = {"xs": range(1000)}
+    expect = "".join(f"{x}," for x in range(1000))
+    assert template.render(data, size_hint=0) == expect
+    assert template.render(data, size_hint=10) == expect
+    assert template.render(data, size_hint=100_000) == expect
+    assert template.render(data, None, size_hint=None) == expect
+
+
+@pytest.mark.parametrize("hint", [-1, "10", 1.5])
+def test_invalid_size_hint(hint: object) -> None:
+    with pytest.raises((TypeError, ValueError)):
+        parse("{{ x }}").render({}, size_hint=hint)  # type: ignore
+
+
+def test_size_hint_is_keyword_only() -> None:
+    with pytest.raises(TypeError):
+        parse("{{ x }}").render({}, None, 10)  # type: ignore
+
+
+def test_output_size_varies_between_renders() -> None:
+    template = parse("{{ a }}{% for x in xs %}{{ x }}{% endfor %}")
+    for n in (10_000, 0, 5, 100_000, 3, 0):
+        assert template.render({"xs": ["x"] * n}) == "x" * n
+
+
+def test_output_width_varies_between_renders() -> None:
+    template = parse("{% for x in xs %}{{ x }}{% endfor %}")
+    for chars in ("abc", "\U0001f600", "é", "abc", "€\ud800", "xyz"):
+        data = {"xs": [chars] * 100}
+        assert template.render(data) == chars * 100
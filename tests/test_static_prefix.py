@@ -0,0 +1,136 @@
+import asyncio
+import os
+from typing import AsyncIterator
+
+import pytest
+
+from nano_template import StrictUndefined
+from nano_template import UndefinedVariableError
+from nano_template import parse
+
+
+@pytest.mark.parametrize(
+    "source,prefix,want",
+    [
+        ("", "", ""),
+        ("hello", "hello", "hello"),
+        ("Hello, {{ you }}!", "Hello, ", "Hello, World!"),
+        ("{{ you }} hello", "", "World hello"),
+        (
+            "<ul>\n  {%- for x in xs %}<li>{{ x }}</li>{% endfor %}",
+            "<ul>",
+            "<ul><li>1</li>",
+        ),
+        ("head {% if x %}x{% endif %} tail", "head ", "head x tail"),
+    ],
+)
+def test_static_prefix(source: str, prefix: str, want: str) -> None:
+    template = parse(source)
+    assert template.static_prefix == prefix
+    assert template.render({"you": "World", "x": 1, "xs": [1]}) == want
+
+
+@pytest.mark.parametrize("n", [1, 3, 4, 5, 8, 9, 20])
+def test_nodes_after_prefix(n: int) -> None:
+    template = parse("<" + "{{ x }}," * n + ">")
+    assert template.static_prefix == "<"
+    assert template.render({"x": 1}) == "<" + "1," * n + ">"
+
+
+def test_prefix_is_written_before_data_is_read() -> None:
+    template = parse("<html><body>{{ user.name }}</body></html>")
+    chunks: list[str] = []
+
+    class Data(dict[str, object]):
+        def __getitem__(self, key: str) -> object:
+            assert chunks == ["<html><body>"]
+            return super().__getitem__(key)
+
+    template.render_to(chunks.append, Data(user={"name": "Sue"}), flush_prefix=True)
+    assert chunks == ["<html><body>", "Sue</body></html>"]
+
+
+def test_prefix_is_written_before_errors() -> None:
+    template = parse("<html>{{ nosuchthing }}", undefined=StrictUndefined)
+    chunks: list[str] = []
+
+    with pytest.raises(UndefinedVariableError):
+        template.render_to(chunks.append, {}, flush_prefix=True)
+
+    assert chunks == ["<html>"]
+
+
+def test_prefix_is_part_of_the_first_chunk_by_default() -> None:
+    template = parse("<p>{% for x in xs %}{{ x }}{% endfor %}</p>")
+    chunks: list[str] = []
+    template.render_to(chunks.append, {"xs": range(3)})
+    assert chunks == ["<p>012</p>"]
+    assert list(template.iter_render({"xs": range(3)})) == ["<p>012</p>"]
+
+
+def test_flushed_prefix_is_written_to_fd_first() -> None:
+    template = parse("<p>{{ a }}</p>")
+    read_fd, write_fd = os.pipe()
+
+    class Data(dict[str, object]):
+        def __getitem__(self, key: str) -> object:
+            assert os.read(read_fd, 100) == b"<p>"
+            return super().__getitem__(key)
+
+    try:
+        n = template.render_to_fd(write_fd, Data(a="x"), flush_prefix=True)
+        assert n == 8
+        assert os.read(read_fd, 100) == b"x</p>"
+    finally:
+        os.close(read_fd)
+        os.close(write_fd)
+
+
+def test_iter_render_yields_prefix_first() -> None:
+    template = parse("<p>{% for x in xs %}{{ x }}{% endfor %}</p>")
+    it = template.iter_render({"xs": range(3)}, flush_prefix=True)
+    assert next(it) == "<p>"
+    assert list(it) == ["012</p>"]
+
+
+def test_render_async_iter_yields_prefix_before_awaiting() -> None:
+    template = parse("<p>{{ a }}</p>")
+    seen: list[str] = []
+
+    async def fetch() -> str:
+        assert seen == ["<p>"]
+        return "x"
+
+    async def main() -> list[str]:
+        async for chunk in template.render_async_iter(
+            {"a": fetch()}, flush_prefix=True
+        ):
+            seen.append(chunk)
+        return seen
+
+    assert asyncio.run(main()) == ["<p>", "x</p>"]
+
+
+def test_render_async_iter_includes_prefix_in_first_chunk() -> None:
+    template = parse("<p>{{ a }}</p>")
+
+    async def fetch() -> str:
+        return "x"
+
+    async def main() -> list[str]:
+        return [c async for c in template.render_async_iter({"a": fetch()})]
+
+    assert asyncio.run(main()) == ["<p>x</p>"]
+
+
+def test_render_async_includes_prefix() -> None:
+    template = parse("<p>{% for r in rows %}{{ r }}{% endfor %}</p>")
+
+    async def rows() -> AsyncIterator[int]:
+        for i in range(3):
+            yield i
+
+    async def main() -> str:
+        return await template.render_async({"rows": rows()})
+
+    assert asyncio.run(main()) == "<p>012</p>"
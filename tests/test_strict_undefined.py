@@ -36,3 +36,12 @@ def test_loop_over_strict_undefined() -> None:
             data={},
             undefined=StrictUndefined,
         )
+
+
+def test_strict_undefined_long_path() -> None:
+    with pytest.raises(UndefinedVariableError, match="'a.b.c.d.nosuchthing'"):
+        render(
+            "{{ a.b.c.d.nosuchthing.f }}",
+            data={"a": {"b": {"c": {"d": {}}}}},
+            undefined=StrictUndefined,
+        )
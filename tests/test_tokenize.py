@@ -190,6 +190,30 @@ def test_for() -> None:
         assert want == got
 
 
+def test_for_key_value() -> None:
+    text = "{% for k, v in y %}{% endfor %}"
+    tokens = _tokenize(text)
+
+    expect: list[_T] = [
+        _T(Kind.TOK_TAG_START, "{%"),
+        _T(Kind.TOK_FOR_TAG, "for"),
+        _T(Kind.TOK_WORD, "k"),
+        _T(Kind.TOK_COMMA, ","),
+        _T(Kind.TOK_WORD, "v"),
+        _T(Kind.TOK_IN, "in"),
+        _T(Kind.TOK_WORD, "y"),
+        _T(Kind.TOK_TAG_END, "%}"),
+        _T(Kind.TOK_TAG_START, "{%"),
+        _T(Kind.TOK_ENDFOR_TAG, "endfor"),
+        _T(Kind.TOK_TAG_END, "%}"),
+        _T(Kind.TOK_EOF, ""),
+    ]
+
+    assert len(tokens) == len(expect)
+    for want, got in zip(expect, tokens):
+        assert want == got
+
+
 def test_whitespace_control() -> None:
     text = "Hello {%- if true ~%}{{~ you -}}{% endif %}!"
     tokens = _tokenize(text)